@@ -0,0 +1,53 @@
+(* allocation-heavy: build and walk many complete binary trees *)
+class Tree {
+    left: Tree;
+    right: Tree;
+
+    init(l: Tree, r: Tree): Tree {{ left <- l; right <- r; self; }};
+
+    check(): Int {
+        if isvoid left then 1 else 1 + left.check() + right.check() fi
+    };
+};
+
+class Main inherits IO {
+    make(depth: Int): Tree {
+        if depth = 0 then (new Tree).init(new Tree, new Tree)
+        else (new Tree).init(make(depth - 1), make(depth - 1)) fi
+    };
+
+    main(): Int {
+        let max: Int <- 12, depth: Int <- 4, total: Int <- 0 in {
+            out_string("stretch ").out_string(make(max + 1).check().to_string())
+                .out_string("\n");
+            let long: Tree <- make(max) in {
+                while depth <= max loop {
+                    let n: Int <- 1, i: Int <- 0, check: Int <- 0 in {
+                        (* 2^(max - depth + 4) trees of each depth *)
+                        let k: Int <- max - depth + 4 in
+                            while 0 < k loop { n <- n * 2; k <- k - 1; } pool;
+                        while i < n loop {
+                            check <- check + make(depth).check();
+                            i <- i + 1;
+                        } pool;
+                        out_string(n.to_string()).out_string(" trees of depth ")
+                            .out_string(depth.to_string()).out_string(" check ")
+                            .out_string(check.to_string()).out_string("\n");
+                    };
+                    depth <- depth + 2;
+                } pool;
+                out_string("long lived ").out_string(long.check().to_string())
+                    .out_string("\n");
+            };
+            0;
+        }
+    };
+};
+
+-- stretch 32767
+-- 4096 trees of depth 4 check 258048
+-- 1024 trees of depth 6 check 261120
+-- 256 trees of depth 8 check 261888
+-- 64 trees of depth 10 check 262080
+-- 16 trees of depth 12 check 262128
+-- long lived 16383
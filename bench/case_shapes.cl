@@ -0,0 +1,55 @@
+(* case-heavy: classify objects of several classes by case *)
+class Shape {
+    size: Int;
+    init(s: Int): Shape {{ size <- s; self; }};
+    size(): Int { size };
+};
+class Square inherits Shape {};
+class Circle inherits Shape {};
+class Triangle inherits Shape {};
+class Hexagon inherits Shape {};
+
+class Node {
+    shape: Shape;
+    next: Node;
+    init(s: Shape, n: Node): Node {{ shape <- s; next <- n; self; }};
+    shape(): Shape { shape };
+    next(): Node { next };
+};
+
+class Main inherits IO {
+    make(i: Int): Shape {
+        let k: Int <- i - i / 4 * 4 in
+            if k = 0 then (new Square).init(i) else
+            if k = 1 then (new Circle).init(i) else
+            if k = 2 then (new Triangle).init(i) else (new Hexagon).init(i) fi fi fi
+    };
+
+    area(s: Shape): Int {
+        case s of
+            q: Square => q.size() * q.size();
+            c: Circle => 3 * c.size() * c.size();
+            t: Triangle => t.size() * t.size() / 2;
+            h: Hexagon => 5 * h.size() * h.size() / 2;
+            o: Object => 0;
+        esac
+    };
+
+    main(): Int {
+        let list: Node, i: Int <- 0, round: Int <- 0, total: Int <- 0 in {
+            while i < 1000 loop { list <- (new Node).init(make(i), list); i <- i + 1; } pool;
+            while round < 1000 loop {
+                let n: Node <- list in
+                    while not isvoid n loop {
+                        total <- total + area(n.shape()) / 1000;
+                        n <- n.next();
+                    } pool;
+                round <- round + 1;
+            } pool;
+            out_string(total.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- 582247000
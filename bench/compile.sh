@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Measures the phases of `src/coolc $COOLCFLAGS`, with --time-report, on
+# programs of COMPILE_SIZES lines (1000, 10000, 100000 and 1000000 by
+# default) made by bench/gen.sh, in chains of 5 classes with 10 methods of 18
+# nested expressions. Writes the reports as JSON to BENCH_OUT,
+# bench/results/compile-COMMIT.json by default.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+sizes=${COMPILE_SIZES:-1000 10000 100000 1000000}
+depth=5
+methods=10
+nesting=18
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if ! git diff --quiet HEAD -- src 2>/dev/null; then
+    commit="$commit-dirty"
+fi
+out=${BENCH_OUT:-bench/results/compile-$commit.json}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+mkdir -p "$(dirname "$out")"
+{
+    echo "{"
+    echo "  \"commit\": \"$commit\","
+    echo "  \"coolcflags\": \"$COOLCFLAGS\","
+    echo "  \"programs\": ["
+} > "$work/json"
+
+sep=
+for size in $sizes; do
+    classes=$((size / (methods * (nesting + 2) + 3)))
+    if [ "$classes" -lt 1 ]; then
+        classes=1
+    fi
+    bench/gen.sh "$classes" "$depth" "$methods" "$nesting" > "$work/gen.cl"
+    lines=$(wc -l < "$work/gen.cl")
+
+    src/coolc --time-report=json $COOLCFLAGS "$work/gen" "$work/gen.cl" 2> "$work/report"
+    "$work/gen" > /dev/null
+
+    report=$(sed -n -e '/^[ {}]/s/^/    /p' "$work/report")
+    total=$(sed -n -E -e 's/^  "seconds": (.*),$/\1/p' "$work/report")
+    echo "$lines lines, $classes classes: $total seconds"
+    printf '%s    {"lines": %s, "classes": %s, "report":\n%s}' \
+        "$sep" "$lines" "$classes" "$report" >> "$work/json"
+    sep=$',\n'
+done
+
+{
+    echo
+    echo "  ]"
+    echo "}"
+} >> "$work/json"
+mv "$work/json" "$out"
+echo "results written to $out"
@@ -0,0 +1,13 @@
+(* call-heavy: naive recursive Fibonacci *)
+class Main inherits IO {
+    fib(n: Int): Int {
+        if n < 2 then n else fib(n - 1) + fib(n - 2) fi
+    };
+
+    main(): Int {{
+        out_string(fib(28).to_string()).out_string("\n");
+        0;
+    }};
+};
+
+-- 317811
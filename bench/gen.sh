@@ -0,0 +1,72 @@
+#!/bin/bash
+#
+# Usage: bench/gen.sh CLASSES DEPTH METHODS NESTING
+#
+# Writes a COOL program to stdout with CLASSES classes in inheritance chains
+# of DEPTH classes, METHODS methods in each, overriding those of the same
+# name up the chain, and method bodies of NESTING nested expressions. Every
+# method is reachable from Main.main, which prints one sum. The program has
+# about CLASSES * METHODS * (NESTING + 2) lines.
+
+set -e
+
+if [ $# -ne 4 ]; then
+    echo "Usage: $0 CLASSES DEPTH METHODS NESTING" >&2
+    exit 1
+fi
+
+awk -v classes="$1" -v depth="$2" -v methods="$3" -v nesting="$4" '
+function indent(n) {
+    return sprintf("%" (2 * n) "s", "")
+}
+
+# an Int expression nested k deep in method j of class i; the innermost one
+# calls the method before, so that every method is reached
+function expr(i, j, k, ind) {
+    if (k == 0) {
+        return indent(ind) (j > 0 ? "self.m" (j - 1) "(x)" : "x + f" i)
+    }
+    inner = expr(i, j, k - 1, ind + 1)
+    s = (i + j + k) % 5
+    if (s == 0) {
+        return indent(ind) "(" k " +\n" inner ")"
+    }
+    if (s == 1) {
+        return indent(ind) "if x < " k " then x - f" i " else\n" inner " fi"
+    }
+    if (s == 2) {
+        return indent(ind) "let y : Int <- x * " k " in\n" inner
+    }
+    if (s == 3) {
+        return indent(ind) "{ f" i " <- f" i " + " k ";\n" inner "; }"
+    }
+    return indent(ind) "case self of o : C" i " =>\n" inner "; esac"
+}
+
+BEGIN {
+    for (i = 0; i < classes; i++) {
+        parent = i % depth == 0 ? "" : " inherits C" (i - 1)
+        print "class C" i parent " {"
+        print "  f" i " : Int <- " i ";"
+        for (j = 0; j < methods; j++) {
+            print "  m" j "(x : Int) : Int {"
+            print expr(i, j, nesting, 2)
+            print "  };"
+        }
+        print "};"
+        print ""
+    }
+
+    print "class Main inherits IO {"
+    print "  main() : Int {"
+    print "    let s : Int <- 0 in {"
+    for (i = 0; i < classes; i++) {
+        print "      s <- s + (new C" i ").m" (methods - 1) "(" i ");"
+    }
+    print "      out_string(s.to_string().concat(\"\\n\"));"
+    print "      0;"
+    print "    }"
+    print "  };"
+    print "};"
+}
+'
@@ -0,0 +1,127 @@
+(* case-heavy: insertion sort of a list of boxed Ints, on the List of
+   example/list.cl *)
+class ListNode {
+    prev : ListNode;
+    next : ListNode;
+    data : Object;
+
+    get_prev() : ListNode {
+        prev
+    };
+
+    set_prev(node : ListNode) : SELF_TYPE {{
+        prev <- node;
+        self;
+    }};
+
+    get_next() : ListNode {
+        next
+    };
+
+    set_next(node : ListNode) : SELF_TYPE {{
+        next <- node;
+        self;
+    }};
+
+    get_data() : Object {
+        data
+    };
+
+    set_data(obj : Object) : SELF_TYPE {{
+        data <- obj;
+        self;
+    }};
+};
+
+class List {
+    head : ListNode <- new ListNode;
+    tail : ListNode <- new ListNode;
+
+    init() : SELF_TYPE {{
+        head.set_next(tail);
+        tail.set_prev(head);
+        self;
+    }};
+
+    append(obj : Object) : SELF_TYPE {{
+        let node : ListNode <- new ListNode in {
+            node.set_data(obj);
+            node.set_prev(tail.get_prev());
+            node.set_next(tail);
+            tail.get_prev().set_next(node);
+            tail.set_prev(node);
+        };
+        self;
+    }};
+
+    prepend(obj : Object) : SELF_TYPE {{
+        let node : ListNode <- new ListNode in {
+            node.set_data(obj);
+            node.set_prev(head);
+            node.set_next(head.get_next());
+            head.get_next().set_prev(node);
+            head.set_next(node);
+        };
+        self;
+    }};
+
+    get_head() : ListNode {
+        head
+    };
+
+    get_tail() : ListNode {
+        tail
+    };
+};
+
+class Main inherits IO {
+    value(node: ListNode): Int {
+        case node.get_data() of
+            i: Int => i;
+        esac
+    };
+
+    sort(list: List): List {
+        let node: ListNode <- list.get_head().get_next() in {
+            while not isvoid node.get_next() loop {
+                let x: Int <- value(node), prev: ListNode <- node.get_prev() in {
+                    while if isvoid prev.get_prev() then false
+                          else x < value(prev) fi loop {
+                        prev.get_next().set_data(prev.get_data());
+                        prev <- prev.get_prev();
+                    } pool;
+                    prev.get_next().set_data(x);
+                };
+                node <- node.get_next();
+            } pool;
+            list;
+        }
+    };
+
+    main(): Int {
+        let list: List <- new List, seed: Int <- 42, i: Int <- 0,
+            sum: Int <- 0 in {
+            list.init();
+            while i < 5000 loop {
+                seed <- seed * 75 + 74;
+                seed <- seed - seed / 65537 * 65537;
+                list.append(seed);
+                i <- i + 1;
+            } pool;
+            sort(list);
+            i <- 0;
+            let node: ListNode <- list.get_head().get_next() in
+                while not isvoid node.get_next() loop {
+                    i <- i + 1;
+                    sum <- sum + i * value(node);
+                    node <- node.get_next();
+                } pool;
+            out_string(value(list.get_head().get_next()).to_string()).out_string(" ")
+                .out_string(value(list.get_tail().get_prev()).to_string()).out_string(" ")
+                .out_string(sum.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- 9 65522 550836363436
@@ -0,0 +1,77 @@
+(* arithmetic-heavy: n-body simulation in fixed-point integers *)
+class Body {
+    x: Int; y: Int; vx: Int; vy: Int; m: Int;
+    next: Body;
+
+    init(x0: Int, y0: Int, vx0: Int, vy0: Int, m0: Int, n: Body): Body {{
+        x <- x0; y <- y0; vx <- vx0; vy <- vy0; m <- m0; next <- n;
+        self;
+    }};
+
+    x(): Int { x };
+    y(): Int { y };
+    m(): Int { m };
+    next(): Body { next };
+
+    pull(dx: Int, dy: Int, k: Int): Body {{
+        vx <- vx + dx * k / 1000000;
+        vy <- vy + dy * k / 1000000;
+        self;
+    }};
+
+    move(): Body {{
+        x <- x + vx / 100;
+        y <- y + vy / 100;
+        self;
+    }};
+
+    sum(): Int { x + y + vx + vy };
+};
+
+class Main inherits IO {
+    isqrt(n: Int): Int {
+        if n < 2 then n else
+            let x: Int <- n, y: Int <- (n + 1) / 2 in {
+                while y < x loop { x <- y; y <- (x + n / x) / 2; } pool;
+                x;
+            }
+        fi
+    };
+
+    step(bodies: Body): Object {
+        let a: Body <- bodies in {
+            while not isvoid a loop {
+                let b: Body <- a.next() in
+                    while not isvoid b loop {
+                        let dx: Int <- b.x() - a.x(), dy: Int <- b.y() - a.y(),
+                            d2: Int <- dx * dx + dy * dy + 10000,
+                            k: Int <- 1000000000 / (d2 * isqrt(d2) / 100 + 1) in {
+                            a.pull(dx, dy, b.m() * k);
+                            b.pull(0 - dx, 0 - dy, a.m() * k);
+                        };
+                        b <- b.next();
+                    } pool;
+                a.move();
+                a <- a.next();
+            } pool;
+        }
+    };
+
+    main(): Int {
+        let none: Body, bodies: Body <-
+                (new Body).init(0, 0, 0, 0, 5000,
+                (new Body).init(1000, 0, 0, 7000, 10,
+                (new Body).init(0, 1500, 0 - 5800, 0, 20,
+                (new Body).init(0 - 2000, 0, 0, 0 - 5000, 30,
+                (new Body).init(0, 0 - 2500, 4500, 0, 40, none))))),
+            i: Int <- 0, sum: Int <- 0 in {
+            while i < 4000 loop { step(bodies); i <- i + 1; } pool;
+            let b: Body <- bodies in
+                while not isvoid b loop { sum <- sum + b.sum(); b <- b.next(); } pool;
+            out_string(sum.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- -8786
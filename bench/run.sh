@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# Builds every bench/*.cl with `src/coolc $COOLCFLAGS`, checks what it
+# prints against its `-- ` lines like the tests do, then runs it BENCH_RUNS
+# times (3 by default). Reports the best wall time, the instructions retired
+# (with perf), the peak RSS (with GNU time) and the size of the executable,
+# and writes them as JSON to BENCH_OUT, bench/results/COMMIT.json by default.
+# Every benchmark reads the same generated text on stdin.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+runs=${BENCH_RUNS:-3}
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if ! git diff --quiet HEAD -- src 2>/dev/null; then
+    commit="$commit-dirty"
+fi
+out=${BENCH_OUT:-bench/results/$commit.json}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+for ((i = 0; i < 10000; i++)); do
+    echo "the quick brown fox jumps over the lazy dog"
+    printf '\tpack my box with  five dozen liquor jugs 1234\n'
+done > "$work/input"
+
+have_perf=
+if command -v perf > /dev/null && perf stat -e instructions true 2> /dev/null; then
+    have_perf=1
+fi
+have_time=
+if [ -x /usr/bin/time ]; then
+    have_time=1
+fi
+
+mkdir -p "$(dirname "$out")"
+{
+    echo "{"
+    echo "  \"commit\": \"$commit\","
+    echo "  \"coolcflags\": \"$COOLCFLAGS\","
+    echo "  \"benchmarks\": ["
+} > "$work/json"
+
+printf "%-14s %10s %14s %10s %10s\n" benchmark "wall (s)" instructions "RSS (KB)" "size (B)"
+sep=
+for src in bench/*.cl; do
+    name=$(basename "$src" .cl)
+    exe="$work/$name"
+    src/coolc $COOLCFLAGS "$exe" "$src"
+
+    if ! diff <("$exe" < "$work/input" 2>&1) <(sed -n -E -e 's@^.*-- (.*)$@\1@p' "$src"); then
+        echo "$name: wrong output" >&2
+        exit 1
+    fi
+
+    best=
+    for ((i = 0; i < runs; i++)); do
+        start=$(date +%s%N)
+        "$exe" < "$work/input" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ns=$((end - start))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+    done
+    wall=$(awk -v ns="$best" 'BEGIN { printf "%.4f", ns / 1e9 }')
+
+    instructions=null
+    if [ -n "$have_perf" ]; then
+        perf stat -x, -e instructions -o "$work/perf" "$exe" < "$work/input" > /dev/null 2>&1
+        instructions=$(awk -F, '$3 ~ /^instructions/ && $1 ~ /^[0-9]+$/ { print $1 }' "$work/perf")
+        instructions=${instructions:-null}
+    fi
+
+    rss=null
+    if [ -n "$have_time" ]; then
+        /usr/bin/time -f %M -o "$work/time" "$exe" < "$work/input" > /dev/null 2>&1
+        rss=$(tail -n 1 "$work/time")
+    fi
+
+    size=$(stat -c %s "$exe")
+
+    printf "%-14s %10s %14s %10s %10s\n" "$name" "$wall" "$instructions" "$rss" "$size"
+    printf '%s    {"name": "%s", "wall_seconds": %s, "instructions": %s, "max_rss_kb": %s, "binary_bytes": %s}' \
+        "$sep" "$name" "$wall" "$instructions" "$rss" "$size" >> "$work/json"
+    sep=$',\n'
+done
+
+{
+    echo
+    echo "  ]"
+    echo "}"
+} >> "$work/json"
+mv "$work/json" "$out"
+echo "results written to $out"
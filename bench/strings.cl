@@ -0,0 +1,41 @@
+(* string-heavy: build, reverse and scan strings *)
+class Main inherits IO {
+    reverse(s: String): String {
+        let r: String <- "", i: Int <- s.length() in {
+            while 0 < i loop {
+                r <- r.concat(s.substr(i - 1, i));
+                i <- i - 1;
+            } pool;
+            r;
+        }
+    };
+
+    digits(s: String): Int {
+        let n: Int <- 0, i: Int <- 0 in {
+            while i < s.length() loop {
+                n <- n + s.substr(i, i + 1).to_int();
+                i <- i + 1;
+            } pool;
+            n;
+        }
+    };
+
+    main(): Int {
+        let round: Int <- 0, total: Int <- 0 in {
+            while round < 100 loop {
+                let s: String <- "", i: Int <- 0 in {
+                    while i < 200 loop {
+                        s <- s.concat((round * 1000 + i).to_string()).concat(",");
+                        i <- i + 1;
+                    } pool;
+                    total <- total + digits(reverse(s)) + s.length();
+                };
+                round <- round + 1;
+            } pool;
+            out_string(total.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- 487690
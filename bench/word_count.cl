@@ -0,0 +1,30 @@
+(* IO- and string-heavy: count the lines, words and characters of stdin *)
+class Main inherits IO {
+    main(): Int {
+        let lines: Int <- 0, words: Int <- 0, chars: Int <- 0,
+            line: String <- in_string() in {
+            while 0 < line.length() loop {
+                let i: Int <- 0, n: Int <- line.length(), in_word: Bool <- false in
+                    while i < n loop {
+                        (* atol skips leading white space: " 1" is 1, "a1" 0 *)
+                        if line.substr(i, i + 1).concat("1").to_int() = 1 then
+                            in_word <- false
+                        else {
+                            if not in_word then words <- words + 1 else 0 fi;
+                            in_word <- true;
+                        } fi;
+                        i <- i + 1;
+                    } pool;
+                lines <- lines + 1;
+                chars <- chars + line.length();
+                line <- in_string();
+            } pool;
+            out_string(lines.to_string()).out_string(" ")
+                .out_string(words.to_string()).out_string(" ")
+                .out_string(chars.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- 20000 180000 910000
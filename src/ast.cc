@@ -1,11 +1,20 @@
 #include "ast.hh"
 
+#include <algorithm>
+#include <sstream>
+
 #include "cg.hh"
 #include "sa.hh"
 #include "util.hh"
 
 namespace ast {
 
+std::string Node::site() {
+  std::ostringstream o;
+  o << loc;
+  return o.str();
+}
+
 void Assign::print(std::ostream &o, int indent) {
   o << std::string(indent, ' ') << name << " <-"
     << " @" << loc << std::endl;
@@ -31,10 +40,10 @@ Class *Assign::type(cool::SemanticAnalyser *sa) {
   return right;
 }
 
-void Assign::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # ASSIGN " + name + "\n";
+void Assign::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   expr->generate(cg, o);
-  o << "  movq %rax, " + cg->scope.find(name) + "\n";
+  o.ins("movq", x86::RAX, cg->scope.find(name));
 }
 
 void Invoke::print(std::ostream &o, int indent) {
@@ -111,43 +120,121 @@ Class *Invoke::type(cool::SemanticAnalyser *sa) {
   return sa->name2Class[method->ret_type_name].get();
 }
 
-void Invoke::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # INVOKE " + name + "\n";
+Class *Invoke::target_class() {
+  if (type_name.empty() && type_sa->is_overridden(name)) {
+    return nullptr;
+  }
+  return type_sa->get_method_class(name);
+}
 
-  o << "  pushq %rbx\n"; // save rbx
+void Invoke::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  // for COOL_STATS, however the dispatch is compiled; the ones of `__init__`
+  // to that of the parent belong to `new`
+  if (name != cool::init_method_name) {
+    o.ins("incq", x86::sym("stats_dispatches"));
+  }
+  // the frame can be reused if the arguments fit in it
+  auto cls = target_class();
+  if (tail && cls && !cg->options.instrument_calls &&
+      (cls->name2Method[name] == cg->selfMethod ||
+       arguments.size() <= cg->selfMethod->formals.size())) {
+    tail_generate(cg, o, cls);
+    return;
+  }
+
+  // results of arithmetic given to a built-in method that keeps no
+  // reference to them are built in the frame, 6 slots each
+  bool stack = cls && cg->keeps_no_reference(cls, name);
+  int boxes = 0, base = cg->offset_rbp;
+  if (stack) {
+    boxes = is_int_op(expr_sa.get());
+    for (auto &arg : arguments) {
+      boxes += is_int_op(arg.get());
+    }
+  }
+  if (boxes) {
+    o.ins("subq", x86::imm(boxes * 48), x86::RSP);
+    cg->offset_rbp += boxes * 6;
+  }
+  auto operand_generate = [&](Expression *e) {
+    if (stack && is_int_op(e)) {
+      int_value_generate(cg, o, e);
+      base += 6;
+      cg->stack_int_generate(o, base * (-8));
+    } else {
+      e->generate(cg, o);
+    }
+  };
+
+  o.ins("pushq", x86::RBX); // save rbx
   cg->offset_rbp++;
 
   // push arguments
   for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) {
-    it->get()->generate(cg, o);
-    o << "  pushq %rax\n";
+    operand_generate(it->get());
+    o.ins("pushq", x86::RAX);
     cg->offset_rbp++;
   }
 
-  expr_sa->generate(cg, o);
+  operand_generate(expr_sa.get());
 
-  o << "  cmpq $0, %rax\n";
-  o << "  je _invoke_on_void\n";
+  if (!receiver_non_void) {
+    o.ins("cmpq", x86::imm(0), x86::RAX);
+    o.ins("je", x86::sym("_invoke_on_void"));
+  }
 
-  o << "  movq %rax, %rbx\n"; // this
+  o.ins("movq", x86::RAX, x86::RBX); // this
 
   // invoke
 
-  if (type_name.empty()) {
-    o << "  movq 32(%rbx), %rax\n"; // method table
+  if (cls) {
+    cg->call_generate(o, cls, name);
   } else {
-    o << "  movq $" + type_sa->name + "_method_table, %rax\n"; // method table
+    cg->dispatch_generate(o, type_sa, name, site());
   }
 
-  o << "  call *" + std::to_string(type_sa->methods_numbered[name] * 8) +
-           "(%rax)\n";
-
-  o << "  addq $" + std::to_string(arguments.size() * 8) +
-           ", %rsp\n"; // pop arguments
+  o.ins("addq", x86::imm(arguments.size() * 8), x86::RSP); // pop arguments
   cg->offset_rbp -= arguments.size();
 
-  o << "  popq %rbx\n"; // restore rbx
+  o.ins("popq", x86::RBX); // restore rbx
   cg->offset_rbp -= 1;
+
+  if (boxes) {
+    o.ins("addq", x86::imm(boxes * 48), x86::RSP);
+    cg->offset_rbp -= boxes * 6;
+  }
+}
+
+void Invoke::tail_generate(cool::CodeGenerator *cg, x86::Emitter &o,
+                           Class *cls) {
+  for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) {
+    it->get()->generate(cg, o);
+    o.ins("pushq", x86::RAX);
+    cg->offset_rbp++;
+  }
+
+  expr_sa->generate(cg, o);
+
+  if (!receiver_non_void) {
+    o.ins("cmpq", x86::imm(0), x86::RAX);
+    o.ins("je", x86::sym("_invoke_on_void"));
+  }
+
+  o.ins("movq", x86::RAX, x86::RBX); // this
+
+  // the arguments replace those of the method being generated
+  for (int i = 0; i < arguments.size(); ++i) {
+    o.ins("popq", x86::mem((2 + i) * 8, x86::RBP));
+  }
+  cg->offset_rbp -= arguments.size();
+
+  o.ins("movq", x86::RBP, x86::RSP);
+  if (cls->name2Method[name] == cg->selfMethod) {
+    o.ins("jmp", x86::sym(cg->selfMethodEntry));
+  } else {
+    cg->epilogue_generate(o, cls->name + "." + name);
+  }
 }
 
 void If::print(std::ostream &o, int indent) {
@@ -182,18 +269,35 @@ Class *If::type(cool::SemanticAnalyser *sa) {
   return sa->common_ancestor(b_type, c_type);
 }
 
-void If::generate(cool::CodeGenerator *cg, std::ostream &o) {
+void If::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   auto label_1 = cg->next_label();
   auto label_2 = cg->next_label();
-  o << "  # IF\n";
   a->generate(cg, o);
-  o << "  cmpq $0, 40(%rax)\n";
-  o << "  je " + label_1 + "\n";
+  o.ins("cmpq", x86::imm(0), x86::mem(40, x86::RAX));
+
+  // the arm taken more often falls through
+  auto key = "if " + site();
+  if (cg->profile_count(key + " else") > cg->profile_count(key + " then")) {
+    o.ins("jne", x86::sym(label_1));
+    cg->count_generate(o, key + " else");
+    c->generate(cg, o);
+    o.ins("jmp", x86::sym(label_2));
+    o.label(label_1);
+    cg->count_generate(o, key + " then");
+    b->generate(cg, o);
+    o.label(label_2);
+    return;
+  }
+
+  o.ins("je", x86::sym(label_1));
+  cg->count_generate(o, key + " then");
   b->generate(cg, o);
-  o << "  jmp " + label_2 + "\n";
-  o << label_1 + ":\n";
+  o.ins("jmp", x86::sym(label_2));
+  o.label(label_1);
+  cg->count_generate(o, key + " else");
   c->generate(cg, o);
-  o << label_2 + ":\n";
+  o.label(label_2);
 }
 
 void While::print(std::ostream &o, int indent) {
@@ -222,30 +326,29 @@ Class *While::type(cool::SemanticAnalyser *sa) {
   return sa->objectClass.get();
 }
 
-void While::generate(cool::CodeGenerator *cg, std::ostream &o) {
+void While::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   auto label_1 = cg->next_label();
   auto label_2 = cg->next_label();
 
-  o << "  # WHILE\n";
-  o << "  xorq %rax, %rax\n";
-
-  o << label_1 + ":\n";
-  o << "  pushq %rax\n"; // save rax
-  cg->offset_rbp++;
+  auto key = "while " + site() + " body";
 
+  // the loop head, unless the profile has it cold
+  if (!cg->options.profile || cg->profile_count(key) > 0) {
+    o.directive(".p2align", "4,,10");
+  }
+  o.label(label_1);
   a->generate(cg, o);
 
-  o << "  popq %rcx\n"; // restore
-  cg->offset_rbp--;
-
-  o << "  cmpq $0, 40(%rax)\n";
-  o << "  je " + label_2 + "\n";
+  o.ins("cmpq", x86::imm(0), x86::mem(40, x86::RAX));
+  o.ins("je", x86::sym(label_2));
 
+  cg->count_generate(o, key);
   b->generate(cg, o);
-  o << "  jmp " + label_1 + "\n";
+  o.ins("jmp", x86::sym(label_1));
 
-  o << label_2 + ":\n";
-  o << "  movq %rcx, %rax\n";
+  o.label(label_2);
+  o.ins("xorq", x86::RAX, x86::RAX); // void
 }
 
 void Block::print(std::ostream &o, int indent) {
@@ -271,8 +374,8 @@ Class *Block::type(cool::SemanticAnalyser *sa) {
   return expressions.back()->type(sa);
 }
 
-void Block::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # BLOCK\n";
+void Block::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   for (auto &expr : expressions) {
     expr->generate(cg, o);
   }
@@ -309,13 +412,13 @@ Class *Let::type(cool::SemanticAnalyser *sa) {
   return res;
 }
 
-void Let::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # LET " + name + "\n";
-  o << "  pushq $0\n"; // a local variable
+void Let::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  o.ins("pushq", x86::imm(0)); // a local variable
   cg->offset_rbp++;
 
   cg->scope.enter();
-  cg->scope.add(name, std::to_string(cg->offset_rbp * (-8)) + "(%rbp)");
+  cg->scope.add(name, x86::mem(cg->offset_rbp * (-8), x86::RBP));
 
   expr_cg = expr;
   if (std::dynamic_pointer_cast<Void>(expr_cg)) {
@@ -331,14 +434,14 @@ void Let::generate(cool::CodeGenerator *cg, std::ostream &o) {
 
   if (!std::dynamic_pointer_cast<Void>(expr_cg)) {
     expr_cg->generate(cg, o);
-    o << "  movq %rax, " + cg->scope.find(name) + "\n";
+    o.ins("movq", x86::RAX, cg->scope.find(name));
   }
 
   body->generate(cg, o);
 
   cg->scope.exit();
 
-  o << "  popq %rcx\n";
+  o.ins("popq", x86::RCX);
   cg->offset_rbp--;
 }
 
@@ -397,42 +500,56 @@ Class *Case::type(cool::SemanticAnalyser *sa) {
   return sa->common_ancestor(branch_expr_types);
 }
 
-void Case::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # CASE\n";
+void Case::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  o.ins("incq", x86::sym("stats_cases"));
   expr->generate(cg, o);
 
-  o << "  cmpq $0, %rax\n";
-  o << "  je _case_on_void\n";
+  if (!expr_non_void) {
+    o.ins("cmpq", x86::imm(0), x86::RAX);
+    o.ins("je", x86::sym("_case_on_void"));
+  }
 
   auto label_done = cg->next_label();
 
-  for (auto &branch : branches) {
+  // branches match exact classes, so they can be tried most taken first
+  auto key = "case " + site() + " ";
+  std::vector<std::shared_ptr<CaseBranch>> ordered(branches.begin(),
+                                                   branches.end());
+  std::stable_sort(ordered.begin(), ordered.end(),
+                   [&](const std::shared_ptr<CaseBranch> &x,
+                       const std::shared_ptr<CaseBranch> &y) {
+                     return cg->profile_count(key + x->type->name) >
+                            cg->profile_count(key + y->type->name);
+                   });
+
+  for (auto &branch : ordered) {
     auto label_1 = cg->next_label();
 
-    o << "  cmpq $" + std::to_string(branch->type->id) +
-             ", 16(%rax)\n"; // compare class id
-    o << "  jne " + label_1 + "\n";
+    o.ins("cmpq", x86::imm(branch->type->id),
+          x86::mem(16, x86::RAX)); // compare class id
+    o.ins("jne", x86::sym(label_1));
+    cg->count_generate(o, key + branch->type->name);
 
-    o << "  pushq %rax\n"; // a new local variable
+    o.ins("pushq", x86::RAX); // a new local variable
     cg->offset_rbp++;
     cg->scope.enter();
-    cg->scope.add(branch->name,
-                  std::to_string(cg->offset_rbp * (-8)) + "(%rbp)");
+    cg->scope.add(branch->name, x86::mem(cg->offset_rbp * (-8), x86::RBP));
 
     branch->expr->generate(cg, o);
 
-    o << "  popq %rcx\n";
+    o.ins("popq", x86::RCX);
     cg->offset_rbp--;
     cg->scope.exit();
 
-    o << "  jmp " + label_done + "\n";
+    o.ins("jmp", x86::sym(label_done));
 
-    o << label_1 + ":\n";
+    o.label(label_1);
   }
 
-  o << "  jmp _case_no_match\n";
+  o.ins("jmp", x86::sym("_case_no_match"));
 
-  o << label_done + ":\n";
+  o.label(label_done);
 }
 
 void New::print(std::ostream &o, int indent) {
@@ -449,27 +566,26 @@ Class *New::type(cool::SemanticAnalyser *sa) {
   return type_sa;
 }
 
-void new_generate(cool::CodeGenerator *cg, std::ostream &o, Class *cls) {
-  o << "  pushq %rbx\n"; // save rbx
+void new_generate(cool::CodeGenerator *cg, x86::Emitter &o, Class *cls) {
+  o.ins("pushq", x86::RBX); // save rbx
 
   // invoke `copy` method of the prototype object
-  o << "  movq $" + cls->name + "_prototype, %rbx\n"; // this
-  o << "  movq $" + cls->name + "_method_table, %rax\n";
-  o << "  call *" + std::to_string(cls->methods_numbered["copy"] * 8) +
-           "(%rax)\n";
+  o.ins("movq", x86::imm(cls->name + "_prototype"), x86::RBX); // this
+  o.ins("movq", x86::imm(cls->name + "_method_table"), x86::RAX);
+  o.ins("call",
+        x86::indirect(x86::mem(cls->methods_numbered["copy"] * 8, x86::RAX)));
 
   // invoke `__init__` method of the new object
-  o << "  movq %rax, %rbx\n";
-  o << "  movq $" + cls->name + "_method_table, %rax\n";
-  o << "  call *" +
-           std::to_string(cls->methods_numbered[cool::init_method_name] * 8) +
-           "(%rax)\n";
+  o.ins("movq", x86::RAX, x86::RBX);
+  o.ins("movq", x86::imm(cls->name + "_method_table"), x86::RAX);
+  o.ins("call", x86::indirect(x86::mem(
+                    cls->methods_numbered[cool::init_method_name] * 8, x86::RAX)));
 
-  o << "  popq %rbx\n"; // restore rbx
+  o.ins("popq", x86::RBX); // restore rbx
 }
 
-void New::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # NEW " + type_name + "\n";
+void New::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   new_generate(cg, o, type_sa);
 }
 
@@ -486,17 +602,17 @@ Class *IsVoid::type(cool::SemanticAnalyser *sa) {
   return sa->boolClass.get();
 }
 
-void IsVoid::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # ISVOID\n";
+void IsVoid::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   expr->generate(cg, o);
 
-  o << "  cmpq $0, %rax\n";
-  o << "  je 1f\n";
-  o << "  movq $bool_constant_false, %rax\n";
-  o << "  jmp 2f\n";
-  o << "1:\n";
-  o << "  movq $bool_constant_true, %rax\n";
-  o << "2:\n";
+  o.ins("cmpq", x86::imm(0), x86::RAX);
+  o.ins("je", x86::sym("1f"));
+  o.ins("movq", x86::imm("bool_constant_false"), x86::RAX);
+  o.ins("jmp", x86::sym("2f"));
+  o.label("1");
+  o.ins("movq", x86::imm("bool_constant_true"), x86::RAX);
+  o.label("2");
 }
 
 void Add::print(std::ostream &o, int indent) {
@@ -536,50 +652,121 @@ Class *Add::type(cool::SemanticAnalyser *sa) {
   return int_op_type(sa, std::list<std::shared_ptr<Expression>>{a, b});
 }
 
-void int_op_generate(cool::CodeGenerator *cg, std::ostream &o, Expression *a,
-                     Expression *b, char op) {
-  b->generate(cg, o);
-  o << "  movq 40(%rax), %rax\n"; // 2nd operand
+// 1st operand op a constant 2nd operand
+void int_op_constant_generate(cool::CodeGenerator *cg, x86::Emitter &o,
+                              Expression *a, int64_t k, char op) {
+  int_value_generate(cg, o, a); // 1st operand
 
-  o << "  pushq %rax\n";
+  switch (op) {
+  case '+':
+    o.ins("addq", x86::imm(k), x86::RAX);
+    break;
+  case '-':
+    o.ins("subq", x86::imm(k), x86::RAX);
+    break;
+  case '*':
+    cg->mul_constant_generate(o, k);
+    break;
+  case '/':
+    cg->div_constant_generate(o, k);
+    break;
+  }
+}
+
+// %rax <- the value of a op b
+void int_op_value_generate(cool::CodeGenerator *cg, x86::Emitter &o,
+                           Expression *a, Expression *b, char op) {
+  auto ka = dynamic_cast<IntConst *>(a);
+  auto kb = dynamic_cast<IntConst *>(b);
+  if (kb && (op == '*' || op == '/' || util::fits_int32(kb->value))) {
+    int_op_constant_generate(cg, o, a, kb->value, op);
+    return;
+  }
+  if (ka && op == '*') {
+    // constants have no side effects, so the order does not matter
+    int_op_constant_generate(cg, o, b, ka->value, op);
+    return;
+  }
+
+  int_value_generate(cg, o, b); // 2nd operand
+
+  o.ins("pushq", x86::RAX);
   cg->offset_rbp++;
 
-  a->generate(cg, o);
-  o << "  movq 40(%rax), %rax\n"; // 1st operand
+  int_value_generate(cg, o, a); // 1st operand
 
-  o << "  popq %rcx\n"; // 2nd operand
+  o.ins("popq", x86::RCX); // 2nd operand
   cg->offset_rbp--;
 
   switch (op) {
   case '+':
-    o << "  addq %rcx, %rax\n";
+    o.ins("addq", x86::RCX, x86::RAX);
     break;
   case '-':
-    o << "  subq %rcx, %rax\n";
+    o.ins("subq", x86::RCX, x86::RAX);
     break;
   case '*':
-    o << "  imulq %rcx\n";
+    o.ins("imulq", x86::RCX);
     break;
   case '/':
-    o << "  cqto\n"; // Convert quadword in %rax to octoword in %rdx:%rax
-    o << "  idivq %rcx\n";
+    o.ins("cqto"); // Convert quadword in %rax to octoword in %rdx:%rax
+    o.ins("idivq", x86::RCX);
     break;
   }
+}
+
+bool is_int_op(Expression *e) {
+  return dynamic_cast<Add *>(e) || dynamic_cast<Sub *>(e) ||
+         dynamic_cast<Mul *>(e) || dynamic_cast<Div *>(e) ||
+         dynamic_cast<Neg *>(e);
+}
+
+// %rax <- the value of the Int expression `e`. The results of arithmetic
+// only escape once boxed, so operands of arithmetic are never boxed.
+void int_value_generate(cool::CodeGenerator *cg, x86::Emitter &o,
+                        Expression *e) {
+  auto k = dynamic_cast<IntConst *>(e);
+  auto add = dynamic_cast<Add *>(e);
+  auto sub = dynamic_cast<Sub *>(e);
+  auto mul = dynamic_cast<Mul *>(e);
+  auto div = dynamic_cast<Div *>(e);
+  auto neg = dynamic_cast<Neg *>(e);
+  if (k) {
+    cg->load_constant(o, k->value, x86::RAX);
+  } else if (add) {
+    int_op_value_generate(cg, o, add->a.get(), add->b.get(), '+');
+  } else if (sub) {
+    int_op_value_generate(cg, o, sub->a.get(), sub->b.get(), '-');
+  } else if (mul) {
+    int_op_value_generate(cg, o, mul->a.get(), mul->b.get(), '*');
+  } else if (div) {
+    int_op_value_generate(cg, o, div->a.get(), div->b.get(), '/');
+  } else if (neg) {
+    int_value_generate(cg, o, neg->expr.get());
+    o.ins("negq", x86::RAX);
+  } else {
+    e->generate(cg, o);
+    o.ins("movq", x86::mem(40, x86::RAX), x86::RAX);
+  }
+}
 
-  o << "  pushq %rax\n";
+// %rax <- a new Int with the value in %rax
+void int_box_generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  o.ins("pushq", x86::RAX);
   cg->offset_rbp++;
 
   new_generate(cg, o, cg->sa->intClass.get());
 
-  o << "  popq %rcx\n";
+  o.ins("popq", x86::RCX);
   cg->offset_rbp--;
 
-  o << "  movq %rcx, 40(%rax)\n";
+  o.ins("movq", x86::RCX, x86::mem(40, x86::RAX));
 }
 
-void Add::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # ADD\n";
-  int_op_generate(cg, o, a.get(), b.get(), '+');
+void Add::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  int_value_generate(cg, o, this);
+  int_box_generate(cg, o);
 }
 
 void Sub::print(std::ostream &o, int indent) {
@@ -593,9 +780,10 @@ Class *Sub::type(cool::SemanticAnalyser *sa) {
   return int_op_type(sa, std::list<std::shared_ptr<Expression>>{a, b});
 }
 
-void Sub::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # SUB\n";
-  int_op_generate(cg, o, a.get(), b.get(), '-');
+void Sub::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  int_value_generate(cg, o, this);
+  int_box_generate(cg, o);
 }
 
 void Mul::print(std::ostream &o, int indent) {
@@ -609,9 +797,10 @@ Class *Mul::type(cool::SemanticAnalyser *sa) {
   return int_op_type(sa, std::list<std::shared_ptr<Expression>>{a, b});
 }
 
-void Mul::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # MUL\n";
-  int_op_generate(cg, o, a.get(), b.get(), '*');
+void Mul::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  int_value_generate(cg, o, this);
+  int_box_generate(cg, o);
 }
 
 void Div::print(std::ostream &o, int indent) {
@@ -625,9 +814,10 @@ Class *Div::type(cool::SemanticAnalyser *sa) {
   return int_op_type(sa, std::list<std::shared_ptr<Expression>>{a, b});
 }
 
-void Div::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # DIV\n";
-  int_op_generate(cg, o, a.get(), b.get(), '/');
+void Div::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  int_value_generate(cg, o, this);
+  int_box_generate(cg, o);
 }
 
 void Neg::print(std::ostream &o, int indent) {
@@ -640,55 +830,42 @@ Class *Neg::type(cool::SemanticAnalyser *sa) {
   return int_op_type(sa, std::list<std::shared_ptr<Expression>>{expr});
 }
 
-void Neg::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # NEG\n";
-  expr->generate(cg, o);
-
-  o << "  xorq %rcx, %rcx\n";
-  o << "  subq 40(%rax), %rcx\n";
-  o << "  pushq %rcx\n";
-  cg->offset_rbp++;
-
-  new_generate(cg, o, cg->sa->intClass.get());
-
-  o << "  popq %rcx\n";
-  cg->offset_rbp--;
-
-  o << "  movq %rcx, 40(%rax)\n";
+void Neg::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  int_value_generate(cg, o, this);
+  int_box_generate(cg, o);
 }
 
-void int_rel_op_generate(cool::CodeGenerator *cg, std::ostream &o,
+void int_rel_op_generate(cool::CodeGenerator *cg, x86::Emitter &o,
                          Expression *a, Expression *b, char op) {
-  a->generate(cg, o);
-  o << "  movq 40(%rax), %rax\n"; // 1st operand
+  int_value_generate(cg, o, a); // 1st operand
 
-  o << "  pushq %rax\n";
+  o.ins("pushq", x86::RAX);
   cg->offset_rbp++;
 
-  b->generate(cg, o);
-  o << "  movq 40(%rax), %rax\n"; // 2nd operand
+  int_value_generate(cg, o, b); // 2nd operand
 
-  o << "  popq %rcx\n"; // 1st operand
+  o.ins("popq", x86::RCX); // 1st operand
   cg->offset_rbp--;
 
-  o << "  cmpq %rax, %rcx\n";
+  o.ins("cmpq", x86::RAX, x86::RCX);
 
   switch (op) {
   case '<':
-    o << "  jl 1f\n";
+    o.ins("jl", x86::sym("1f"));
     break;
   case '=':
-    o << "  je 1f\n";
+    o.ins("je", x86::sym("1f"));
     break;
   case '[':
-    o << "  jle 1f\n";
+    o.ins("jle", x86::sym("1f"));
     break;
   }
-  o << "  movq $bool_constant_false, %rax\n";
-  o << "  jmp 2f\n";
-  o << "1:\n";
-  o << "  movq $bool_constant_true, %rax\n";
-  o << "2:\n";
+  o.ins("movq", x86::imm("bool_constant_false"), x86::RAX);
+  o.ins("jmp", x86::sym("2f"));
+  o.label("1");
+  o.ins("movq", x86::imm("bool_constant_true"), x86::RAX);
+  o.label("2");
 }
 
 void LessThan::print(std::ostream &o, int indent) {
@@ -703,8 +880,8 @@ Class *LessThan::type(cool::SemanticAnalyser *sa) {
                      sa->boolClass.get());
 }
 
-void LessThan::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # LESSTHAN\n";
+void LessThan::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   int_rel_op_generate(cg, o, a.get(), b.get(), '<');
 }
 
@@ -720,8 +897,8 @@ Class *Equal::type(cool::SemanticAnalyser *sa) {
                      sa->boolClass.get());
 }
 
-void Equal::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # EQUAL\n";
+void Equal::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   int_rel_op_generate(cg, o, a.get(), b.get(), '=');
 }
 
@@ -737,8 +914,8 @@ Class *LessOrEqual::type(cool::SemanticAnalyser *sa) {
                      sa->boolClass.get());
 }
 
-void LessOrEqual::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # LESSOREQUAL\n";
+void LessOrEqual::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   int_rel_op_generate(cg, o, a.get(), b.get(), '[');
 }
 
@@ -760,16 +937,16 @@ Class *Not::type(cool::SemanticAnalyser *sa) {
   return sa->boolClass.get();
 }
 
-void Not::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # NOT\n";
+void Not::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   expr->generate(cg, o);
-  o << "  cmpq $0, 40(%rax)\n";
-  o << "  je 1f\n";
-  o << "  movq $bool_constant_false, %rax\n";
-  o << "  jmp 2f\n";
-  o << "1:\n";
-  o << "  movq $bool_constant_true, %rax\n";
-  o << "2:\n";
+  o.ins("cmpq", x86::imm(0), x86::mem(40, x86::RAX));
+  o.ins("je", x86::sym("1f"));
+  o.ins("movq", x86::imm("bool_constant_false"), x86::RAX);
+  o.ins("jmp", x86::sym("2f"));
+  o.label("1");
+  o.ins("movq", x86::imm("bool_constant_true"), x86::RAX);
+  o.label("2");
 }
 
 void Var::print(std::ostream &o, int indent) {
@@ -788,12 +965,12 @@ Class *Var::type(cool::SemanticAnalyser *sa) {
   return res;
 }
 
-void Var::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  # VAR " + name + "\n";
+void Var::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   if (name == "self") {
-    o << "  movq %rbx, %rax\n";
+    o.ins("movq", x86::RBX, x86::RAX);
   } else {
-    o << "  movq " + cg->scope.find(name) + ", %rax\n";
+    o.ins("movq", cg->scope.find(name), x86::RAX);
   }
 }
 
@@ -803,9 +980,12 @@ void IntConst::print(std::ostream &o, int indent) {
 
 Class *IntConst::type(cool::SemanticAnalyser *sa) { return sa->intClass.get(); }
 
-void IntConst::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  movq $int_constant_" +
-           std::to_string(cg->get_int_constant_no(value)) + ", %rax\n";
+void IntConst::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  o.ins("movq",
+        x86::imm("int_constant_" +
+                 std::to_string(cg->get_int_constant_no(value))),
+        x86::RAX);
 }
 
 void StrConst::print(std::ostream &o, int indent) {
@@ -819,9 +999,9 @@ Class *StrConst::type(cool::SemanticAnalyser *sa) {
 
 std::string StrConst::escaped() { return util::escape_string(value); }
 
-void StrConst::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  movq $string_constant_" +
-           std::to_string(cg->get_string_constant_no(value)) + ", %rax\n";
+void StrConst::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  o.ins("movq", cg->string_constant(value), x86::RAX);
 }
 
 void BoolConst::print(std::ostream &o, int indent) {
@@ -832,11 +1012,12 @@ Class *BoolConst::type(cool::SemanticAnalyser *sa) {
   return sa->boolClass.get();
 }
 
-void BoolConst::generate(cool::CodeGenerator *cg, std::ostream &o) {
+void BoolConst::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
   if (value) {
-    o << "  movq $bool_constant_true, %rax\n";
+    o.ins("movq", x86::imm("bool_constant_true"), x86::RAX);
   } else {
-    o << "  movq $bool_constant_false, %rax\n";
+    o.ins("movq", x86::imm("bool_constant_false"), x86::RAX);
   }
 }
 
@@ -916,25 +1097,63 @@ bool Method::check_type(cool::SemanticAnalyser *sa) {
   return true;
 }
 
-void Method::generate(cool::CodeGenerator *cg, std::ostream &o) {
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
+namespace {
+
+// mark the dispatches whose value is that of `expr`
+void mark_tail_calls(std::shared_ptr<Expression> expr) {
+  auto invoke = std::dynamic_pointer_cast<Invoke>(expr);
+  if (invoke) {
+    invoke->tail = true;
+  }
+  auto if_ = std::dynamic_pointer_cast<If>(expr);
+  if (if_) {
+    mark_tail_calls(if_->b);
+    mark_tail_calls(if_->c);
+  }
+  auto block = std::dynamic_pointer_cast<Block>(expr);
+  if (block) {
+    mark_tail_calls(block->expressions.back());
+  }
+  auto let = std::dynamic_pointer_cast<Let>(expr);
+  if (let) {
+    mark_tail_calls(let->body);
+  }
+  auto case_ = std::dynamic_pointer_cast<Case>(expr);
+  if (case_) {
+    for (auto &branch : case_->branches) {
+      mark_tail_calls(branch->expr);
+    }
+  }
+}
+
+} // namespace
+
+void Method::generate(cool::CodeGenerator *cg, x86::Emitter &o) {
+  cool::LocationScope location(cg, o, this);
+  cg->prologue_generate(o);
+  cg->entry_probe_generate(o, cg->selfClass->name + "." + name);
+
+  cg->selfMethod = this;
+  cg->selfMethodEntry = cg->next_label();
+  o.label(cg->selfMethodEntry);
+  cg->count_generate(o, "method " + cg->selfClass->name + "." + name);
+  cg->call_enter_generate(o);
 
   cg->offset_rbp = 0;
 
   cg->scope.enter();
   int i = 0;
   for (auto &formal : formals) {
-    auto formal_ref = std::to_string((2 + i++) * 8) + "(%rbp)";
-    cg->scope.add(formal->name, formal_ref);
+    cg->scope.add(formal->name, x86::mem((2 + i++) * 8, x86::RBP));
   }
 
+  mark_tail_calls(expr);
   expr->generate(cg, o);
 
   cg->scope.exit();
 
-  o << "  popq %rbp\n";
-  o << "  ret\n";
+  cg->call_exit_generate(o);
+  cg->epilogue_generate(o);
 }
 
 void Class::print(std::ostream &o, int indent) {
@@ -979,6 +1198,15 @@ Method *Class::get_method(std::string name) {
   return cls->name2Method[name];
 }
 
+bool Class::is_overridden(const std::string &name) {
+  for (auto child : children) {
+    if (child->name2Method.count(name) || child->is_overridden(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Field *Class::get_field(std::string name) {
   if (name2Field.find(name) != name2Field.end()) {
     return name2Field[name];
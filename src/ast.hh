@@ -1,6 +1,7 @@
 #ifndef _AST_HH
 #define _AST_HH
 
+#include <cstdint>
 #include <list>
 #include <map>
 #include <memory>
@@ -11,8 +12,26 @@
 namespace cool {
 class SemanticAnalyser;
 class CodeGenerator;
+class NonVoidAnalyser;
+class ReachabilityAnalyser;
 } // namespace cool
 
+namespace vm {
+class Compiler;
+} // namespace vm
+
+namespace csrc {
+class Translator;
+} // namespace csrc
+
+namespace ir {
+class Builder;
+} // namespace ir
+
+namespace x86 {
+class Emitter;
+} // namespace x86
+
 namespace ast {
 
 class Class;
@@ -23,6 +42,8 @@ public:
   void set_loc(const yy::location &l) { loc = l; }
 
   const yy::location &get_loc() { return loc; }
+  // where it is in the source, which names it in profiles
+  std::string site();
 
   virtual void print(std::ostream &o, int indent) {}
 
@@ -33,7 +54,19 @@ protected:
 class Expression : public Node {
 public:
   virtual Class *type(cool::SemanticAnalyser *sa) { return nullptr; }
-  virtual void generate(cool::CodeGenerator *cg, std::ostream &o) {}
+  virtual void generate(cool::CodeGenerator *cg, x86::Emitter &o) {}
+  virtual void compile(vm::Compiler *c) {}
+  virtual std::string translate(csrc::Translator *t, std::ostream &o) {
+    return "NULL";
+  }
+  virtual int lower(ir::Builder *bld) { return -1; }
+  // fold the subexpressions; returns the constant this one evaluates to, if
+  // known at compile time
+  virtual std::shared_ptr<Expression> fold() { return nullptr; }
+  // whether it never evaluates to void
+  virtual bool non_void(cool::NonVoidAnalyser *nva) { return false; }
+  // report the classes it creates and the methods it calls
+  virtual void reach(cool::ReachabilityAnalyser *ra) {}
 };
 
 class Void : public Expression {};
@@ -54,14 +87,39 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Invoke : public Expression {
 public:
   Invoke(std::shared_ptr<Expression> expr, std::string type_name,
          std::string name, std::list<std::shared_ptr<Expression>> arguments)
-      : expr(expr), type_name(type_name), name(name), arguments(arguments) {}
+      : expr(expr), type_name(type_name), name(name), arguments(arguments),
+        tail(false), receiver_non_void(false) {}
 
   void print(std::ostream &o, int indent) override;
 
@@ -77,10 +135,42 @@ public:
   Class *type_sa;
 
   Class *type(cool::SemanticAnalyser *sa) override;
+  // the class of the method called, if known at compile time
+  Class *target_class();
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+  // jump to the method called instead of calling it
+  void tail_generate(cool::CodeGenerator *cg, x86::Emitter &o, Class *cls);
+
+  bool tail; // the value of the method being generated
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool receiver_non_void;
+
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class If : public Expression {
@@ -99,7 +189,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class While : public Expression {
@@ -117,7 +231,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Block : public Expression {
@@ -135,14 +273,39 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Let : public Expression {
 public:
   Let(std::string name, std::string type_name, std::shared_ptr<Expression> expr,
       std::shared_ptr<Expression> body)
-      : name(name), type_name(type_name), expr(expr), body(body) {}
+      : name(name), type_name(type_name), expr(expr), body(body),
+        var_non_void(true) {}
 
   void print(std::ostream &o, int indent) override;
 
@@ -157,15 +320,41 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
   std::shared_ptr<Expression> expr_cg;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool var_non_void;
+
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class CaseBranch : public Node {
 public:
   CaseBranch(std::string name, std::string type_name,
              std::shared_ptr<Expression> expr)
-      : name(name), type_name(type_name), expr(expr) {}
+      : name(name), type_name(type_name), expr(expr), var_non_void(true) {}
 
   void print(std::ostream &o, int indent) override;
 
@@ -177,13 +366,17 @@ public:
 public:
   Class *type;
   Class *expr_type;
+
+  // --- nonvoid ---
+public:
+  bool var_non_void;
 };
 
 class Case : public Expression {
 public:
   Case(std::shared_ptr<Expression> expr,
        std::list<std::shared_ptr<CaseBranch>> branches)
-      : expr(expr), branches(branches) {}
+      : expr(expr), branches(branches), expr_non_void(false) {}
 
   void print(std::ostream &o, int indent) override;
 
@@ -196,7 +389,33 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool expr_non_void;
+
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class New : public Expression {
@@ -214,7 +433,27 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class IsVoid : public Expression {
@@ -231,7 +470,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Add : public Expression {
@@ -249,7 +512,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Sub : public Expression {
@@ -267,7 +554,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Mul : public Expression {
@@ -285,7 +596,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Div : public Expression {
@@ -303,7 +638,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Neg : public Expression {
@@ -320,7 +679,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class LessThan : public Expression {
@@ -338,7 +721,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Equal : public Expression {
@@ -356,7 +763,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class LessOrEqual : public Expression {
@@ -374,7 +805,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Not : public Expression {
@@ -391,7 +846,31 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- fold ---
+public:
+  std::shared_ptr<Expression> fold() override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
+
+  // --- reach ---
+public:
+  void reach(cool::ReachabilityAnalyser *ra) override;
 };
 
 class Var : public Expression {
@@ -408,16 +887,32 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
 };
 
 class IntConst : public Expression {
 public:
-  IntConst(int value) : value(value) {}
+  IntConst(int64_t value) : value(value) {}
 
   void print(std::ostream &o, int indent) override;
 
-  int value;
+  int64_t value;
 
   // --- sa ---
 public:
@@ -425,7 +920,23 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
 };
 
 class StrConst : public Expression {
@@ -444,7 +955,23 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
 };
 
 class BoolConst : public Expression {
@@ -461,7 +988,23 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o) override;
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o) override;
+
+  // --- vm ---
+public:
+  void compile(vm::Compiler *c) override;
+
+  // --- csrc ---
+public:
+  std::string translate(csrc::Translator *t, std::ostream &o) override;
+
+  // --- ir ---
+public:
+  int lower(ir::Builder *bld) override;
+
+  // --- nonvoid ---
+public:
+  bool non_void(cool::NonVoidAnalyser *nva) override;
 };
 
 class Feature : public Node {};
@@ -517,7 +1060,7 @@ public:
 
   // --- cg ---
 public:
-  void generate(cool::CodeGenerator *cg, std::ostream &o);
+  void generate(cool::CodeGenerator *cg, x86::Emitter &o);
 };
 
 class Class : public Node {
@@ -542,6 +1085,8 @@ public:
 
   Class *get_method_class(std::string name);
   Method *get_method(std::string name);
+  // whether a class inheriting from this one defines method `name` again
+  bool is_overridden(const std::string &name);
 
   void check_type(cool::SemanticAnalyser *sa);
 
@@ -576,10 +1121,20 @@ public:
   void print(std::ostream &o);
 
   std::list<std::shared_ptr<Class>> classes;
+
+  // --- fold ---
+public:
+  // evaluate constant subexpressions of the analysed program
+  void fold();
 };
 
 // --- cg ---
-void new_generate(cool::CodeGenerator *cg, std::ostream &o, Class *cls);
+void new_generate(cool::CodeGenerator *cg, x86::Emitter &o, Class *cls);
+// whether `e` is Int arithmetic, whose result is a new Int
+bool is_int_op(Expression *e);
+// %rax <- the value of the Int expression `e`, not boxed
+void int_value_generate(cool::CodeGenerator *cg, x86::Emitter &o,
+                        Expression *e);
 
 } /* namespace ast */
 
@@ -1,5 +1,11 @@
 #include "cg.hh"
 
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+#include "ir.hh"
+#include "timer.hh"
 #include "util.hh"
 
 /*
@@ -42,7 +48,16 @@ int CodeGenerator::get_string_constant_no(std::string s) {
   return string_constants_numbered[s];
 }
 
-int CodeGenerator::get_int_constant_no(int i) {
+x86::Operand CodeGenerator::string_constant(const std::string &s) {
+  return x86::imm("string_constant_" +
+                  std::to_string(get_string_constant_no(s)));
+}
+
+x86::Operand CodeGenerator::string_data(const std::string &s) {
+  return x86::imm("string_data_" + std::to_string(get_string_constant_no(s)));
+}
+
+int CodeGenerator::get_int_constant_no(int64_t i) {
   if (int_constants_numbered.find(i) == int_constants_numbered.end()) {
     int_constants_numbered[i] = int_constants.size();
     int_constants.push_back(i);
@@ -50,527 +65,1893 @@ int CodeGenerator::get_int_constant_no(int i) {
   return int_constants_numbered[i];
 }
 
+namespace {
+
+// classes a dispatch tests the receiver for at most
+const int type_test_limit = 4;
+
+// --instrument-calls: the sizes of frames and nodes of the calling context
+// tree, and how many there can be
+const int call_frame_size = 32;
+const int call_node_size = 40;
+const int call_stack_frames = 1 << 20;
+const int call_nodes_max = 1 << 18;
+
+// n if `k` is 2^n, else -1
+int log2_exact(uint64_t k) {
+  if (k == 0 || (k & (k - 1))) {
+    return -1;
+  }
+  int n = 0;
+  while (k >>= 1) {
+    n++;
+  }
+  return n;
+}
+
+// the magic number and shift dividing by `d` (|d| >= 2), Hacker's Delight 10-1
+void magic(int64_t d, int64_t &m, int &s) {
+  const uint64_t two63 = 1ull << 63;
+  uint64_t ad = d < 0 ? -(uint64_t)d : d;
+  uint64_t t = two63 + ((uint64_t)d >> 63);
+  uint64_t anc = t - 1 - t % ad;
+  int p = 63;
+  uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+  uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+  uint64_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  m = q2 + 1;
+  if (d < 0) {
+    m = -(uint64_t)m;
+  }
+  s = p - 64;
+}
+
+} // namespace
+
+void CodeGenerator::load_constant(x86::Emitter &o, int64_t k,
+                                  x86::Register reg) {
+  if (util::fits_int32(k)) {
+    o.ins("movq", x86::imm(k), reg);
+  } else {
+    o.ins("movabsq", x86::imm(k), reg);
+  }
+}
+
+void CodeGenerator::stack_int_generate(x86::Emitter &o, int offset) {
+  o.ins("movq", x86::RAX, x86::mem(offset + 40, x86::RBP));
+  o.ins("movq", x86::imm("Int_prototype"), x86::RCX);
+  for (int i = 0; i < 40; i += 8) {
+    o.ins("movq", x86::mem(i, x86::RCX), x86::RAX);
+    o.ins("movq", x86::RAX, x86::mem(offset + i, x86::RBP));
+  }
+  o.ins("leaq", x86::mem(offset, x86::RBP), x86::RAX);
+}
+
+bool CodeGenerator::keeps_no_reference(ast::Class *cls,
+                                       const std::string &name) {
+  // the others return self, and Array.set keeps x
+  if (name == init_method_name ||
+      (cls == sa->ioClass.get() && name == "out_string") ||
+      (cls == sa->arrayClass.get() && name == "set")) {
+    return false;
+  }
+  for (auto &builtin : sa->builtin) {
+    if (builtin.get() == cls) {
+      return true;
+    }
+  }
+  return false;
+}
+
+x86::Operand CodeGenerator::new_counter(const std::string &key) {
+  if (!key.empty()) {
+    profile_keys.emplace_back(counters, key);
+  }
+  return x86::sym("counters", counters++ * 8);
+}
+
+x86::Operand CodeGenerator::new_stats_counter(const std::string &key) {
+  stats_keys.emplace_back(counters, key);
+  return x86::sym("counters", counters++ * 8);
+}
+
+bool CodeGenerator::counting() const {
+  return !options.profile_generate.empty() || options.type_test_stats ||
+         options.alloc_stats || options.instrument_calls;
+}
+
+void CodeGenerator::string_data_count_generate(x86::Emitter &o,
+                                               x86::Register bytes) {
+  o.ins("addq", bytes, x86::sym("stats_string_bytes"));
+  if (options.alloc_stats) {
+    o.ins("addq", bytes, x86::sym("alloc_bytes", sa->stringClass->id * 8));
+  }
+}
+
+void CodeGenerator::count_generate(x86::Emitter &o, const std::string &key) {
+  if (!options.profile_generate.empty()) {
+    o.ins("incq", new_counter(key));
+  }
+}
+
+void CodeGenerator::call_enter_generate(x86::Emitter &o) {
+  if (options.instrument_calls) {
+    o.ins("movq", x86::imm(instrumented.size() - 1), x86::RDI);
+    o.ins("call", x86::sym("_call_enter"));
+  }
+}
+
+void CodeGenerator::call_exit_generate(x86::Emitter &o) {
+  if (options.instrument_calls) {
+    o.ins("call", x86::sym("_call_exit"));
+  }
+}
+
+void CodeGenerator::probe_generate(x86::Emitter &o,
+                                    const std::string &provider,
+                                    const std::string &name,
+                                    const std::string &args) {
+  if (options.usdt) {
+    auto label = next_label();
+    probes.push_back({label, provider, name, args});
+    o.label(label);
+    o.ins("nop");
+  }
+}
+
+void CodeGenerator::entry_probe_generate(x86::Emitter &o,
+                                         const std::string &method) {
+  if (options.usdt_methods) {
+    auto name = method;
+    name.replace(name.find('.'), 1, "__");
+    probe_generate(o, "cool_method", name, "8@%rbx");
+  }
+}
+
+int64_t CodeGenerator::profile_count(const std::string &key) {
+  return options.profile ? options.profile->count(key) : 0;
+}
+
+void CodeGenerator::prologue_generate(x86::Emitter &o) {
+  o.ins("pushq", x86::RBP);
+  if (options.debug_info) {
+    o.directive(".cfi_def_cfa_offset", "16");
+    o.directive(".cfi_offset", "%rbp, -16");
+  }
+  o.ins("movq", x86::RSP, x86::RBP);
+  if (options.debug_info) {
+    o.directive(".cfi_def_cfa_register", "%rbp");
+  }
+}
+
+void CodeGenerator::epilogue_generate(x86::Emitter &o,
+                                      const std::string &target) {
+  o.ins("popq", x86::RBP);
+  if (options.debug_info) {
+    o.directive(".cfi_remember_state");
+    o.directive(".cfi_def_cfa", "%rsp, 8");
+  }
+  if (target.empty()) {
+    o.ins("ret");
+  } else {
+    o.ins("jmp", x86::sym(target));
+  }
+  if (options.debug_info) {
+    o.directive(".cfi_restore_state");
+  }
+}
+
+void CodeGenerator::loc_generate(x86::Emitter &o, const yy::location &loc) {
+  // built-in classes are in no file
+  if (options.debug_info && loc.begin.filename &&
+      file_numbers.count(*loc.begin.filename)) {
+    o.loc = x86::Loc(file_numbers[*loc.begin.filename], loc.begin.line,
+                     loc.begin.column);
+  }
+}
+
+LocationScope::LocationScope(CodeGenerator *cg, x86::Emitter &o,
+                             ast::Node *node)
+    : cg(cg), o(o), saved(cg->loc) {
+  cg->loc = &node->get_loc();
+  cg->loc_generate(o, *cg->loc);
+}
+
+LocationScope::~LocationScope() {
+  cg->loc = saved;
+  if (saved) {
+    cg->loc_generate(o, *saved);
+  }
+}
+
+void CodeGenerator::array_access_generate(x86::Emitter &o, ast::Class *cls,
+                                          const std::string &name, int args) {
+  bool ints = cls == sa->intArrayClass.get();
+  if (name == "length") {
+    o.ins("movq", x86::mem(40, x86::RBX), x86::RDI);
+    o.ins("call", x86::sym("Int.__new__"));
+    return;
+  }
+
+  o.ins("movq", x86::mem(args, x86::RSP), x86::RAX);
+  o.ins("movq", x86::mem(40, x86::RAX), x86::RAX); // i
+  o.ins("cmpq", x86::mem(40, x86::RBX), x86::RAX);
+  o.ins("jae", x86::sym("_array_bounds")); // i < 0 too
+  if (name == "get") {
+    if (ints) {
+      o.ins("movq", x86::mem(48, x86::RBX, x86::RAX, 8), x86::RDI);
+      o.ins("call", x86::sym("Int.__new__"));
+    } else {
+      o.ins("movq", x86::mem(48, x86::RBX, x86::RAX, 8), x86::RAX);
+    }
+    return;
+  }
+  o.ins("movq", x86::mem(args + 8, x86::RSP), x86::RCX); // x
+  if (ints) {
+    o.ins("movq", x86::mem(40, x86::RCX), x86::RCX);
+  }
+  o.ins("movq", x86::RCX, x86::mem(48, x86::RBX, x86::RAX, 8));
+  o.ins("movq", x86::RBX, x86::RAX);
+}
+
+void CodeGenerator::call_generate(x86::Emitter &o, ast::Class *cls,
+                                  const std::string &name) {
+  auto def = cls->get_method_class(name);
+  auto method = def->name2Method[name];
+  if ((def == sa->arrayClass.get() || def == sa->intArrayClass.get()) &&
+      (name == "get" || name == "set" || name == "length")) {
+    array_access_generate(o, def, name, 0);
+    return;
+  }
+  auto key = "method " + def->name + "." + name;
+  // getters and constants, which need no frame
+  auto var = std::dynamic_pointer_cast<ast::Var>(method->expr);
+  bool trivial =
+      method->formals.empty() &&
+      (var || std::dynamic_pointer_cast<ast::IntConst>(method->expr) ||
+       std::dynamic_pointer_cast<ast::StrConst>(method->expr) ||
+       std::dynamic_pointer_cast<ast::BoolConst>(method->expr));
+  // instrumented methods are never inlined, so that their calls count
+  if (!trivial || profile_count(key) == 0 || options.instrument_calls) {
+    o.ins("call", x86::sym(def->name + "." + name));
+    return;
+  }
+
+  count_generate(o, key);
+  if (var && var->name == "self") {
+    o.ins("movq", x86::RBX, x86::RAX);
+  } else if (var) {
+    o.ins("movq", x86::mem((5 + def->fields_numbered[var->name]) * 8, x86::RBX),
+          x86::RAX);
+  } else {
+    method->expr->generate(this, o);
+  }
+}
+
+std::vector<ast::Class *> CodeGenerator::type_tests(ast::Class *type,
+                                                    const std::string &name,
+                                                    const std::string &site) {
+  std::vector<ast::Class *> res;
+  for (auto &cls : sa->classes) {
+    if (sa->assignable(type, cls.get()) && reach.is_live(cls.get()) &&
+        reach.is_live(cls->get_method_class(name), name)) {
+      res.push_back(cls.get());
+    }
+  }
+
+  if (options.profile) {
+    // the receivers seen most
+    auto count = [&](ast::Class *cls) {
+      return profile_count("call " + site + " " + cls->name);
+    };
+    res.erase(std::remove_if(res.begin(), res.end(),
+                             [&](ast::Class *cls) { return count(cls) == 0; }),
+              res.end());
+    std::stable_sort(res.begin(), res.end(), [&](ast::Class *a, ast::Class *b) {
+      return count(a) > count(b);
+    });
+    if (res.size() > type_test_limit) {
+      res.resize(type_test_limit);
+    }
+  } else if (res.size() > type_test_limit) {
+    res.clear(); // only the method table
+  }
+  return res;
+}
+
+void CodeGenerator::dispatch_generate(x86::Emitter &o, ast::Class *type,
+                                      const std::string &name,
+                                      const std::string &site) {
+  if (!options.profile_generate.empty()) {
+    // receivers by class id
+    x86::Operand base;
+    for (int id = 0; id <= sa->classes.size(); ++id) {
+      std::string key;
+      if (id > 0 && sa->assignable(type, sa->classes[id - 1].get())) {
+        key = "call " + site + " " + sa->classes[id - 1]->name;
+      }
+      auto counter = new_counter(key);
+      if (id == 0) {
+        base = counter;
+      }
+    }
+    o.ins("movq", x86::mem(16, x86::RBX), x86::RCX);
+    base.index = x86::RCX;
+    base.scale = 8;
+    o.ins("incq", base);
+  }
+
+  auto tests = type_tests(type, name, site);
+  x86::Operand hits, misses;
+  if (options.type_test_stats) {
+    hits = new_stats_counter("type tests " + site + " " + name + " hits");
+    misses = new_stats_counter("type tests " + site + " " + name + " misses");
+  }
+
+  // a compare and a direct call per class, calls of a method shared
+  std::vector<ast::Class *> targets;
+  std::vector<std::string> labels;
+  auto label_done = next_label();
+  if (!tests.empty()) {
+    o.ins("movq", x86::mem(16, x86::RBX), x86::RAX); // class id
+  }
+  for (auto cls : tests) {
+    auto def = cls->get_method_class(name);
+    auto it = std::find(targets.begin(), targets.end(), def);
+    if (it == targets.end()) {
+      targets.push_back(def);
+      labels.push_back(next_label());
+      it = targets.end() - 1;
+    }
+    o.ins("cmpq", x86::imm(cls->id), x86::RAX);
+    o.ins("je", x86::sym(labels[it - targets.begin()]));
+  }
+
+  if (options.type_test_stats) {
+    o.ins("incq", misses);
+  }
+  o.ins("movq", x86::mem(32, x86::RBX), x86::RAX); // method table
+  o.ins("call",
+        x86::indirect(x86::mem(type->methods_numbered[name] * 8, x86::RAX)));
+
+  for (int i = 0; i < targets.size(); ++i) {
+    o.ins("jmp", x86::sym(label_done));
+    o.label(labels[i]);
+    if (options.type_test_stats) {
+      o.ins("incq", hits);
+    }
+    call_generate(o, targets[i], name);
+  }
+  o.label(label_done);
+}
+
+void CodeGenerator::mul_constant_generate(x86::Emitter &o, int64_t k) {
+  if (k < 0 && k != INT64_MIN) {
+    mul_constant_generate(o, -k);
+    o.ins("negq", x86::RAX);
+    return;
+  }
+  if (k == 0) {
+    o.ins("xorq", x86::RAX, x86::RAX);
+    return;
+  }
+
+  int n = log2_exact(k);
+  if (n >= 0) {
+    if (n > 0) {
+      o.ins("salq", x86::imm(n), x86::RAX);
+    }
+    return;
+  }
+  // 3, 5 or 9 times 2^n
+  for (int scale : {2, 4, 8}) {
+    n = k % (scale + 1) == 0 ? log2_exact(k / (scale + 1)) : -1;
+    if (n >= 0) {
+      o.ins("leaq", x86::mem(0, x86::RAX, x86::RAX, scale), x86::RAX);
+      if (n > 0) {
+        o.ins("salq", x86::imm(n), x86::RAX);
+      }
+      return;
+    }
+  }
+  // 2^n + 1 or 2^n - 1
+  n = log2_exact(k - 1);
+  int m = log2_exact((uint64_t)k + 1);
+  if (n >= 0 || m >= 0) {
+    o.ins("movq", x86::RAX, x86::RCX);
+    o.ins("salq", x86::imm(n >= 0 ? n : m), x86::RAX);
+    o.ins(n >= 0 ? "addq" : "subq", x86::RCX, x86::RAX);
+    return;
+  }
+
+  if (util::fits_int32(k)) {
+    o.ins("imulq", x86::imm(k), x86::RAX);
+  } else {
+    load_constant(o, k, x86::RCX);
+    o.ins("imulq", x86::RCX, x86::RAX);
+  }
+}
+
+void CodeGenerator::div_constant_generate(x86::Emitter &o, int64_t k) {
+  if (k == 1) {
+    return;
+  }
+  // division by 0 and INT64_MIN / -1 trap like they do with idivq
+  if (k == 0 || k == -1 || k == INT64_MIN) {
+    load_constant(o, k, x86::RCX);
+    o.ins("cqto");
+    o.ins("idivq", x86::RCX);
+    return;
+  }
+
+  uint64_t ak = k < 0 ? -(uint64_t)k : k;
+  int n = log2_exact(ak);
+  if (n >= 0) {
+    // round towards 0 by adding 2^n - 1 to negative dividends
+    o.ins("movq", x86::RAX, x86::RDX);
+    o.ins("sarq", x86::imm(63), x86::RDX);
+    o.ins("shrq", x86::imm(64 - n), x86::RDX);
+    o.ins("addq", x86::RDX, x86::RAX);
+    o.ins("sarq", x86::imm(n), x86::RAX);
+    if (k < 0) {
+      o.ins("negq", x86::RAX);
+    }
+    return;
+  }
+
+  int64_t m;
+  int s;
+  magic(k, m, s);
+  o.ins("movq", x86::RAX, x86::RCX);
+  load_constant(o, m, x86::RAX);
+  o.ins("imulq", x86::RCX); // %rdx = the high half of m * dividend
+  if (k > 0 && m < 0) {
+    o.ins("addq", x86::RCX, x86::RDX);
+  } else if (k < 0 && m > 0) {
+    o.ins("subq", x86::RCX, x86::RDX);
+  }
+  if (s > 0) {
+    o.ins("sarq", x86::imm(s), x86::RDX);
+  }
+  // add 1 to negative quotients
+  o.ins("movq", x86::RDX, x86::RAX);
+  o.ins("shrq", x86::imm(63), x86::RAX);
+  o.ins("addq", x86::RDX, x86::RAX);
+}
+
 void CodeGenerator::arrange_classes() {
   for (int i = 0; i < sa->classes.size(); ++i) {
     auto cls = sa->classes[i];
     cls->id = i + 1;
-
-    get_string_constant_no(cls->name);
   }
 
   sa->objectClass->arrange();
+  reach.analyse();
 }
 
-void CodeGenerator::generate_prototypes(std::ostream &o) {
-  o << "  .text\n\n";
+void CodeGenerator::generate_prototypes(x86::Emitter &o) {
+  o.directive(".section", ".rodata");
   for (auto &cls : sa->classes) {
-    o << "  .balign 8\n";
-    o << cls->name + "_prototype:\n";
-    o << "  .quad " + cls->name + "_prototype_END - " + cls->name +
-             "_prototype\n";            // size
-    o << "  .quad 0\n";                 // GC
-    o << "  .quad " << cls->id << "\n"; // id
-    o << "  .quad string_constant_" << get_string_constant_no(cls->name)
-      << "\n";                                       // name
-    o << "  .quad " + cls->name + "_method_table\n"; // method table
+    if (!reach.is_live(cls.get())) {
+      continue;
+    }
+    o.directive(".balign", "8");
+    auto prototype = cls->name + "_prototype";
+    auto name_no = get_string_constant_no(cls->name);
+    o.label(prototype);
+    o.directive(".quad", prototype + "_END - " + prototype); // size
+    o.directive(".quad", "0");                               // GC
+    o.directive(".quad", std::to_string(cls->id));           // id
+    o.directive(".quad", "string_constant_" + std::to_string(name_no)); // name
+    o.directive(".quad", cls->name + "_method_table"); // method table
 
     // fields
     for (auto &name : cls->fields_ordered) {
       auto field = cls->get_field(name);
       if (field->type == sa->stringClass.get()) {
-        o << "  .quad string_constant_" << get_string_constant_no("") << " # " + name + "\n";
+        o.directive(".quad", "string_constant_" +
+                                 std::to_string(get_string_constant_no("")));
       } else if (field->type == sa->intClass.get()) {
-        o << "  .quad int_constant_" << get_int_constant_no(0) << " # " + name + "\n";
+        o.directive(".quad", "int_constant_" +
+                                 std::to_string(get_int_constant_no(0)));
       } else if (field->type == sa->boolClass.get()) {
-        o << "  .quad bool_constant_false" << " # " + name + "\n";
+        o.directive(".quad", "bool_constant_false");
       } else {
-        o << "  .quad 0" << "# " + name + "\n";
+        o.directive(".quad", "0");
       }
     }
 
     // data
     if (cls == sa->stringClass) {
-      o << "  .quad string_data_" << get_string_constant_no("") << "\n";
+      o.directive(".quad", "string_data_" +
+                               std::to_string(get_string_constant_no("")));
     } else if (cls == sa->intClass) {
-      o << "  .quad 0\n";
+      o.directive(".quad", "0");
     } else if (cls == sa->boolClass) {
-      o << "  .quad 0\n";
+      o.directive(".quad", "0");
+    } else if (cls == sa->arrayClass || cls == sa->intArrayClass) {
+      o.directive(".quad", "0"); // length
     }
 
-    o << cls->name + "_prototype_END:\n\n";
+    o.label(prototype + "_END");
   }
 
   // prototype table
-  o << "  .balign 8\n";
-  o << "prototype_table:\n";
-  o << "  .quad 0\n";
+  o.directive(".balign", "8");
+  o.label("prototype_table");
+  o.directive(".quad", "0");
   for (auto &cls : sa->classes) {
-    o << "  .quad " + cls->name + "_prototype\n";
+    if (reach.is_live(cls.get())) {
+      o.directive(".quad", cls->name + "_prototype");
+    } else {
+      o.directive(".quad", "0");
+    }
   }
-  o << "\n";
 
-  // method tables
+  // method tables, of the classes that have objects
   for (auto &cls : sa->classes) {
-    o << "  .balign 8\n";
-    o << cls->name + "_method_table:\n";
+    if (!reach.is_live(cls.get())) {
+      continue;
+    }
+    o.directive(".balign", "8");
+    o.label(cls->name + "_method_table");
     for (auto &method_name : cls->methods_ordered) {
-      o << "  .quad " + cls->methods_resolved[method_name]->name + "." +
-               method_name + "\n";
+      auto def = cls->methods_resolved[method_name];
+      if (reach.is_live(def, method_name)) {
+        o.directive(".quad", def->name + "." + method_name);
+      } else {
+        o.directive(".quad", "0");
+      }
     }
-    o << "\n";
   }
 }
 
-void CodeGenerator::generate_methods(std::ostream &o) {
-  o << "  .text\n\n";
+void CodeGenerator::generate_methods(x86::Emitter &o) {
+  o.directive(".text");
+
+  std::set<ast::Class *> user;
   for (auto &cls : program->classes) {
-    selfClass = cls.get();
+    user.insert(cls.get());
+    auto filename = cls->get_loc().begin.filename;
+    if (filename && !file_numbers.count(*filename)) {
+      auto n = file_numbers.size() + 1;
+      file_numbers[*filename] = n;
+      if (options.debug_info) {
+        o.directive(".file", std::to_string(n) + " \"" + *filename + "\"");
+      }
+    }
+  }
+
+  // callers and callees together, and entries aligned
+  for (auto &ref : method_order()) {
+    auto cls = ref.first;
+    if (!user.count(cls)) {
+      continue;
+    }
+    selfClass = cls;
 
     scope.enter();
     for (auto &field_name : cls->fields_ordered) {
-      auto field_ref =
-          std::to_string((5 + cls->fields_numbered[field_name]) * 8) + "(%rbx)";
-      scope.add(field_name, field_ref);
+      scope.add(field_name,
+                x86::mem((5 + cls->fields_numbered[field_name]) * 8, x86::RBX));
     }
 
-    for (auto it = cls->name2Method.begin(); it != cls->name2Method.end();
-         ++it) {
-      o << cls->name + "." + it->first + ":\n";
-      it->second->generate(this, o);
-      o << "\n";
+    auto method = cls->name2Method[ref.second];
+    auto label = cls->name + "." + ref.second;
+    if (options.instrument_calls) {
+      instrumented.push_back(label);
+    }
+    o.directive(".p2align", "4");
+    o.directive(".type", label + ", @function");
+    o.label(label);
+    if (options.debug_info) {
+      o.directive(".cfi_startproc");
     }
+    if (options.opt_level < 0) {
+      method->generate(this, o);
+    } else {
+      auto f = ir::Builder(this).lower(cls, method);
+      ir::PassManager(options.opt_level,
+                      options.dump_ir ? &std::cerr : nullptr)
+          .run(f);
+      ir::generate(f, this, o);
+    }
+    if (options.debug_info) {
+      o.directive(".cfi_endproc");
+    }
+    o.directive(".size", label + ", .-" + label);
+    o.loc = x86::Loc();
+    if (options.peephole) {
+      peephole(o.lines, label);
+    }
+    o.flush();
 
     scope.exit();
   }
 }
 
-void CodeGenerator::generate_object_methods(std::ostream &o) {
-  o << "Object.__init__:\n";
-  o << "  movq %rbx, %rax\n";
-  o << "  ret\n\n";
-
-  o << "Object.copy:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
-
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-
-  o << "  movq 0(%rbx), %rdi\n";
-  o << "  call malloc\n";
-  o << "  cmpq $0, %rax\n";
-  o << "  je _error\n";
-
-  o << "  pushq %rax\n";
-  o << "  subq $8, %rsp\n"; // align stack
-  o << "  movq %rax, %rdi\n";
-  o << "  movq %rbx, %rsi\n";
-  o << "  movq 0(%rbx), %rdx\n";
-  o << "  call memcpy\n";
-  o << "  addq $8, %rsp\n";
-  o << "  popq %rax\n";
-
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+std::vector<ReachabilityAnalyser::MethodRef> CodeGenerator::method_order() {
+  auto order = reach.order;
+  if (options.profile) {
+    auto count = [&](const ReachabilityAnalyser::MethodRef &ref) {
+      return profile_count("method " + ref.first->name + "." + ref.second);
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const ReachabilityAnalyser::MethodRef &a,
+                         const ReachabilityAnalyser::MethodRef &b) {
+                       return count(a) > count(b);
+                     });
+  }
+  return order;
+}
 
-  o << "Object.abort:\n";
-  o << "  jmp _abort\n\n";
+void CodeGenerator::generate_object_methods(x86::Emitter &o) {
+  o.label("Object.__init__");
+  o.ins("movq", x86::RBX, x86::RAX);
+  o.ins("ret");
+
+  o.label("Object.copy");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+  o.ins("movq", x86::mem(0, x86::RBX), x86::RDI);
+  o.ins("call", x86::sym("malloc"));
+  o.ins("cmpq", x86::imm(0), x86::RAX);
+  o.ins("je", x86::sym("_error"));
+
+  o.ins("incq", x86::sym("stats_objects"));
+  o.ins("movq", x86::mem(0, x86::RBX), x86::RDX);
+  o.ins("addq", x86::RDX, x86::sym("stats_object_bytes"));
+  if (options.alloc_stats) {
+    o.ins("movq", x86::mem(16, x86::RBX), x86::RCX); // class id
+    o.ins("incq", x86::mem("alloc_objects", 0, x86::NOREG, x86::RCX, 8));
+    o.ins("movq", x86::mem(0, x86::RBX), x86::RDX);
+    o.ins("addq", x86::RDX,
+          x86::mem("alloc_bytes", 0, x86::NOREG, x86::RCX, 8));
+  }
 
-  o << "Object.type_name:\n";
-  o << "  movq 24(%rbx), %rax\n";
-  o << "  ret\n\n";
+  o.ins("pushq", x86::RAX);
+  o.ins("subq", x86::imm(8), x86::RSP); // align stack
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("movq", x86::RBX, x86::RSI);
+  o.ins("movq", x86::mem(0, x86::RBX), x86::RDX);
+  o.ins("call", x86::sym("memcpy"));
+  o.ins("addq", x86::imm(8), x86::RSP);
+  o.ins("popq", x86::RAX);
+  // the object, its class id and size
+  probe_generate(o, "cool", "alloc", "8@%rax 8@16(%rax) 8@0(%rax)");
+
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
+
+  o.directive(".pushsection", ".text.unlikely,\"ax\"");
+  o.label("Object.abort");
+  o.ins("jmp", x86::sym("_abort"));
+  o.directive(".popsection");
+
+  o.label("Object.type_name");
+  o.ins("movq", x86::mem(24, x86::RBX), x86::RAX);
+  o.ins("ret");
 }
 
-void CodeGenerator::generate_string_methods(std::ostream &o) {
-  o << "String.__init__:\n";
-  o << "  movq %rbx, %rax\n";
-  o << "  ret\n\n";
+void CodeGenerator::generate_string_methods(x86::Emitter &o) {
+  o.label("String.__init__");
+  o.ins("movq", x86::RBX, x86::RAX);
+  o.ins("ret");
+
+  o.label("String.length");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
 
-  o << "String.length:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
 
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
+  o.ins("movq", x86::mem(40, x86::RBX), x86::RDI);
+  o.ins("call", x86::sym("strlen"));
 
-  o << "  movq 40(%rbx), %rdi\n";
-  o << "  call strlen\n";
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("call", x86::sym("Int.__new__"));
 
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
 
   // str3 <- str1.concat(str2)
-  o << "String.concat:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
+  o.label("String.concat");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
 
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
 
-  o << "  movq 16(%rbp), %rdi\n"; // str2
-  o << "  movq 40(%rdi), %rdi\n"; // str2 data
-  o << "  call strlen\n";
+  o.ins("movq", x86::mem(16, x86::RBP), x86::RDI); // str2
+  o.ins("movq", x86::mem(40, x86::RDI), x86::RDI); // str2 data
+  o.ins("call", x86::sym("strlen"));
 
-  o << "  pushq %rax\n";          // str2 length
-  o << "  pushq %rax\n";          // align stack
-  o << "  movq 40(%rbx), %rdi\n"; // str1 data
-  o << "  call strlen\n";
-  o << "  movq %rax, %rdi\n"; // str1 length
-  o << "  popq %rax\n";
-  o << "  popq %rax\n";
+  o.ins("pushq", x86::RAX);          // str2 length
+  o.ins("pushq", x86::RAX);          // align stack
+  o.ins("movq", x86::mem(40, x86::RBX), x86::RDI); // str1 data
+  o.ins("call", x86::sym("strlen"));
+  o.ins("movq", x86::RAX, x86::RDI); // str1 length
+  o.ins("popq", x86::RAX);
+  o.ins("popq", x86::RAX);
 
-  o << "  addq %rax, %rdi\n";
-  o << "  incq %rdi\n"; // str1 length + str2 length + 1
-  o << "  call malloc\n";
-  o << "  cmpq $0, %rax\n";
-  o << "  je _error\n";
+  o.ins("addq", x86::RAX, x86::RDI);
+  o.ins("incq", x86::RDI); // str1 length + str2 length + 1
+  string_data_count_generate(o, x86::RDI);
+  o.ins("addq", x86::RDI, x86::sym("stats_copied_bytes"));
+  o.ins("call", x86::sym("malloc"));
+  o.ins("cmpq", x86::imm(0), x86::RAX);
+  o.ins("je", x86::sym("_error"));
 
-  o << "  pushq %rax\n";
-  o << "  pushq %rax\n";
+  o.ins("pushq", x86::RAX);
+  o.ins("pushq", x86::RAX);
 
-  o << "  movq %rax, %rdi\n";     // str3 data
-  o << "  movq 40(%rbx), %rsi\n"; // str1 data
-  o << "  call strcpy\n";
+  o.ins("movq", x86::RAX, x86::RDI);     // str3 data
+  o.ins("movq", x86::mem(40, x86::RBX), x86::RSI); // str1 data
+  o.ins("call", x86::sym("strcpy"));
 
-  o << "  movq (%rsp), %rdi\n";   // str3 data
-  o << "  movq 16(%rbp), %rsi\n"; // str2
-  o << "  movq 40(%rsi), %rsi\n"; // str2 data
-  o << "  call strcat\n";
+  o.ins("movq", x86::mem(0, x86::RSP), x86::RDI);   // str3 data
+  o.ins("movq", x86::mem(16, x86::RBP), x86::RSI); // str2
+  o.ins("movq", x86::mem(40, x86::RSI), x86::RSI); // str2 data
+  o.ins("call", x86::sym("strcat"));
 
-  o << "  popq %rdi\n";
-  o << "  popq %rdi\n"; // str3 data
+  o.ins("popq", x86::RDI);
+  o.ins("popq", x86::RDI); // str3 data
 
-  o << "  call String.__new__\n";
+  o.ins("call", x86::sym("String.__new__"));
 
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
 
   // str2 <- str1.substr(i1, i2)
-  o << "String.substr:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
-
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-
-  o << "  movq 40(%rbx), %rdi\n"; // str1 data
-  o << "  call strlen\n";
-
-  o << "  movq 16(%rbp), %rdi\n";
-  o << "  movq 40(%rdi), %rdi\n"; // i1
-  o << "  movq 24(%rbp), %rsi\n";
-  o << "  movq 40(%rsi), %rsi\n"; // i2
-
-  o << "  cmpq %rax, %rdi\n";
-  o << "  jae 3f\n"; // i1 >= str1 length
-  o << "  cmpq %rax, %rsi\n";
-  o << "  jbe 1f\n"; // i2 <= str1 length
-  o << "  movq %rax, %rsi\n";
-  o << "1:\n";
-  o << "  cmpq %rdi, %rsi\n";
-  o << "  jbe 3f\n"; // i2 <= i1
-
-  o << "  pushq %rdi\n"; // i1
-  o << "  subq %rdi, %rsi\n";
-  o << "  incq %rsi\n";
-  o << "  pushq %rsi\n"; // i2 - i1 + 1
-  o << "  movq %rsi, %rdi\n";
-  o << "  call malloc\n";
-  o << "  cmpq $0, %rax\n";
-  o << "  je _error\n";
-
-  o << "  pushq %rax\n"; // str2 data
-  o << "  pushq %rax\n"; // align stack
-
-  o << "  movq %rax, %rdi\n";
-  o << "  xorq %rsi, %rsi\n";
-  o << "  movq 16(%rsp), %rdx\n"; // i2 - i1 + 1
-  o << "  call memset\n";
-
-  o << "  movq 8(%rsp), %rdi\n"; // str2 data
-  o << "  movq 16(%rsp), %rdx\n";
-  o << "  decq %rdx\n";           // i2 - i1
-  o << "  movq 24(%rsp), %rsi\n"; // i1
-  o << "  addq 40(%rbx), %rsi\n"; // str1 data + i1
-  o << "  call memcpy\n";
-  o << "  movq %rax, %rdi\n";
-  o << "  addq $32, %rsp\n";
-  o << "  call String.__new__\n";
-  o << "  jmp 4f\n";
-
-  o << "3:\n";
-  o << "  movq $string_constant_" + std::to_string(get_string_constant_no("")) +
-           ", %rax\n";
-  o << "4:\n";
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.label("String.substr");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+  o.ins("movq", x86::mem(40, x86::RBX), x86::RDI); // str1 data
+  o.ins("call", x86::sym("strlen"));
+
+  o.ins("movq", x86::mem(16, x86::RBP), x86::RDI);
+  o.ins("movq", x86::mem(40, x86::RDI), x86::RDI); // i1
+  o.ins("movq", x86::mem(24, x86::RBP), x86::RSI);
+  o.ins("movq", x86::mem(40, x86::RSI), x86::RSI); // i2
+
+  o.ins("cmpq", x86::RAX, x86::RDI);
+  o.ins("jae", x86::sym("3f")); // i1 >= str1 length
+  o.ins("cmpq", x86::RAX, x86::RSI);
+  o.ins("jbe", x86::sym("1f")); // i2 <= str1 length
+  o.ins("movq", x86::RAX, x86::RSI);
+  o.label("1");
+  o.ins("cmpq", x86::RDI, x86::RSI);
+  o.ins("jbe", x86::sym("3f")); // i2 <= i1
+
+  o.ins("pushq", x86::RDI); // i1
+  o.ins("subq", x86::RDI, x86::RSI);
+  o.ins("incq", x86::RSI);
+  o.ins("pushq", x86::RSI); // i2 - i1 + 1
+  o.ins("movq", x86::RSI, x86::RDI);
+  string_data_count_generate(o, x86::RDI);
+  o.ins("addq", x86::RDI, x86::sym("stats_copied_bytes"));
+  o.ins("call", x86::sym("malloc"));
+  o.ins("cmpq", x86::imm(0), x86::RAX);
+  o.ins("je", x86::sym("_error"));
+
+  o.ins("pushq", x86::RAX); // str2 data
+  o.ins("pushq", x86::RAX); // align stack
+
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("xorq", x86::RSI, x86::RSI);
+  o.ins("movq", x86::mem(16, x86::RSP), x86::RDX); // i2 - i1 + 1
+  o.ins("call", x86::sym("memset"));
+
+  o.ins("movq", x86::mem(8, x86::RSP), x86::RDI); // str2 data
+  o.ins("movq", x86::mem(16, x86::RSP), x86::RDX);
+  o.ins("decq", x86::RDX);           // i2 - i1
+  o.ins("movq", x86::mem(24, x86::RSP), x86::RSI); // i1
+  o.ins("addq", x86::mem(40, x86::RBX), x86::RSI); // str1 data + i1
+  o.ins("call", x86::sym("memcpy"));
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("addq", x86::imm(32), x86::RSP);
+  o.ins("call", x86::sym("String.__new__"));
+  o.ins("jmp", x86::sym("4f"));
+
+  o.label("3");
+  o.ins("movq", string_constant(""), x86::RAX);
+  o.label("4");
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
 
   // i1 <- str1.to_int()
-  o << "String.to_int:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
+  o.label("String.to_int");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
 
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
 
-  o << "  movq 40(%rbx), %rdi\n"; // str1 data
-  o << "  call atol\n";
-  o << "  movq %rax, %rdi\n";
-  o << "  call Int.__new__\n";
+  o.ins("movq", x86::mem(40, x86::RBX), x86::RDI); // str1 data
+  o.ins("call", x86::sym("atol"));
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("call", x86::sym("Int.__new__"));
 
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
 
-  o << "String.__new__:\n";
-  o << "  pushq %rdi\n";
+  o.label("String.__new__");
+  o.ins("pushq", x86::RDI);
 
-  o << "  pushq %rbx\n";
-  o << "  movq $String_prototype, %rbx\n";
-  o << "  call Object.copy\n";
-  o << "  popq %rbx\n";
+  o.ins("pushq", x86::RBX);
+  o.ins("movq", x86::imm("String_prototype"), x86::RBX);
+  o.ins("call", x86::sym("Object.copy"));
+  o.ins("popq", x86::RBX);
 
-  o << "  popq %rdi\n";
-  o << "  movq %rdi, 40(%rax)\n";
-  o << "  ret\n\n";
+  o.ins("popq", x86::RDI);
+  o.ins("movq", x86::RDI, x86::mem(40, x86::RAX));
+  o.ins("ret");
 }
 
-void CodeGenerator::generate_int_methods(std::ostream &o) {
-  o << "Int.__init__:\n";
-  o << "  movq %rbx, %rax\n";
-  o << "  ret\n\n";
+void CodeGenerator::generate_int_methods(x86::Emitter &o) {
+  o.label("Int.__init__");
+  o.ins("movq", x86::RBX, x86::RAX);
+  o.ins("ret");
 
   // str1 <- i1.to_string()
-  o << "Int.to_string:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
+  o.label("Int.to_string");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
 
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
 
-  o << "  movq $32, %rdi\n";
-  o << "  call malloc\n";
-  o << "  cmpq $0, %rax\n";
-  o << "  je _error\n";
+  o.ins("movq", x86::imm(32), x86::RDI);
+  string_data_count_generate(o, x86::RDI);
+  o.ins("call", x86::sym("malloc"));
+  o.ins("cmpq", x86::imm(0), x86::RAX);
+  o.ins("je", x86::sym("_error"));
 
-  o << "  pushq %rax\n"; // str1 data
-  o << "  pushq %rax\n"; // align stack
+  o.ins("pushq", x86::RAX); // str1 data
+  o.ins("pushq", x86::RAX); // align stack
 
-  o << "  movq %rax, %rdi\n";
-  o << "  movq $string_data_" + std::to_string(get_string_constant_no("%ld")) +
-           ", %rsi\n";
-  o << "  movq 40(%rbx), %rdx\n";
-  o << "  call sprintf\n";
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("movq", string_data("%ld"), x86::RSI);
+  o.ins("movq", x86::mem(40, x86::RBX), x86::RDX);
+  o.ins("call", x86::sym("sprintf"));
 
-  o << "  popq %rdi\n";
-  o << "  popq %rdi\n"; // str1 data
-  o << "  call String.__new__\n";
+  o.ins("popq", x86::RDI);
+  o.ins("popq", x86::RDI); // str1 data
+  o.ins("call", x86::sym("String.__new__"));
 
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
 
-  o << "Int.__new__:\n";
-  o << "  pushq %rdi\n";
+  o.label("Int.__new__");
+  o.ins("pushq", x86::RDI);
 
-  o << "  pushq %rbx\n";
-  o << "  movq $Int_prototype, %rbx\n";
-  o << "  call Object.copy\n";
-  o << "  popq %rbx\n";
+  o.ins("pushq", x86::RBX);
+  o.ins("movq", x86::imm("Int_prototype"), x86::RBX);
+  o.ins("call", x86::sym("Object.copy"));
+  o.ins("popq", x86::RBX);
 
-  o << "  popq %rdi\n";
-  o << "  movq %rdi, 40(%rax)\n";
-  o << "  ret\n\n";
+  o.ins("popq", x86::RDI);
+  o.ins("movq", x86::RDI, x86::mem(40, x86::RAX));
+  o.ins("ret");
 }
 
-void CodeGenerator::generate_bool_methods(std::ostream &o) {
-  o << "Bool.__init__:\n";
-  o << "  movq %rbx, %rax\n";
-  o << "  ret\n\n";
+void CodeGenerator::generate_bool_methods(x86::Emitter &o) {
+  o.label("Bool.__init__");
+  o.ins("movq", x86::RBX, x86::RAX);
+  o.ins("ret");
 }
 
-void CodeGenerator::generate_io_methods(std::ostream &o) {
-  o << "IO.__init__:\n";
-  o << "  movq %rbx, %rax\n";
-  o << "  ret\n\n";
+void CodeGenerator::generate_io_methods(x86::Emitter &o) {
+  o.label("IO.__init__");
+  o.ins("movq", x86::RBX, x86::RAX);
+  o.ins("ret");
 
   // str1 <- io.in_string()
-  o << "IO.in_string:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
-
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-
-  o << "  pushq $0\n";           // char *line
-  o << "  pushq $0\n";           // size_t n
-  o << "  leaq 8(%rsp), %rdi\n"; // &line
-  o << "  movq %rsp, %rsi\n";    // &n
-  o << "  movq stdin, %rdx\n";
-  o << "  call getline\n"; // getline(&line, &n, stdin)
-  o << "  pop %rdi\n";
-  o << "  pop %rdi\n"; // line
-  o << "  call String.__new__\n";
-
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.label("IO.in_string");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+  o.ins("pushq", x86::imm(0));           // char *line
+  o.ins("pushq", x86::imm(0));           // size_t n
+  o.ins("leaq", x86::mem(8, x86::RSP), x86::RDI); // &line
+  o.ins("movq", x86::RSP, x86::RSI);    // &n
+  o.ins("movq", x86::sym("stdin"), x86::RDX);
+  o.ins("call", x86::sym("getline")); // getline(&line, &n, stdin)
+  o.ins("pop", x86::RDI); // n, the size of line
+  string_data_count_generate(o, x86::RDI);
+  o.ins("pop", x86::RDI); // line
+  o.ins("call", x86::sym("String.__new__"));
+  probe_generate(o, "cool", "in_string", "8@40(%rax)");
+
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
 
   // io1 <- io1.out_string(str1)
-  o << "IO.out_string:\n";
-  o << "  pushq %rbp\n";
-  o << "  movq %rsp, %rbp\n";
-
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-
-  o << "  movq $string_data_" + std::to_string(get_string_constant_no("%s")) +
-           ", %rdi\n";
-  o << "  movq 16(%rbp), %rsi\n"; // str1
-  o << "  movq 40(%rsi), %rsi\n"; // str1 data
-  o << "  call printf\n";
-
-  o << "  movq %rbx, %rax\n";
-
-  o << "  movq %rbp, %rsp\n";
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
-}
-
-void CodeGenerator::generate_system_methods(std::ostream &o) {
-  o << "_invoke_on_void:\n";
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-  o << "  movq $string_data_" +
-           std::to_string(get_string_constant_no("fatal error: invoke on void\n")) +
-           ", %rdi\n";
-  o << "  movq stderr, %rsi\n";
-  o << "  call fputs\n";
-  o << "  jmp _abort\n\n";
-
-  o << "_case_on_void:\n";
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-  o << "  movq $string_data_" +
-           std::to_string(get_string_constant_no("fatal error: case on void\n")) + ", %rdi\n";
-  o << "  movq stderr, %rsi\n";
-  o << "  call fputs\n";
-  o << "  jmp _abort\n\n";
-
-  o << "_case_no_match:\n";
-  o << "  andq $-16, %rsp\n"; // make the stack 16-byte aligned
-  o << "  movq $string_data_" +
-           std::to_string(get_string_constant_no("fatal error: case no match\n")) + ", %rdi\n";
-  o << "  movq stderr, %rsi\n";
-  o << "  call fputs\n";
-  o << "  jmp _abort\n\n";
+  o.label("IO.out_string");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
 
-  // ASSUME: stack is aligned
-  o << "_error:\n";
-  o << "  xorq %rdi, %rdi\n";
-  o << "  call perror\n\n";
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+  o.ins("movq", string_data("%s"), x86::RDI);
+  o.ins("movq", x86::mem(16, x86::RBP), x86::RSI); // str1
+  o.ins("movq", x86::mem(40, x86::RSI), x86::RSI); // str1 data
+  probe_generate(o, "cool", "out_string", "8@%rsi");
+  o.ins("call", x86::sym("printf"));
+
+  o.ins("movq", x86::RBX, x86::RAX);
+
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
+}
+
+void CodeGenerator::generate_clock_methods(x86::Emitter &o) {
+  // %rax <- the time of clock %rdi in ns, also called from IR code
+  o.label("_clock_ns");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+  o.ins("subq", x86::imm(16), x86::RSP);    // struct timespec
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+  o.ins("movq", x86::RSP, x86::RSI);
+  o.ins("call", x86::sym("clock_gettime"));
+  o.ins("movq", x86::mem(0, x86::RSP), x86::RAX);
+  o.ins("imulq", x86::imm(1000000000), x86::RAX);
+  o.ins("addq", x86::mem(8, x86::RSP), x86::RAX);
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
+
+  o.label("Clock.__init__");
+  o.ins("movq", x86::RBX, x86::RAX);
+  o.ins("ret");
+
+  // i1 <- clock.now_ns()
+  o.label("Clock.now_ns");
+  o.ins("movq", x86::imm(1), x86::RDI); // CLOCK_MONOTONIC
+  o.ins("call", x86::sym("_clock_ns"));
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("call", x86::sym("Int.__new__"));
+  o.ins("ret");
+
+  // i1 <- clock.cycles()
+  o.label("Clock.cycles");
+  o.ins("rdtsc");
+  o.ins("shlq", x86::imm(32), x86::RDX);
+  o.ins("orq", x86::RDX, x86::RAX);
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("call", x86::sym("Int.__new__"));
+  o.ins("ret");
+
+  // i1 <- clock.cpu_time_ns()
+  o.label("Clock.cpu_time_ns");
+  o.ins("movq", x86::imm(2), x86::RDI); // CLOCK_PROCESS_CPUTIME_ID
+  o.ins("call", x86::sym("_clock_ns"));
+  o.ins("movq", x86::RAX, x86::RDI);
+  o.ins("call", x86::sym("Int.__new__"));
+  o.ins("ret");
+}
+
+/*
+ * An Array or an IntArray is its length at 40 followed by its elements,
+ * pointers to objects or raw Ints, so that copy copies them too.
+ */
+void CodeGenerator::generate_array_methods(x86::Emitter &o) {
+  for (auto cls : {sa->arrayClass.get(), sa->intArrayClass.get()}) {
+    auto &name = cls->name;
+    o.label(name + ".__init__");
+    o.ins("movq", x86::RBX, x86::RAX);
+    o.ins("ret");
+
+    // a2 <- a1.new_array(n), whose elements are 0
+    o.label(name + ".new_array");
+    o.ins("movq", x86::mem(8, x86::RSP), x86::RDI);
+    o.ins("movq", x86::mem(40, x86::RDI), x86::RDI); // n
+    o.ins("movq", x86::RDI, x86::RAX);
+    o.ins("shrq", x86::imm(31), x86::RAX);
+    o.ins("jnz", x86::sym("_array_size")); // n < 0 or n >= 2^31
+
+    o.ins("pushq", x86::RBP);
+    o.ins("movq", x86::RSP, x86::RBP);
+
+    o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+    o.ins("pushq", x86::RDI);
+    o.ins("leaq", x86::mem(48, x86::NOREG, x86::RDI, 8), x86::RSI);
+    o.ins("pushq", x86::RSI); // size
+    o.ins("movq", x86::imm(1), x86::RDI);
+    o.ins("call", x86::sym("calloc"));
+    o.ins("cmpq", x86::imm(0), x86::RAX);
+    o.ins("je", x86::sym("_error"));
+    o.ins("popq", x86::RDX);
+    o.ins("popq", x86::RDI);
+
+    o.ins("movq", x86::RDX, x86::mem(0, x86::RAX));
+    for (int i = 16; i < 40; i += 8) { // class id, name and method table
+      o.ins("movq", x86::mem(i, x86::RBX), x86::RCX);
+      o.ins("movq", x86::RCX, x86::mem(i, x86::RAX));
+    }
+    o.ins("movq", x86::RDI, x86::mem(40, x86::RAX));
+
+    o.ins("incq", x86::sym("stats_objects"));
+    o.ins("addq", x86::RDX, x86::sym("stats_object_bytes"));
+    if (options.alloc_stats) {
+      o.ins("movq", x86::mem(16, x86::RBX), x86::RCX); // class id
+      o.ins("incq", x86::mem("alloc_objects", 0, x86::NOREG, x86::RCX, 8));
+      o.ins("addq", x86::RDX,
+            x86::mem("alloc_bytes", 0, x86::NOREG, x86::RCX, 8));
+    }
+    probe_generate(o, "cool", "alloc", "8@%rax 8@16(%rax) 8@0(%rax)");
+
+    o.ins("movq", x86::RBP, x86::RSP);
+    o.ins("popq", x86::RBP);
+    o.ins("ret");
+
+    for (auto method : {"get", "set", "length"}) {
+      o.label(name + "." + method);
+      array_access_generate(o, cls, method, 8);
+      o.ins("ret");
+    }
+  }
+}
+
+void CodeGenerator::generate_system_methods(x86::Emitter &o) {
+  // error paths
+  o.directive(".section", ".text.unlikely,\"ax\"");
+
+  o.label("_invoke_on_void");
+  probe_generate(o, "cool", "invoke_on_void");
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+  o.ins("movq", string_data("fatal error: invoke on void\n"), x86::RDI);
+  o.ins("movq", x86::sym("stderr"), x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.ins("jmp", x86::sym("_abort"));
+
+  o.label("_case_on_void");
+  probe_generate(o, "cool", "case_on_void");
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+  o.ins("movq", string_data("fatal error: case on void\n"), x86::RDI);
+  o.ins("movq", x86::sym("stderr"), x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.ins("jmp", x86::sym("_abort"));
+
+  o.label("_array_bounds");
+  probe_generate(o, "cool", "array_bounds");
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+  o.ins("movq", string_data("fatal error: array index out of bounds\n"),
+        x86::RDI);
+  o.ins("movq", x86::sym("stderr"), x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.ins("jmp", x86::sym("_abort"));
+
+  o.label("_array_size");
+  probe_generate(o, "cool", "array_size");
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+  o.ins("movq", string_data("fatal error: array size out of range\n"),
+        x86::RDI);
+  o.ins("movq", x86::sym("stderr"), x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.ins("jmp", x86::sym("_abort"));
+
+  o.label("_case_no_match");
+  probe_generate(o, "cool", "case_no_match");
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+  o.ins("movq", string_data("fatal error: case no match\n"), x86::RDI);
+  o.ins("movq", x86::sym("stderr"), x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.ins("jmp", x86::sym("_abort"));
+
+  if (options.instrument_calls) {
+    o.label("_call_stack_overflow");
+    o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+    o.ins("movq",
+          string_data("fatal error: call stack too deep to instrument\n"),
+          x86::RDI);
+    o.ins("movq", x86::sym("stderr"), x86::RSI);
+    o.ins("call", x86::sym("fputs"));
+    o.ins("jmp", x86::sym("_abort"));
+  }
 
   // ASSUME: stack is aligned
-  o << "_abort:\n";
-  o << "  movq $-1, %rdi\n";
-  o << "  call exit\n";
-  o << "  jmp .\n\n";
+  o.label("_error");
+  o.ins("xorq", x86::RDI, x86::RDI);
+  o.ins("call", x86::sym("perror"));
 
-  o << "  .globl main\n\n";
-  o << "main:\n";
-  o << "  push %rbp\n";
-  o << "  movq %rsp, %rbp\n";
+  // ASSUME: stack is aligned
+  o.label("_abort");
+  probe_generate(o, "cool", "abort");
+  if (counting()) {
+    o.ins("call", x86::sym("_counters_write"));
+  }
+  o.ins("call", x86::sym("_stats_write"));
+  o.ins("movq", x86::imm(-1), x86::RDI);
+  o.ins("call", x86::sym("exit"));
+  o.ins("jmp", x86::sym("."));
+
+  o.directive(".text");
+  o.directive(".globl", "main");
+  o.label("main");
+  o.ins("push", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+
+  o.ins("movq", x86::imm("stats_variable"), x86::RDI);
+  o.ins("call", x86::sym("getenv"));
+  o.ins("movq", x86::RAX, x86::sym("stats_enabled"));
+  o.ins("movq", x86::imm(1), x86::RDI); // CLOCK_MONOTONIC
+  o.ins("movq", x86::imm("stats_start"), x86::RSI);
+  o.ins("call", x86::sym("clock_gettime"));
+
+  if (options.instrument_calls) {
+    // the root frame and node
+    o.ins("movq", x86::imm("call_nodes"), x86::sym("call_stack"));
+    o.ins("movq", x86::imm(-1), x86::sym("call_nodes"));
+  }
 
   ast::new_generate(this, o, sa->mainClass.get()); // new a Main object
 
-  o << "  pushq %rbx\n";
-  o << "  movq %rax, %rbx\n";
-  o << "  call Main.main\n";
-  o << "  popq %rbx\n";
-  o << "  movq 40(%rax), %rax\n";
+  o.ins("pushq", x86::RBX);
+  o.ins("movq", x86::RAX, x86::RBX);
+  o.ins("call", x86::sym("Main.main"));
+  o.ins("popq", x86::RBX);
+  o.ins("movq", x86::mem(40, x86::RAX), x86::RAX);
+
+  o.ins("pushq", x86::RAX);
+  if (counting()) {
+    o.ins("call", x86::sym("_counters_write"));
+  }
+  o.ins("call", x86::sym("_stats_write"));
+  o.ins("popq", x86::RAX);
 
-  o << "  popq %rbp\n";
-  o << "  ret\n\n";
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
+
+  generate_stats(o);
 }
 
-void CodeGenerator::generate_builtin_methods(std::ostream &o) {
-  o << "  .text\n\n";
+/*
+ * With COOL_STATS set in the environment, the program prints to stderr at
+ * exit: the objects it allocated and their bytes, the heap in use (nothing
+ * is freed, so that is its peak), the bytes of the strings concat and substr
+ * made, the dispatches and case expressions it evaluated, and the wall time
+ * since it started Main.main. Dispatches are counted where they are
+ * compiled, so static, dynamic, inlined and tail ones all count; the calls
+ * of `new` to initialize objects do not.
+ */
+void CodeGenerator::generate_stats(x86::Emitter &o) {
+  o.directive(".data");
+  o.directive(".balign", "8");
+  for (auto name : {"stats_enabled", "stats_objects", "stats_object_bytes",
+                    "stats_string_bytes", "stats_copied_bytes",
+                    "stats_dispatches", "stats_cases"}) {
+    o.label(name);
+    o.directive(".quad", "0");
+  }
+  o.label("stats_start"); // struct timespec
+  o.directive(".zero", "16");
+  o.label("stats_end");
+  o.directive(".zero", "16");
+  o.label("stats_variable");
+  o.directive(".string", "\"COOL_STATS\"");
+  o.label("stats_format");
+  o.directive(".string", "\"%-24s %14ld\\n\"");
+  o.label("stats_time_format");
+  o.directive(".string", "\"%-24s %4ld.%09ld\\n\"");
+  std::vector<std::string> names = {
+      "objects allocated", "bytes allocated", "peak heap bytes",
+      "string bytes copied", "dispatches", "case evaluations",
+      "Main.main seconds"};
+  for (int i = 0; i < names.size(); ++i) {
+    o.label("stats_name_" + std::to_string(i));
+    o.directive(".string", "\"" + names[i] + "\"");
+  }
+
+  o.directive(".section", ".text.unlikely,\"ax\"");
+  o.label("_stats_write");
+  o.ins("cmpq", x86::imm(0), x86::sym("stats_enabled"));
+  o.ins("jne", x86::sym("1f"));
+  o.ins("ret");
+  o.label("1");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+  o.ins("subq", x86::imm(80), x86::RSP); // struct mallinfo2
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+  o.ins("movq", x86::imm(1), x86::RDI); // CLOCK_MONOTONIC
+  o.ins("movq", x86::imm("stats_end"), x86::RSI);
+  o.ins("call", x86::sym("clock_gettime"));
+  o.ins("movq", x86::RSP, x86::RDI);
+  o.ins("call", x86::sym("mallinfo2"));
+
+  // fprintf(stderr, format, name, %rcx)
+  auto line_generate = [&](int i) {
+    o.ins("movq", x86::sym("stderr"), x86::RDI);
+    o.ins("movq", x86::imm("stats_format"), x86::RSI);
+    o.ins("movq", x86::imm("stats_name_" + std::to_string(i)), x86::RDX);
+    o.ins("xorq", x86::RAX, x86::RAX); // no vector registers
+    o.ins("call", x86::sym("fprintf"));
+  };
+  o.ins("movq", x86::sym("stats_objects"), x86::RCX);
+  line_generate(0);
+  o.ins("movq", x86::sym("stats_object_bytes"), x86::RCX);
+  o.ins("addq", x86::sym("stats_string_bytes"), x86::RCX);
+  line_generate(1);
+  o.ins("movq", x86::mem(32, x86::RSP), x86::RCX); // hblkhd, mmapped
+  o.ins("addq", x86::mem(56, x86::RSP), x86::RCX); // uordblks, in use otherwise
+  line_generate(2);
+  o.ins("movq", x86::sym("stats_copied_bytes"), x86::RCX);
+  line_generate(3);
+  o.ins("movq", x86::sym("stats_dispatches"), x86::RCX);
+  line_generate(4);
+  o.ins("movq", x86::sym("stats_cases"), x86::RCX);
+  line_generate(5);
+
+  o.ins("movq", x86::sym("stats_end"), x86::RAX);
+  o.ins("subq", x86::sym("stats_start"), x86::RAX);
+  o.ins("imulq", x86::imm(1000000000), x86::RAX);
+  o.ins("addq", x86::sym("stats_end", 8), x86::RAX);
+  o.ins("subq", x86::sym("stats_start", 8), x86::RAX); // nanoseconds
+  o.ins("movq", x86::imm(1000000000), x86::RCX);
+  o.ins("cqto");
+  o.ins("idivq", x86::RCX);
+  o.ins("movq", x86::RDX, x86::R8);
+  o.ins("movq", x86::RAX, x86::RCX);
+  o.ins("movq", x86::sym("stderr"), x86::RDI);
+  o.ins("movq", x86::imm("stats_time_format"), x86::RSI);
+  o.ins("movq", x86::imm("stats_name_6"), x86::RDX);
+  o.ins("xorq", x86::RAX, x86::RAX);
+  o.ins("call", x86::sym("fprintf"));
+
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
+
+  o.directive(".text");
+}
+
+void CodeGenerator::generate_builtin_methods(x86::Emitter &o) {
+  o.directive(".text");
   generate_object_methods(o);
   generate_string_methods(o);
   generate_int_methods(o);
   generate_bool_methods(o);
   generate_io_methods(o);
+  generate_clock_methods(o);
+  generate_array_methods(o);
   generate_system_methods(o);
 }
 
-void CodeGenerator::generate_constants(std::ostream &o) {
-  o << "  .text\n\n";
+void CodeGenerator::generate_constants(x86::Emitter &o) {
+  o.directive(".section", ".rodata");
+
+  // the object at `label`, of class `cls`, up to its data
+  auto header = [&](const std::string &label, ast::Class *cls) {
+    auto name_no = get_string_constant_no(cls->name);
+    o.directive(".balign", "8");
+    o.label(label);
+    o.directive(".quad", label + "_END - " + label);                   // size
+    o.directive(".quad", "0");                                         // GC
+    o.directive(".quad", std::to_string(cls->id));                     // id
+    o.directive(".quad", "string_constant_" + std::to_string(name_no)); // name
+    o.directive(".quad", cls->name + "_method_table"); // method table
+  };
 
   for (auto &s : string_constants) {
-    o << "  .balign 8\n";
     auto idx = std::to_string(string_constants_numbered[s]);
-    o << "string_constant_" + idx + ":\n";
-
-    o << "  .quad string_constant_" + idx + "_END - string_constant_" + idx +
-             "\n";                                  // size
-    o << "  .quad 0\n";                             // GC
-    o << "  .quad " << sa->stringClass->id << "\n"; // id
-    o << "  .quad string_constant_"
-      << get_string_constant_no(sa->stringClass->name) << "\n";  // name
-    o << "  .quad " + sa->stringClass->name + "_method_table\n"; // method table
+    header("string_constant_" + idx, sa->stringClass.get());
+    o.directive(".quad", "string_data_" + idx);
+    o.label("string_constant_" + idx + "_END");
 
-    o << "  .quad string_data_" + idx + "\n";
-    o << "string_constant_" + idx + "_END:\n\n";
-
-    o << "  .balign 8\n";
-    o << "string_data_" + idx + ":\n";
-    o << "  .string \"" + util::escape_string(s) + "\"\n";
-    o << "\n";
+    o.directive(".balign", "8");
+    o.label("string_data_" + idx);
+    o.directive(".string", "\"" + util::escape_string(s) + "\"");
   }
 
   for (auto &i : int_constants) {
-    o << "  .balign 8\n";
     auto idx = std::to_string(int_constants_numbered[i]);
-    o << "int_constant_" + idx + ":\n";
+    header("int_constant_" + idx, sa->intClass.get());
+    o.directive(".quad", std::to_string(i));
+    o.label("int_constant_" + idx + "_END");
+  }
 
-    o << "  .quad int_constant_" + idx + "_END - int_constant_" + idx +
-             "\n";                               // size
-    o << "  .quad 0\n";                          // GC
-    o << "  .quad " << sa->intClass->id << "\n"; // id
-    o << "  .quad string_constant_"
-      << get_string_constant_no(sa->intClass->name) << "\n";  // name
-    o << "  .quad " + sa->intClass->name + "_method_table\n"; // method table
+  auto bool_constants = std::vector<std::string>{"false", "true"};
+  for (int i = 0; i < bool_constants.size(); ++i) {
+    header("bool_constant_" + bool_constants[i], sa->boolClass.get());
+    o.directive(".quad", std::to_string(i));
+    o.label("bool_constant_" + bool_constants[i] + "_END");
+  }
+}
 
-    o << "  .quad " + std::to_string(i) + "\n";
+void CodeGenerator::call_runtime_generate(x86::Emitter &o) {
+  o.directive(".text");
+
+  // push a frame for method %rdi, under the node of the caller
+  o.label("_call_enter");
+  o.ins("leaq", x86::mem(0, x86::RDI, x86::RDI, 2), x86::RAX);
+  o.ins("incq", x86::mem("call_counts", 0, x86::NOREG, x86::RAX, 8));
+  o.ins("movq", x86::sym("call_sp"), x86::RCX);
+  o.ins("movq", x86::mem(0, x86::RCX), x86::RDX);   // the node of the caller
+  o.ins("movq", x86::mem(16, x86::RDX), x86::RAX); // its first child
+  o.label("1");
+  o.ins("testq", x86::RAX, x86::RAX);
+  o.ins("je", x86::sym("2f"));
+  o.ins("cmpq", x86::RDI, x86::mem(0, x86::RAX));
+  o.ins("je", x86::sym("4f"));
+  o.ins("movq", x86::mem(24, x86::RAX), x86::RAX);
+  o.ins("jmp", x86::sym("1b"));
+  o.label("2");
+  o.ins("movq", x86::sym("call_next_node"), x86::RAX);
+  o.ins("cmpq", x86::imm("call_nodes_END"), x86::RAX);
+  o.ins("jae", x86::sym("3f"));
+  o.ins("leaq", x86::mem(call_node_size, x86::RAX), x86::RSI);
+  o.ins("movq", x86::RSI, x86::sym("call_next_node"));
+  o.ins("movq", x86::RDI, x86::mem(0, x86::RAX));
+  o.ins("movq", x86::RDX, x86::mem(8, x86::RAX));
+  o.ins("movq", x86::mem(16, x86::RDX), x86::RSI);
+  o.ins("movq", x86::RSI, x86::mem(24, x86::RAX));
+  o.ins("movq", x86::RAX, x86::mem(16, x86::RDX));
+  o.ins("jmp", x86::sym("4f"));
+  o.label("3");
+  // out of nodes, the cycles go to the caller
+  o.ins("movq", x86::RDX, x86::RAX);
+  o.label("4");
+  o.ins("addq", x86::imm(call_frame_size), x86::RCX);
+  o.ins("cmpq", x86::imm("call_stack_END"), x86::RCX);
+  o.ins("jae", x86::sym("_call_stack_overflow"));
+  o.ins("movq", x86::RCX, x86::sym("call_sp"));
+  o.ins("movq", x86::RAX, x86::mem(0, x86::RCX));
+  o.ins("movq", x86::RDI, x86::mem(8, x86::RCX));
+  o.ins("movq", x86::imm(0), x86::mem(24, x86::RCX));
+  o.ins("rdtsc");
+  o.ins("shlq", x86::imm(32), x86::RDX);
+  o.ins("orq", x86::RDX, x86::RAX);
+  o.ins("movq", x86::RAX, x86::mem(16, x86::RCX));
+  o.ins("ret");
+
+  // pop the frame, keeping %rax
+  o.label("_call_exit");
+  o.ins("pushq", x86::RAX);
+  o.ins("rdtsc");
+  o.ins("shlq", x86::imm(32), x86::RDX);
+  o.ins("orq", x86::RDX, x86::RAX);
+  o.ins("movq", x86::sym("call_sp"), x86::RCX);
+  o.ins("subq", x86::mem(16, x86::RCX), x86::RAX); // inclusive
+  o.ins("movq", x86::RAX, x86::RDX);
+  o.ins("subq", x86::mem(24, x86::RCX), x86::RDX); // exclusive
+  o.ins("movq", x86::mem(0, x86::RCX), x86::RSI);
+  o.ins("addq", x86::RDX, x86::mem(32, x86::RSI));
+  o.ins("movq", x86::mem(8, x86::RCX), x86::RDI);
+  o.ins("leaq", x86::mem(0, x86::RDI, x86::RDI, 2), x86::RDI);
+  o.ins("addq", x86::RAX, x86::mem("call_counts", 8, x86::NOREG, x86::RDI, 8));
+  o.ins("addq", x86::RDX, x86::mem("call_counts", 16, x86::NOREG, x86::RDI, 8));
+  o.ins("subq", x86::imm(call_frame_size), x86::RCX);
+  o.ins("movq", x86::RCX, x86::sym("call_sp"));
+  o.ins("addq", x86::RAX, x86::mem(24, x86::RCX));
+  o.ins("popq", x86::RAX);
+  o.ins("ret");
+
+  // print the methods from the root to node %rdi, separated by ';', to the
+  // FILE in %r12
+  o.directive(".section", ".text.unlikely,\"ax\"");
+  o.label("_call_path");
+  o.ins("pushq", x86::RBX);
+  o.ins("movq", x86::RDI, x86::RBX);
+  o.ins("movq", x86::mem(8, x86::RBX), x86::RDI);
+  o.ins("cmpq", x86::imm(-1), x86::mem(0, x86::RDI));
+  o.ins("je", x86::sym("1f"));
+  o.ins("call", x86::sym("_call_path"));
+  o.ins("movq", x86::imm("call_separator"), x86::RDI);
+  o.ins("movq", x86::R12, x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.label("1");
+  o.ins("movq", x86::mem(0, x86::RBX), x86::RAX);
+  o.ins("movq", x86::mem("call_names", 0, x86::NOREG, x86::RAX, 8), x86::RDI);
+  o.ins("movq", x86::R12, x86::RSI);
+  o.ins("call", x86::sym("fputs"));
+  o.ins("popq", x86::RBX);
+  o.ins("ret");
+}
 
-    o << "int_constant_" + idx + "_END:\n\n";
+/*
+ * Probes are described as in <sys/sdt.h>: a note of type 3 named "stapsdt"
+ * for each, holding the address of its nop, that of .stapsdt.base, that of
+ * its semaphore (none) and its provider, name and arguments. The notes are
+ * made after the methods not reachable are stripped, with their probes.
+ */
+void CodeGenerator::generate_probes(x86::Emitter &o) {
+  o.directive(".pushsection", ".stapsdt.base,\"a\",@progbits");
+  o.label("_.stapsdt.base");
+  o.directive(".zero", "1");
+  o.directive(".popsection");
+
+  o.directive(".pushsection", ".note.stapsdt,\"\",@note");
+  for (auto &probe : probes) {
+    auto desc_size = 3 * 8 + probe.provider.size() + probe.name.size() +
+                     probe.args.size() + 3;
+    o.directive(".balign", "4");
+    o.directive(".4byte", "8, " + std::to_string(desc_size) + ", 3");
+    o.directive(".asciz", "\"stapsdt\"");
+    o.directive(".8byte", probe.label + ", _.stapsdt.base, 0");
+    o.directive(".asciz", "\"" + probe.provider + "\"");
+    o.directive(".asciz", "\"" + probe.name + "\"");
+    o.directive(".asciz", "\"" + probe.args + "\"");
   }
+  o.directive(".balign", "4");
+  o.directive(".popsection");
+}
 
-  auto bool_constants = std::vector<std::string>{"false", "true"};
-  for (int i = 0; i < bool_constants.size(); ++i) {
-    o << "  .balign 8\n";
-    o << "bool_constant_" + bool_constants[i] + ":\n";
+void CodeGenerator::generate_counters(x86::Emitter &o) {
+  o.directive(".data");
+  o.directive(".balign", "8");
+  o.label("counters");
+  if (counters) {
+    o.directive(".zero", std::to_string(counters * 8));
+  }
+  if (options.alloc_stats) {
+    // by class id
+    auto n = (sa->classes.size() + 1) * 8;
+    o.label("alloc_objects");
+    o.directive(".zero", std::to_string(n));
+    o.label("alloc_bytes");
+    o.directive(".zero", std::to_string(n));
+  }
+  if (options.instrument_calls) {
+    // by method: calls, inclusive and exclusive cycles
+    o.label("call_counts");
+    o.directive(".zero", std::to_string(instrumented.size() * 24));
+    o.label("call_sp");
+    o.directive(".quad", "call_stack");
+    o.label("call_next_node");
+    o.directive(".quad", "call_nodes+" + std::to_string(call_node_size));
+
+    // frames: node, method, cycles at entry, cycles of callees
+    o.directive(".bss");
+    o.directive(".balign", "8");
+    o.label("call_stack");
+    o.directive(".zero", std::to_string(call_stack_frames * call_frame_size));
+    o.label("call_stack_END");
+    // the calling context tree: method, parent, first child, next sibling,
+    // exclusive cycles; the root is the first
+    o.label("call_nodes");
+    o.directive(".zero", std::to_string(call_nodes_max * call_node_size));
+    o.label("call_nodes_END");
+  }
+
+  o.directive(".section", ".rodata");
+  auto table_generate = [&](const std::string &table,
+                            std::vector<std::pair<int, std::string>> &keys) {
+    o.directive(".balign", "8");
+    o.label(table);
+    for (auto &key : keys) {
+      o.directive(".quad", table + "_" + std::to_string(key.first) +
+                               ", counters+" + std::to_string(key.first * 8));
+    }
+    o.label(table + "_END");
+    for (auto &key : keys) {
+      o.label(table + "_" + std::to_string(key.first));
+      o.directive(".string", "\"" + util::escape_string(key.second) + "\"");
+    }
+  };
+  table_generate("profile_table", profile_keys);
+  table_generate("stats_table", stats_keys);
+  o.label("profile_file");
+  o.directive(".string",
+              "\"" + util::escape_string(options.profile_generate) + "\"");
+  o.label("profile_mode");
+  o.directive(".string", "\"w\"");
+  o.label("counter_format");
+  o.directive(".string", "\"%s %ld\\n\"");
+  if (options.alloc_stats) {
+    o.label("alloc_header");
+    o.directive(".string",
+                "\"class                     objects          bytes\\n\"");
+    o.label("alloc_format");
+    o.directive(".string", "\"%-16s %16ld %14ld\\n\"");
+    o.label("alloc_total");
+    o.directive(".string", "\"total\"");
+  }
+  if (options.instrument_calls) {
+    o.label("call_header");
+    o.directive(".string", "\"method                          calls   "
+                           "inclusive cycles   exclusive cycles\\n\"");
+    o.label("call_format");
+    o.directive(".string", "\"%-24s %12ld %18ld %18ld\\n\"");
+    o.label("call_stack_format");
+    o.directive(".string", "\" %ld\\n\"");
+    o.label("call_separator");
+    o.directive(".string", "\";\"");
+    o.label("call_stacks_file");
+    o.directive(".string",
+                "\"" + util::escape_string(options.call_stacks) + "\"");
+    o.directive(".balign", "8");
+    o.label("call_names");
+    for (int i = 0; i < instrumented.size(); ++i) {
+      o.directive(".quad", "call_name_" + std::to_string(i));
+    }
+    for (int i = 0; i < instrumented.size(); ++i) {
+      o.label("call_name_" + std::to_string(i));
+      o.directive(".string", "\"" + instrumented[i] + "\"");
+    }
+  }
+
+  if (options.instrument_calls) {
+    call_runtime_generate(o);
+  }
+
+  // print the counters of `table` to the FILE in %r12
+  auto print_generate = [&](const std::string &table, bool skip_zero) {
+    auto label_loop = next_label();
+    auto label_next = next_label();
+    auto label_done = next_label();
+    o.ins("movq", x86::imm(table), x86::RBX);
+    o.label(label_loop);
+    o.ins("cmpq", x86::imm(table + "_END"), x86::RBX);
+    o.ins("jae", x86::sym(label_done));
+    o.ins("movq", x86::mem(8, x86::RBX), x86::RCX);
+    o.ins("movq", x86::mem(0, x86::RCX), x86::RCX);
+    if (skip_zero) {
+      o.ins("cmpq", x86::imm(0), x86::RCX);
+      o.ins("je", x86::sym(label_next));
+    }
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("counter_format"), x86::RSI);
+    o.ins("movq", x86::mem(0, x86::RBX), x86::RDX);
+    o.ins("xorq", x86::RAX, x86::RAX); // no vector registers
+    o.ins("call", x86::sym("fprintf"));
+    o.label(label_next);
+    o.ins("addq", x86::imm(16), x86::RBX);
+    o.ins("jmp", x86::sym(label_loop));
+    o.label(label_done);
+  };
+
+  // at exit, the profile to its file and the statistics to stderr
+  o.directive(".section", ".text.unlikely,\"ax\"");
+  o.label("_counters_write");
+  o.ins("pushq", x86::RBP);
+  o.ins("movq", x86::RSP, x86::RBP);
+  o.ins("pushq", x86::RBX);
+  o.ins("pushq", x86::R12);
+  o.ins("pushq", x86::R13);
+  o.ins("pushq", x86::R14);
+  o.ins("andq", x86::imm(-16), x86::RSP); // make the stack 16-byte aligned
+
+  if (!options.profile_generate.empty()) {
+    auto label_open = next_label();
+    auto label_done = next_label();
+    o.ins("movq", x86::imm("profile_file"), x86::RDI);
+    o.ins("movq", x86::imm("profile_mode"), x86::RSI);
+    o.ins("call", x86::sym("fopen"));
+    o.ins("cmpq", x86::imm(0), x86::RAX);
+    o.ins("jne", x86::sym(label_open));
+    o.ins("movq", x86::imm("profile_file"), x86::RDI);
+    o.ins("call", x86::sym("perror"));
+    o.ins("jmp", x86::sym(label_done));
+    o.label(label_open);
+    o.ins("movq", x86::RAX, x86::R12);
+    print_generate("profile_table", true);
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("call", x86::sym("fclose"));
+    o.label(label_done);
+  }
+
+  o.ins("xorq", x86::RDI, x86::RDI); // after what the program wrote
+  o.ins("call", x86::sym("fflush"));
+  o.ins("movq", x86::sym("stderr"), x86::R12);
+  print_generate("stats_table", false);
+
+  if (options.alloc_stats) {
+    // the classes by bytes allocated, most first, then the totals in r13
+    // and r14; the objects of a class are cleared once it is printed
+    int64_t n = sa->classes.size() + 1;
+    auto label_sum = next_label();
+    auto label_find = next_label();
+    auto label_next = next_label();
+    auto label_found = next_label();
+    auto label_done = next_label();
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("alloc_header"), x86::RSI);
+    o.ins("xorq", x86::RAX, x86::RAX);
+    o.ins("call", x86::sym("fprintf"));
+    o.ins("xorq", x86::R13, x86::R13);
+    o.ins("xorq", x86::R14, x86::R14);
+    o.ins("movq", x86::imm(1), x86::RCX);
+    o.label(label_sum);
+    o.ins("addq", x86::mem("alloc_objects", 0, x86::NOREG, x86::RCX, 8),
+          x86::R13);
+    o.ins("addq", x86::mem("alloc_bytes", 0, x86::NOREG, x86::RCX, 8),
+          x86::R14);
+    o.ins("incq", x86::RCX);
+    o.ins("cmpq", x86::imm(n), x86::RCX);
+    o.ins("jb", x86::sym(label_sum));
+
+    o.label(label_find);
+    o.ins("xorq", x86::RBX, x86::RBX); // the class found, 0 if none
+    o.ins("movq", x86::imm(1), x86::RCX);
+    o.label(label_next);
+    o.ins("cmpq", x86::imm(n), x86::RCX);
+    o.ins("jae", x86::sym(label_found));
+    o.ins("cmpq", x86::imm(0),
+          x86::mem("alloc_objects", 0, x86::NOREG, x86::RCX, 8));
+    o.ins("je", x86::sym("1f"));
+    o.ins("testq", x86::RBX, x86::RBX);
+    o.ins("je", x86::sym("2f"));
+    o.ins("movq", x86::mem("alloc_bytes", 0, x86::NOREG, x86::RCX, 8),
+          x86::RAX);
+    o.ins("cmpq", x86::mem("alloc_bytes", 0, x86::NOREG, x86::RBX, 8),
+          x86::RAX);
+    o.ins("jbe", x86::sym("1f"));
+    o.label("2");
+    o.ins("movq", x86::RCX, x86::RBX);
+    o.label("1");
+    o.ins("incq", x86::RCX);
+    o.ins("jmp", x86::sym(label_next));
+    o.label(label_found);
+    o.ins("testq", x86::RBX, x86::RBX);
+    o.ins("je", x86::sym(label_done));
+    o.ins("movq", x86::mem("prototype_table", 0, x86::NOREG, x86::RBX, 8),
+          x86::RDX);
+    o.ins("movq", x86::mem(24, x86::RDX), x86::RDX); // name
+    o.ins("movq", x86::mem(40, x86::RDX), x86::RDX); // name data
+    o.ins("movq", x86::mem("alloc_objects", 0, x86::NOREG, x86::RBX, 8),
+          x86::RCX);
+    o.ins("movq", x86::mem("alloc_bytes", 0, x86::NOREG, x86::RBX, 8), x86::R8);
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("alloc_format"), x86::RSI);
+    o.ins("xorq", x86::RAX, x86::RAX);
+    o.ins("call", x86::sym("fprintf"));
+    o.ins("movq", x86::imm(0),
+          x86::mem("alloc_objects", 0, x86::NOREG, x86::RBX, 8));
+    o.ins("jmp", x86::sym(label_find));
+    o.label(label_done);
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("alloc_format"), x86::RSI);
+    o.ins("movq", x86::imm("alloc_total"), x86::RDX);
+    o.ins("movq", x86::R13, x86::RCX);
+    o.ins("movq", x86::R14, x86::R8);
+    o.ins("xorq", x86::RAX, x86::RAX);
+    o.ins("call", x86::sym("fprintf"));
+  }
 
-    o << "  .quad bool_constant_" + bool_constants[i] +
-             "_END - bool_constant_" + bool_constants[i] + "\n"; // size
-    o << "  .quad 0\n";                                          // GC
-    o << "  .quad " << sa->boolClass->id << "\n";                // id
-    o << "  .quad string_constant_"
-      << get_string_constant_no(sa->boolClass->name) << "\n";  // name
-    o << "  .quad " + sa->boolClass->name + "_method_table\n"; // method table
-    o << "  .quad " + std::to_string(i) + "\n";
+  if (options.instrument_calls) {
+    // the methods by exclusive cycles, most first; the calls of a method are
+    // cleared once it is printed
+    int64_t n = instrumented.size();
+    auto label_find = next_label();
+    auto label_next = next_label();
+    auto label_found = next_label();
+    auto label_done = next_label();
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("call_header"), x86::RSI);
+    o.ins("xorq", x86::RAX, x86::RAX);
+    o.ins("call", x86::sym("fprintf"));
+    o.label(label_find);
+    o.ins("movq", x86::imm(-1), x86::RBX); // the method found, -1 if none
+    o.ins("xorq", x86::RCX, x86::RCX);
+    o.label(label_next);
+    o.ins("cmpq", x86::imm(n), x86::RCX);
+    o.ins("jae", x86::sym(label_found));
+    o.ins("leaq", x86::mem(0, x86::RCX, x86::RCX, 2), x86::RDX);
+    o.ins("cmpq", x86::imm(0),
+          x86::mem("call_counts", 0, x86::NOREG, x86::RDX, 8));
+    o.ins("je", x86::sym("1f"));
+    o.ins("cmpq", x86::imm(-1), x86::RBX);
+    o.ins("je", x86::sym("2f"));
+    o.ins("movq", x86::mem("call_counts", 16, x86::NOREG, x86::RDX, 8),
+          x86::RAX);
+    o.ins("leaq", x86::mem(0, x86::RBX, x86::RBX, 2), x86::RDX);
+    o.ins("cmpq", x86::mem("call_counts", 16, x86::NOREG, x86::RDX, 8),
+          x86::RAX);
+    o.ins("jbe", x86::sym("1f"));
+    o.label("2");
+    o.ins("movq", x86::RCX, x86::RBX);
+    o.label("1");
+    o.ins("incq", x86::RCX);
+    o.ins("jmp", x86::sym(label_next));
+    o.label(label_found);
+    o.ins("cmpq", x86::imm(-1), x86::RBX);
+    o.ins("je", x86::sym(label_done));
+    o.ins("movq", x86::mem("call_names", 0, x86::NOREG, x86::RBX, 8), x86::RDX);
+    o.ins("leaq", x86::mem(0, x86::RBX, x86::RBX, 2), x86::RBX);
+    o.ins("movq", x86::mem("call_counts", 0, x86::NOREG, x86::RBX, 8), x86::RCX);
+    o.ins("movq", x86::mem("call_counts", 8, x86::NOREG, x86::RBX, 8), x86::R8);
+    o.ins("movq", x86::mem("call_counts", 16, x86::NOREG, x86::RBX, 8), x86::R9);
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("call_format"), x86::RSI);
+    o.ins("xorq", x86::RAX, x86::RAX);
+    o.ins("call", x86::sym("fprintf"));
+    o.ins("movq", x86::imm(0),
+          x86::mem("call_counts", 0, x86::NOREG, x86::RBX, 8));
+    o.ins("jmp", x86::sym(label_find));
+    o.label(label_done);
+  }
+
+  if (!options.call_stacks.empty()) {
+    // a line of the callers and the exclusive cycles of every node
+    auto label_open = next_label();
+    auto label_loop = next_label();
+    auto label_next = next_label();
+    auto label_done = next_label();
+    o.ins("movq", x86::imm("call_stacks_file"), x86::RDI);
+    o.ins("movq", x86::imm("profile_mode"), x86::RSI);
+    o.ins("call", x86::sym("fopen"));
+    o.ins("cmpq", x86::imm(0), x86::RAX);
+    o.ins("jne", x86::sym(label_open));
+    o.ins("movq", x86::imm("call_stacks_file"), x86::RDI);
+    o.ins("call", x86::sym("perror"));
+    o.ins("jmp", x86::sym(label_done));
+    o.label(label_open);
+    o.ins("movq", x86::RAX, x86::R12);
+    o.ins("movq", x86::imm("call_nodes", call_node_size), x86::RBX);
+    o.label(label_loop);
+    o.ins("cmpq", x86::sym("call_next_node"), x86::RBX);
+    o.ins("jae", x86::sym(label_next));
+    o.ins("cmpq", x86::imm(0), x86::mem(32, x86::RBX));
+    o.ins("je", x86::sym("1f"));
+    o.ins("movq", x86::RBX, x86::RDI);
+    o.ins("call", x86::sym("_call_path"));
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("movq", x86::imm("call_stack_format"), x86::RSI);
+    o.ins("movq", x86::mem(32, x86::RBX), x86::RDX);
+    o.ins("xorq", x86::RAX, x86::RAX);
+    o.ins("call", x86::sym("fprintf"));
+    o.label("1");
+    o.ins("addq", x86::imm(call_node_size), x86::RBX);
+    o.ins("jmp", x86::sym(label_loop));
+    o.label(label_next);
+    o.ins("movq", x86::R12, x86::RDI);
+    o.ins("call", x86::sym("fclose"));
+    o.label(label_done);
+  }
+
+  o.ins("movq", x86::mem(-8, x86::RBP), x86::RBX);
+  o.ins("movq", x86::mem(-16, x86::RBP), x86::R12);
+  o.ins("movq", x86::mem(-24, x86::RBP), x86::R13);
+  o.ins("movq", x86::mem(-32, x86::RBP), x86::R14);
+  o.ins("movq", x86::RBP, x86::RSP);
+  o.ins("popq", x86::RBP);
+  o.ins("ret");
+}
 
-    o << "bool_constant_" + bool_constants[i] + "_END:\n\n";
+void CodeGenerator::generate(
+    const std::function<void(std::list<x86::Line> &)> &sink) {
+  Timer timer("generate");
+  x86::Emitter o;
+  o.sink = sink;
+  generate_program(o);
+  if (options.usdt) {
+    generate_probes(o);
   }
+  o.flush();
 }
 
 void CodeGenerator::generate(std::ostream &o) {
+  generate([&](std::list<x86::Line> &lines) {
+    Timer timer("print");
+    x86::print(o, lines);
+  });
+}
+
+void CodeGenerator::strip(std::list<x86::Line> &lines) {
+  std::set<std::string> dead;
+  for (auto &cls : sa->builtin) {
+    for (auto &method : cls->name2Method) {
+      if (!reach.is_live(cls.get(), method.first)) {
+        dead.insert(cls->name + "." + method.first);
+      }
+    }
+  }
+
+  std::set<std::string> stripped; // labels
+  for (auto it = lines.begin(); it != lines.end();) {
+    if (it->kind != x86::Line::LABEL || !dead.count(it->name)) {
+      ++it;
+      continue;
+    }
+    // up to the next global label; directives may switch sections
+    do {
+      if (it->kind == x86::Line::DIRECTIVE) {
+        ++it;
+      } else {
+        if (it->kind == x86::Line::LABEL) {
+          stripped.insert(it->name);
+        }
+        it = lines.erase(it);
+      }
+    } while (it != lines.end() && (it->kind != x86::Line::LABEL ||
+                                   x86::is_local_label(it->name)));
+  }
+
+  probes.erase(std::remove_if(probes.begin(), probes.end(),
+                              [&](const Probe &probe) {
+                                return stripped.count(probe.label);
+                              }),
+               probes.end());
+}
+
+void CodeGenerator::peephole(std::list<x86::Line> &lines,
+                             const std::string &label) {
+  Timer timer("peephole");
+  auto it = lines.begin();
+  while (it->kind != x86::Line::LABEL || it->name != label) {
+    ++it;
+  }
+  int n = 0;
+  for (auto &line : lines) {
+    n += line.kind == x86::Line::INSTRUCTION;
+  }
+
+  auto eliminated = x86::peephole(lines, it, lines.end());
+  if (options.report_peephole) {
+    std::cerr << label << ": " << eliminated << " of " << n
+              << " instructions eliminated" << std::endl;
+  }
+}
+
+void CodeGenerator::generate_program(x86::Emitter &o) {
   get_string_constant_no("");
   get_int_constant_no(0);
 
-  arrange_classes();
+  {
+    Timer timer("arrange classes");
+    arrange_classes();
+  }
 
-  generate_prototypes(o);
+  {
+    Timer timer("prototypes");
+    generate_prototypes(o);
+    o.flush();
+  }
 
-  generate_methods(o);
+  {
+    Timer timer("methods");
+    generate_methods(o);
+  }
 
-  generate_builtin_methods(o);
+  {
+    Timer timer("builtin methods");
+    generate_builtin_methods(o);
+    {
+      Timer timer("strip");
+      strip(o.lines);
+    }
+    o.flush();
+  }
+
+  if (counting()) {
+    Timer timer("counters");
+    generate_counters(o);
+    o.flush();
+  }
 
+  Timer timer("constants");
   generate_constants(o);
+  o.flush();
 }
 
 } // namespace cool
@@ -1,59 +1,211 @@
 #ifndef _CG_HH
 #define _CG_HH
 
+#include <functional>
 #include <iostream>
 #include <map>
 
 #include "ast.hh"
+#include "profile.hh"
+#include "reach.hh"
 #include "sa.hh"
+#include "x86.hh"
 
 namespace cool {
 
 const std::string init_method_name = "__init__";
 
+class Options {
+public:
+  Options()
+      : opt_level(-1), dump_ir(false), peephole(false), report_peephole(false),
+        type_test_stats(false), alloc_stats(false), instrument_calls(false),
+        usdt(false), usdt_methods(false), debug_info(true),
+        profile(nullptr) {}
+
+  int opt_level; // methods go through the IR if >= 0
+  bool dump_ir;
+  bool peephole; // on at -O1 and -O2
+  bool report_peephole; // how many instructions of each method it removed
+  bool type_test_stats; // print the hits and misses of type tests at exit
+  bool alloc_stats; // print the objects and bytes allocated by class at exit
+  bool instrument_calls; // print the calls and cycles of methods at exit
+  std::string call_stacks; // the file instrumented call stacks are written to
+  bool usdt;         // SystemTap probes in the runtime
+  bool usdt_methods; // and at the entries of methods
+  bool debug_info;   // .file, .loc and .cfi_*
+
+  // with the AST emitter only
+  std::string profile_generate; // the file the program writes its profile to
+  const Profile *profile;       // the profile to optimize for
+};
+
 class CodeGenerator {
 public:
-  CodeGenerator(ast::Program *program, cool::SemanticAnalyser *sa)
-      : program(program), sa(sa), label_no(1) {}
+  CodeGenerator(ast::Program *program, cool::SemanticAnalyser *sa,
+                const Options &options = Options())
+      : loc(nullptr), program(program), sa(sa), options(options), label_no(1),
+        reach(sa), counters(0) {}
 
   std::string next_label();
 
+  // the program as assembly lines, handed to `sink` a method or so at a
+  // time, or as text
+  void generate(const std::function<void(std::list<x86::Line> &)> &sink);
   void generate(std::ostream &o);
 
   int get_string_constant_no(std::string s);
-  int get_int_constant_no(int i);
+  // $string_constant_N and $string_data_N: the String constant `s`, and its
+  // characters
+  x86::Operand string_constant(const std::string &s);
+  x86::Operand string_data(const std::string &s);
+  int get_int_constant_no(int64_t i);
+
+  void load_constant(x86::Emitter &o, int64_t k, x86::Register reg);
+  // %rax <- %rax * k and %rax <- %rax / k, using %rcx and %rdx
+  void mul_constant_generate(x86::Emitter &o, int64_t k);
+  void div_constant_generate(x86::Emitter &o, int64_t k);
+
+  // %rax <- an Int with the value in %rax, built in the 48 bytes at
+  // `offset`(%rbp) instead of the heap
+  void stack_int_generate(x86::Emitter &o, int offset);
+  // whether the built-in method `cls.name` keeps no reference to the
+  // objects it is given, which can then live in the frame of the caller
+  bool keeps_no_reference(ast::Class *cls, const std::string &name);
+
+  // get, set or length of Array or IntArray `cls` in place, on the array in
+  // %rbx and the arguments from `args`(%rsp); its index checked
+  void array_access_generate(x86::Emitter &o, ast::Class *cls,
+                             const std::string &name, int args);
+  // call method `name` of `cls`, or inline it if it is hot and trivial
+  void call_generate(x86::Emitter &o, ast::Class *cls,
+                     const std::string &name);
+  // call method `name` of the object in %rbx, whose static type is `type`,
+  // at `site`: the class id of the receiver is compared with the classes
+  // type_tests gives, whose methods are called directly, and the others
+  // are called through the method table
+  void dispatch_generate(x86::Emitter &o, ast::Class *type,
+                         const std::string &name, const std::string &site);
+
+  // --profile-generate: count `key`
+  void count_generate(x86::Emitter &o, const std::string &key);
+  // --instrument-calls: enter and leave the method being generated
+  void call_enter_generate(x86::Emitter &o);
+  void call_exit_generate(x86::Emitter &o);
+  // --usdt: a probe `provider:name` here, a nop, with arguments `args` in
+  // the notation of SystemTap, e.g. "8@%rax 8@16(%rax)"
+  void probe_generate(x86::Emitter &o, const std::string &provider,
+                      const std::string &name, const std::string &args = "");
+  // --usdt=methods: a probe cool_method:Class__method at the entry of
+  // `method` (Class.method), given self
+  void entry_probe_generate(x86::Emitter &o, const std::string &method);
+  // --profile-use: the count of `key`, 0 without a profile
+  int64_t profile_count(const std::string &key);
+
+  // pushq %rbp; movq %rsp, %rbp, and the call frame information for it
+  void prologue_generate(x86::Emitter &o);
+  // popq %rbp, then a ret, or a jmp to `target` if there is one; the call
+  // frame information of the code after it stays that of the body
+  void epilogue_generate(x86::Emitter &o, const std::string &target = "");
+  // the code generated next comes from `loc` in the source
+  void loc_generate(x86::Emitter &o, const yy::location &loc);
+  const yy::location *loc; // of the innermost node being generated
 
   ast::Class *selfClass;
-  Scope<std::string> scope;
+  ast::Method *selfMethod;
+  std::string selfMethodEntry; // label after the prologue of selfMethod
+  Scope<x86::Operand> scope;
   int offset_rbp;
 
   ast::Program *program;
   cool::SemanticAnalyser *sa;
+  Options options;
 
 private:
   int label_no;
+  ReachabilityAnalyser reach;
 
   void arrange_classes();
 
-  void generate_prototypes(std::ostream &o);
-
-  void generate_methods(std::ostream &o);
-
-  void generate_object_methods(std::ostream &o);
-  void generate_string_methods(std::ostream &o);
-  void generate_int_methods(std::ostream &o);
-  void generate_bool_methods(std::ostream &o);
-  void generate_io_methods(std::ostream &o);
-  void generate_system_methods(std::ostream &o);
-  void generate_builtin_methods(std::ostream &o);
-
-  void generate_constants(std::ostream &o);
+  void generate_program(x86::Emitter &o);
+  // optimize the method at `label`, the last one in `lines`
+  void peephole(std::list<x86::Line> &lines, const std::string &label);
+  // remove the built-in methods that are not reachable, with their probes
+  void strip(std::list<x86::Line> &lines);
+
+  void generate_prototypes(x86::Emitter &o);
+
+  void generate_methods(x86::Emitter &o);
+
+  void generate_object_methods(x86::Emitter &o);
+  void generate_string_methods(x86::Emitter &o);
+  void generate_int_methods(x86::Emitter &o);
+  void generate_bool_methods(x86::Emitter &o);
+  void generate_io_methods(x86::Emitter &o);
+  void generate_clock_methods(x86::Emitter &o);
+  void generate_array_methods(x86::Emitter &o);
+  void generate_system_methods(x86::Emitter &o);
+  void generate_builtin_methods(x86::Emitter &o);
+
+  void generate_constants(x86::Emitter &o);
+  // the classes whose method `name` is called directly at `site`, fixed at
+  // compile time: all the receivers that can reach it, none if there are
+  // too many, or with a profile those seen most
+  std::vector<ast::Class *> type_tests(ast::Class *type,
+                                       const std::string &name,
+                                       const std::string &site);
+
+  // the address of a new counter, written to the profile as `key` unless
+  // it is empty
+  x86::Operand new_counter(const std::string &key);
+  // the address of a new counter, printed as `key` with --type-test-stats
+  x86::Operand new_stats_counter(const std::string &key);
+  // whether the program has counters to write out at exit
+  bool counting() const;
+  // with --alloc-stats: count `bytes` allocated for the characters of strings
+  void string_data_count_generate(x86::Emitter &o, x86::Register bytes);
+  // the counters and the code writing them out at exit
+  void generate_counters(x86::Emitter &o);
+  // the statistics every program keeps, and the code printing them at exit
+  // if COOL_STATS is set
+  void generate_stats(x86::Emitter &o);
+  // --instrument-calls: the routines entering and leaving methods
+  void call_runtime_generate(x86::Emitter &o);
+  // the notes describing the probes not stripped
+  void generate_probes(x86::Emitter &o);
+  // the methods, hottest first with a profile
+  std::vector<ReachabilityAnalyser::MethodRef> method_order();
 
   std::map<std::string, int> string_constants_numbered;
   std::list<std::string> string_constants;
 
-  std::map<int, int> int_constants_numbered;
-  std::list<int> int_constants;
+  std::map<int64_t, int> int_constants_numbered;
+  std::list<int64_t> int_constants;
+
+  int counters;
+  std::vector<std::pair<int, std::string>> profile_keys, stats_keys;
+  // --instrument-calls: the methods, numbered as generated
+  std::vector<std::string> instrumented;
+  class Probe {
+  public:
+    std::string label, provider, name, args;
+  };
+  std::vector<Probe> probes;
+  // the source files, numbered for .file and .loc
+  std::map<std::string, int> file_numbers;
+};
+
+// emits the location of `node` for the code generated during its lifetime,
+// and that of the enclosing node after it
+class LocationScope {
+public:
+  LocationScope(CodeGenerator *cg, x86::Emitter &o, ast::Node *node);
+  ~LocationScope();
+
+private:
+  CodeGenerator *cg;
+  x86::Emitter &o;
+  const yy::location *saved;
 };
 
 } // namespace cool
@@ -0,0 +1,735 @@
+#include "csrc.hh"
+
+#include <sstream>
+
+#include "cg.hh"
+
+namespace csrc {
+
+namespace {
+
+const char *runtime_prelude = R"(#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct Object Object;
+
+struct Object {
+  int64_t size;
+  int64_t gc;
+  int64_t id;
+  Object *name;
+  const void *vtable;
+};
+
+#define INT(o) (((const struct C_Int *)(o))->value)
+#define BOOL(o) (((const struct C_Bool *)(o))->value)
+#define STR(o) (((const struct C_String *)(o))->data)
+#define ARRAY(o) ((struct C_Array *)(o))
+#define INT_ARRAY(o) ((struct C_IntArray *)(o))
+
+__attribute__((noreturn, cold)) static void cool_fatal(const char *msg) {
+  fputs(msg, stderr);
+  exit(-1);
+}
+
+__attribute__((noreturn, cold)) static void cool_invoke_on_void(void) {
+  cool_fatal("fatal error: invoke on void\n");
+}
+
+__attribute__((noreturn, cold)) static void cool_case_on_void(void) {
+  cool_fatal("fatal error: case on void\n");
+}
+
+__attribute__((noreturn, cold)) static void cool_case_no_match(void) {
+  cool_fatal("fatal error: case no match\n");
+}
+
+__attribute__((noreturn, cold)) static void cool_array_bounds(void) {
+  cool_fatal("fatal error: array index out of bounds\n");
+}
+
+__attribute__((noreturn, cold)) static void cool_array_size(void) {
+  cool_fatal("fatal error: array size out of range\n");
+}
+
+__attribute__((noreturn, cold)) static void cool_error(void) {
+  perror(NULL);
+  exit(-1);
+}
+
+// traps on division by 0 and INT64_MIN / -1, like idivq, even if the
+// quotient is unused
+static inline int64_t cool_div(int64_t x, int64_t y) {
+  if (__builtin_expect(y == 0 || (x == INT64_MIN && y == -1), 0)) {
+    raise(SIGFPE);
+  }
+  return x / y;
+}
+
+)";
+
+// the built-in methods, as in CodeGenerator::generate_builtin_methods
+const char *runtime_builtins = R"(
+static Object *cool_copy(const Object *o) {
+  Object *res = malloc(o->size);
+  if (!res) {
+    cool_error();
+  }
+  memcpy(res, o, o->size);
+  return res;
+}
+
+static Object *cool_string(char *data) {
+  Object *res = cool_copy(&P_String.h);
+  ((struct C_String *)res)->data = data;
+  return res;
+}
+
+static Object *cool_int(int64_t value) {
+  Object *res = cool_copy(&P_Int.h);
+  ((struct C_Int *)res)->value = value;
+  return res;
+}
+
+static inline Object *cool_bool(int64_t value) {
+  return (Object *)(value ? &B_1 : &B_0);
+}
+
+static Object *M_Object____init__(Object *self) { return self; }
+
+static Object *M_Object__copy(Object *self) { return cool_copy(self); }
+
+static Object *M_Object__abort(Object *self) { exit(-1); }
+
+static Object *M_Object__type_name(Object *self) { return self->name; }
+
+static Object *M_String____init__(Object *self) { return self; }
+
+static Object *M_String__length(Object *self) {
+  return cool_int(strlen(STR(self)));
+}
+
+static Object *M_String__concat(Object *self, Object *a_other) {
+  char *data = malloc(strlen(STR(self)) + strlen(STR(a_other)) + 1);
+  if (!data) {
+    cool_error();
+  }
+  strcpy(data, STR(self));
+  strcat(data, STR(a_other));
+  return cool_string(data);
+}
+
+static Object *M_String__substr(Object *self, Object *a_begin, Object *a_end) {
+  uint64_t len = strlen(STR(self));
+  uint64_t i1 = INT(a_begin), i2 = INT(a_end);
+  if (i1 >= len) {
+    return (Object *)&S_0;
+  }
+  if (i2 > len) {
+    i2 = len;
+  }
+  if (i2 <= i1) {
+    return (Object *)&S_0;
+  }
+  char *data = calloc(i2 - i1 + 1, 1);
+  if (!data) {
+    cool_error();
+  }
+  memcpy(data, STR(self) + i1, i2 - i1);
+  return cool_string(data);
+}
+
+static Object *M_String__to_int(Object *self) {
+  return cool_int(atol(STR(self)));
+}
+
+static Object *M_Int____init__(Object *self) { return self; }
+
+static Object *M_Int__to_string(Object *self) {
+  char *data = malloc(32);
+  if (!data) {
+    cool_error();
+  }
+  sprintf(data, "%ld", (long)INT(self));
+  return cool_string(data);
+}
+
+static Object *M_Bool____init__(Object *self) { return self; }
+
+static Object *M_IO____init__(Object *self) { return self; }
+
+static Object *M_IO__in_string(Object *self) {
+  char *line = NULL;
+  size_t n = 0;
+  getline(&line, &n, stdin);
+  return cool_string(line);
+}
+
+static Object *M_IO__out_string(Object *self, Object *a_x) {
+  printf("%s", STR(a_x));
+  return self;
+}
+
+static Object *M_Clock____init__(Object *self) { return self; }
+
+static int64_t cool_clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static Object *M_Clock__now_ns(Object *self) {
+  return cool_int(cool_clock_ns(CLOCK_MONOTONIC));
+}
+
+static Object *M_Clock__cycles(Object *self) {
+  return cool_int(__builtin_ia32_rdtsc());
+}
+
+static Object *M_Clock__cpu_time_ns(Object *self) {
+  return cool_int(cool_clock_ns(CLOCK_PROCESS_CPUTIME_ID));
+}
+
+// an array of the class of `self` with `n` elements, all 0
+static Object *cool_array(const Object *self, int64_t n) {
+  if ((uint64_t)n >> 31) {
+    cool_array_size();
+  }
+  size_t size = sizeof(struct C_Array) + n * sizeof(Object *);
+  Object *res = calloc(1, size);
+  if (!res) {
+    cool_error();
+  }
+  *res = *self;
+  res->size = size;
+  res->gc = 0;
+  ARRAY(res)->length = n;
+  return res;
+}
+
+static uint64_t cool_index(const Object *self, const Object *i) {
+  if ((uint64_t)INT(i) >= (uint64_t)ARRAY(self)->length) {
+    cool_array_bounds();
+  }
+  return INT(i);
+}
+
+static Object *M_Array____init__(Object *self) { return self; }
+
+static Object *M_Array__new_array(Object *self, Object *a_n) {
+  return cool_array(self, INT(a_n));
+}
+
+static Object *M_Array__get(Object *self, Object *a_i) {
+  return ARRAY(self)->data[cool_index(self, a_i)];
+}
+
+static Object *M_Array__set(Object *self, Object *a_i, Object *a_x) {
+  ARRAY(self)->data[cool_index(self, a_i)] = a_x;
+  return self;
+}
+
+static Object *M_Array__length(Object *self) {
+  return cool_int(ARRAY(self)->length);
+}
+
+static Object *M_IntArray____init__(Object *self) { return self; }
+
+static Object *M_IntArray__new_array(Object *self, Object *a_n) {
+  return cool_array(self, INT(a_n));
+}
+
+static Object *M_IntArray__get(Object *self, Object *a_i) {
+  return cool_int(INT_ARRAY(self)->data[cool_index(self, a_i)]);
+}
+
+static Object *M_IntArray__set(Object *self, Object *a_i, Object *a_x) {
+  INT_ARRAY(self)->data[cool_index(self, a_i)] = INT(a_x);
+  return self;
+}
+
+static Object *M_IntArray__length(Object *self) {
+  return cool_int(INT_ARRAY(self)->length);
+}
+
+)";
+
+std::string escape(const std::string &s) {
+  std::string res;
+  for (unsigned char ch : s) {
+    if (ch == '\\' || ch == '"') {
+      res += '\\';
+      res += ch;
+    } else if (ch >= 0x20 && ch < 0x7f && ch != '?') {
+      res += ch;
+    } else {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\%03o", ch);
+      res += buf;
+    }
+  }
+  return res;
+}
+
+std::string signature(const std::string &function, ast::Method *method) {
+  std::string res = "Object *" + function + "(Object *self";
+  for (auto &formal : method->formals) {
+    res += ", Object *a_" + formal->name;
+  }
+  return res + ")";
+}
+
+} // namespace
+
+std::string Translator::new_temp(std::ostream &o, const std::string &value) {
+  auto name = "t" + std::to_string(temp_no++);
+  o << indent << "Object *" << name;
+  if (!value.empty()) {
+    o << " = " << value;
+  }
+  o << ";\n";
+  return name;
+}
+
+std::string Translator::new_local(const std::string &name) {
+  return "l" + std::to_string(temp_no++) + "_" + name;
+}
+
+std::string Translator::string_constant(const std::string &s) {
+  if (string_constants_numbered.find(s) == string_constants_numbered.end()) {
+    string_constants_numbered[s] = string_constants.size();
+    string_constants.push_back(s);
+  }
+  return "(Object *)&S_" + std::to_string(string_constants_numbered[s]);
+}
+
+std::string Translator::int_constant(int64_t i) {
+  if (int_constants_numbered.find(i) == int_constants_numbered.end()) {
+    int_constants_numbered[i] = int_constants.size();
+    int_constants.push_back(i);
+  }
+  return "(Object *)&I_" + std::to_string(int_constants_numbered[i]);
+}
+
+std::string Translator::bool_constant(bool b) {
+  return b ? "(Object *)&B_1" : "(Object *)&B_0";
+}
+
+std::string Translator::default_value(ast::Class *cls) {
+  if (cls == sa->stringClass.get()) {
+    return string_constant("");
+  }
+  if (cls == sa->intClass.get()) {
+    return int_constant(0);
+  }
+  if (cls == sa->boolClass.get()) {
+    return bool_constant(false);
+  }
+  return "NULL";
+}
+
+std::string Translator::method_function(ast::Class *cls,
+                                        const std::string &name) {
+  return "M_" + cls->methods_resolved[name]->name + "__" + name;
+}
+
+bool Translator::is_final(ast::Class *cls, const std::string &name) {
+  for (auto child : cls->children) {
+    if (child->methods_resolved[name] != cls->methods_resolved[name] ||
+        !is_final(child, name)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Translator::arrange_classes() {
+  for (int i = 0; i < sa->classes.size(); ++i) {
+    auto cls = sa->classes[i];
+    cls->id = i + 1;
+
+    string_constant(cls->name);
+  }
+
+  sa->objectClass->arrange();
+}
+
+void Translator::translate_structs(std::ostream &o) {
+  for (auto &cls : sa->classes) {
+    o << "struct C_" + cls->name + " {\n";
+    o << "  Object h;\n";
+    for (auto &name : cls->fields_ordered) {
+      o << "  Object *f_" + name + ";\n";
+    }
+    if (cls == sa->stringClass) {
+      o << "  char *data;\n";
+    } else if (cls == sa->intClass || cls == sa->boolClass) {
+      o << "  int64_t value;\n";
+    } else if (cls == sa->arrayClass) {
+      o << "  int64_t length;\n";
+      o << "  Object *data[];\n";
+    } else if (cls == sa->intArrayClass) {
+      o << "  int64_t length;\n";
+      o << "  int64_t data[];\n";
+    }
+    o << "};\n\n";
+
+    o << "struct V_" + cls->name + " {\n";
+    for (auto &name : cls->methods_ordered) {
+      auto method = cls->methods_resolved[name]->name2Method[name];
+      o << "  Object *(*m_" + name + ")(Object *";
+      for (int i = 0; i < method->formals.size(); ++i) {
+        o << ", Object *";
+      }
+      o << ");\n";
+    }
+    o << "};\n\n";
+  }
+}
+
+// everything may refer to everything else
+void Translator::translate_declarations(std::ostream &o) {
+  for (auto &cls : sa->classes) {
+    for (auto it = cls->name2Method.begin(); it != cls->name2Method.end();
+         ++it) {
+      o << "static " << signature(method_function(cls.get(), it->first),
+                                  it->second)
+        << ";\n";
+    }
+  }
+  o << "\n";
+
+  for (auto &cls : sa->classes) {
+    o << "static const struct V_" + cls->name + " V_" + cls->name + ";\n";
+    o << "static const struct C_" + cls->name + " P_" + cls->name + ";\n";
+  }
+  for (auto &s : string_constants) {
+    o << "static const struct C_String S_"
+      << string_constants_numbered[s] << ";\n";
+  }
+  for (auto &i : int_constants) {
+    o << "static const struct C_Int I_" << int_constants_numbered[i] << ";\n";
+  }
+  o << "static const struct C_Bool B_0, B_1;\n";
+}
+
+void Translator::translate_constants(std::ostream &o) {
+  auto header = [this](ast::Class *cls) {
+    return "{sizeof(struct C_" + cls->name + "), 0, " +
+           std::to_string(cls->id) + ", " + string_constant(cls->name) +
+           ", &V_" + cls->name + "}";
+  };
+
+  for (auto &s : string_constants) {
+    o << "static const struct C_String S_" << string_constants_numbered[s]
+      << " = {" << header(sa->stringClass.get()) << ", \"" << escape(s)
+      << "\"};\n";
+  }
+  for (auto &i : int_constants) {
+    o << "static const struct C_Int I_" << int_constants_numbered[i] << " = {"
+      << header(sa->intClass.get()) << ", ";
+    if (i == INT64_MIN) {
+      o << "-" << INT64_MAX << "L - 1};\n"; // no such literal in C
+    } else {
+      o << i << "L};\n";
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    o << "static const struct C_Bool B_" << i << " = {"
+      << header(sa->boolClass.get()) << ", " << i << "};\n";
+  }
+  o << "\n";
+}
+
+void Translator::translate_prototypes(std::ostream &o) {
+  for (auto &cls : sa->classes) {
+    o << "static const struct V_" + cls->name + " V_" + cls->name + " = {\n";
+    for (auto &name : cls->methods_ordered) {
+      o << "  " + method_function(cls.get(), name) + ",\n";
+    }
+    o << "};\n\n";
+
+    o << "static const struct C_" + cls->name + " P_" + cls->name + " = {\n";
+    o << "  {sizeof(struct C_" + cls->name + "), 0, " << cls->id << ", "
+      << string_constant(cls->name) << ", &V_" + cls->name + "},\n";
+    for (auto &name : cls->fields_ordered) {
+      o << "  " + default_value(cls->get_field(name)->type) + ",\n";
+    }
+    if (cls == sa->stringClass) {
+      o << "  \"\",\n";
+    } else if (cls == sa->intClass || cls == sa->boolClass ||
+               cls == sa->arrayClass || cls == sa->intArrayClass) {
+      o << "  0,\n";
+    }
+    o << "};\n\n";
+  }
+}
+
+void Translator::translate_methods(std::ostream &o) {
+  for (auto &cls : program->classes) {
+    scope.enter();
+    for (auto &name : cls->fields_ordered) {
+      scope.add(name, "((struct C_" + cls->name + " *)self)->f_" + name);
+    }
+
+    for (auto it = cls->name2Method.begin(); it != cls->name2Method.end();
+         ++it) {
+      auto method = it->second;
+      o << "static " << signature(method_function(cls.get(), it->first), method)
+        << " {\n";
+
+      scope.enter();
+      for (auto &formal : method->formals) {
+        scope.add(formal->name, "a_" + formal->name);
+      }
+      auto res = method->expr->translate(this, o);
+      o << "  return " << res << ";\n";
+      scope.exit();
+
+      o << "}\n\n";
+    }
+
+    scope.exit();
+  }
+
+  o << "int main(void) {\n";
+  o << "  Object *self = "
+    << method_function(sa->mainClass.get(), cool::init_method_name)
+    << "(cool_copy(&P_" + sa->mainClass->name + ".h));\n";
+  o << "  return INT(" << method_function(sa->mainClass.get(), "main")
+    << "(self));\n";
+  o << "}\n";
+}
+
+void Translator::translate(std::ostream &o) {
+  string_constant("");
+  int_constant(0);
+
+  arrange_classes();
+
+  // methods first, they add constants
+  std::stringstream methods;
+  translate_methods(methods);
+
+  o << runtime_prelude;
+  translate_structs(o);
+  translate_declarations(o);
+  o << runtime_builtins;
+  translate_constants(o);
+  translate_prototypes(o);
+  o << methods.str();
+}
+
+} /* namespace csrc */
+
+namespace ast {
+
+std::string Assign::translate(csrc::Translator *t, std::ostream &o) {
+  auto res = expr->translate(t, o);
+  o << t->indent << t->scope.find(name) << " = " << res << ";\n";
+  return res;
+}
+
+std::string Invoke::translate(csrc::Translator *t, std::ostream &o) {
+  // arguments right to left, then the receiver
+  std::list<std::string> args;
+  for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) {
+    args.push_front(it->get()->translate(t, o));
+  }
+  auto receiver = expr_sa->translate(t, o);
+  if (!receiver_non_void) {
+    o << t->indent << "if (!" << receiver << ") {\n";
+    o << t->indent << "  cool_invoke_on_void();\n";
+    o << t->indent << "}\n";
+  }
+
+  std::string call;
+  if (!type_name.empty() || t->is_final(type_sa, name)) {
+    call = t->method_function(type_sa, name);
+  } else {
+    call = "((const struct V_" + type_sa->name + " *)" + receiver +
+           "->vtable)->m_" + name;
+  }
+  call += "(" + receiver;
+  for (auto &arg : args) {
+    call += ", " + arg;
+  }
+  call += ")";
+  return t->new_temp(o, call);
+}
+
+std::string If::translate(csrc::Translator *t, std::ostream &o) {
+  auto cond = a->translate(t, o);
+  auto res = t->new_temp(o);
+  auto indent = t->indent;
+
+  o << indent << "if (BOOL(" << cond << ")) {\n";
+  t->indent += "  ";
+  auto res_b = b->translate(t, o);
+  o << t->indent << res << " = " << res_b << ";\n";
+  t->indent = indent;
+  o << indent << "} else {\n";
+  t->indent += "  ";
+  auto res_c = c->translate(t, o);
+  o << t->indent << res << " = " << res_c << ";\n";
+  t->indent = indent;
+  o << indent << "}\n";
+  return res;
+}
+
+std::string While::translate(csrc::Translator *t, std::ostream &o) {
+  auto indent = t->indent;
+
+  o << indent << "for (;;) {\n";
+  t->indent += "  ";
+  auto cond = a->translate(t, o);
+  o << t->indent << "if (!BOOL(" << cond << ")) {\n";
+  o << t->indent << "  break;\n";
+  o << t->indent << "}\n";
+  b->translate(t, o);
+  t->indent = indent;
+  o << indent << "}\n";
+  return "NULL";
+}
+
+std::string Block::translate(csrc::Translator *t, std::ostream &o) {
+  std::string res;
+  for (auto &e : expressions) {
+    res = e->translate(t, o);
+  }
+  return res;
+}
+
+std::string Let::translate(csrc::Translator *t, std::ostream &o) {
+  std::string init;
+  if (std::dynamic_pointer_cast<Void>(expr)) {
+    init = t->default_value(t->sa->name2Class[type_name].get());
+  } else {
+    init = expr->translate(t, o);
+  }
+  auto local = t->new_local(name);
+  o << t->indent << "Object *" << local << " = " << init << ";\n";
+
+  t->scope.enter();
+  t->scope.add(name, local);
+  auto res = body->translate(t, o);
+  t->scope.exit();
+  return res;
+}
+
+std::string Case::translate(csrc::Translator *t, std::ostream &o) {
+  auto value = expr->translate(t, o);
+  auto res = t->new_temp(o);
+  auto indent = t->indent;
+
+  if (!expr_non_void) {
+    o << indent << "if (!" << value << ") {\n";
+    o << indent << "  cool_case_on_void();\n";
+    o << indent << "}\n";
+  }
+
+  o << indent;
+  for (auto &branch : branches) {
+    o << "if (" << value << "->id == " << branch->type->id << ") {\n";
+    t->indent += "  ";
+    auto local = t->new_local(branch->name);
+    o << t->indent << "Object *" << local << " = " << value << ";\n";
+    t->scope.enter();
+    t->scope.add(branch->name, local);
+    auto res_branch = branch->expr->translate(t, o);
+    o << t->indent << res << " = " << res_branch << ";\n";
+    t->scope.exit();
+    t->indent = indent;
+    o << indent << "} else ";
+  }
+  o << "{\n";
+  o << indent << "  cool_case_no_match();\n";
+  o << indent << "}\n";
+  return res;
+}
+
+std::string New::translate(csrc::Translator *t, std::ostream &o) {
+  return t->new_temp(o, t->method_function(type_sa, cool::init_method_name) +
+                            "(cool_copy(&P_" + type_sa->name + ".h))");
+}
+
+std::string IsVoid::translate(csrc::Translator *t, std::ostream &o) {
+  return t->new_temp(o, "cool_bool(!" + expr->translate(t, o) + ")");
+}
+
+// operands of arithmetic operators are evaluated right to left
+std::string Add::translate(csrc::Translator *t, std::ostream &o) {
+  auto y = b->translate(t, o);
+  auto x = a->translate(t, o);
+  return t->new_temp(o, "cool_int(INT(" + x + ") + INT(" + y + "))");
+}
+
+std::string Sub::translate(csrc::Translator *t, std::ostream &o) {
+  auto y = b->translate(t, o);
+  auto x = a->translate(t, o);
+  return t->new_temp(o, "cool_int(INT(" + x + ") - INT(" + y + "))");
+}
+
+std::string Mul::translate(csrc::Translator *t, std::ostream &o) {
+  auto y = b->translate(t, o);
+  auto x = a->translate(t, o);
+  return t->new_temp(o, "cool_int(INT(" + x + ") * INT(" + y + "))");
+}
+
+std::string Div::translate(csrc::Translator *t, std::ostream &o) {
+  auto y = b->translate(t, o);
+  auto x = a->translate(t, o);
+  return t->new_temp(o, "cool_int(cool_div(INT(" + x + "), INT(" + y + ")))");
+}
+
+std::string Neg::translate(csrc::Translator *t, std::ostream &o) {
+  return t->new_temp(o, "cool_int(-INT(" + expr->translate(t, o) + "))");
+}
+
+std::string LessThan::translate(csrc::Translator *t, std::ostream &o) {
+  auto x = a->translate(t, o);
+  auto y = b->translate(t, o);
+  return t->new_temp(o, "cool_bool(INT(" + x + ") < INT(" + y + "))");
+}
+
+std::string Equal::translate(csrc::Translator *t, std::ostream &o) {
+  auto x = a->translate(t, o);
+  auto y = b->translate(t, o);
+  return t->new_temp(o, "cool_bool(INT(" + x + ") == INT(" + y + "))");
+}
+
+std::string LessOrEqual::translate(csrc::Translator *t, std::ostream &o) {
+  auto x = a->translate(t, o);
+  auto y = b->translate(t, o);
+  return t->new_temp(o, "cool_bool(INT(" + x + ") <= INT(" + y + "))");
+}
+
+std::string Not::translate(csrc::Translator *t, std::ostream &o) {
+  return t->new_temp(o, "cool_bool(!BOOL(" + expr->translate(t, o) + "))");
+}
+
+std::string Var::translate(csrc::Translator *t, std::ostream &o) {
+  if (name == "self") {
+    return "self";
+  }
+  // copied, later assignments must not change the result
+  return t->new_temp(o, t->scope.find(name));
+}
+
+std::string IntConst::translate(csrc::Translator *t, std::ostream &o) {
+  return t->int_constant(value);
+}
+
+std::string StrConst::translate(csrc::Translator *t, std::ostream &o) {
+  return t->string_constant(value);
+}
+
+std::string BoolConst::translate(csrc::Translator *t, std::ostream &o) {
+  return t->bool_constant(value);
+}
+
+} /* namespace ast */
@@ -0,0 +1,81 @@
+#ifndef _CSRC_HH
+#define _CSRC_HH
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+
+#include "ast.hh"
+#include "sa.hh"
+
+/*
+ * A C backend: the program is translated to C and left to gcc -O2.
+ *
+ * Objects keep the layout of the native code (size, GC, class id, name,
+ * method table, then fields or data). Every class gets a struct with its
+ * fields in `fields_ordered` order and a struct of function pointers with
+ * its methods in `methods_ordered` order; both extend those of the parent,
+ * so an object can be used through the structs of any of its ancestors.
+ *
+ * Names
+ *   C_<class>            objects of the class
+ *   V_<class>            method table (of type struct V_<class>)
+ *   P_<class>            prototype
+ *   M_<class>__<method>  method
+ *   S_<n>, I_<n>, B_<n>  String, Int and Bool constants
+ *   f_<field>, a_<formal>, l<n>_<local>, t<n>
+ */
+
+namespace csrc {
+
+class Translator {
+public:
+  Translator(ast::Program *program, cool::SemanticAnalyser *sa)
+      : indent("  "), program(program), sa(sa), temp_no(0) {}
+
+  void translate(std::ostream &o);
+
+  // --- used by ast::*::translate ---
+
+  // declare a new temporary, initialized to `value` unless it is empty
+  std::string new_temp(std::ostream &o, const std::string &value = "");
+  std::string new_local(const std::string &name);
+
+  std::string string_constant(const std::string &s);
+  std::string int_constant(int64_t i);
+  std::string bool_constant(bool b);
+  std::string default_value(ast::Class *cls);
+
+  // the function implementing `cls`'s method `name`
+  std::string method_function(ast::Class *cls, const std::string &name);
+  // whether no subclass of `cls` overrides its method `name`
+  bool is_final(ast::Class *cls, const std::string &name);
+
+  std::string indent;
+  cool::Scope<std::string> scope;
+
+  ast::Program *program;
+  cool::SemanticAnalyser *sa;
+
+private:
+  int temp_no;
+
+  std::map<std::string, int> string_constants_numbered;
+  std::list<std::string> string_constants;
+
+  std::map<int64_t, int> int_constants_numbered;
+  std::list<int64_t> int_constants;
+
+  void arrange_classes();
+
+  void translate_structs(std::ostream &o);
+  void translate_declarations(std::ostream &o);
+  void translate_constants(std::ostream &o);
+  void translate_prototypes(std::ostream &o);
+  void translate_methods(std::ostream &o);
+};
+
+} /* namespace csrc */
+
+#endif /* _CSRC_HH */
@@ -0,0 +1,200 @@
+#include "elf.hh"
+
+#include <elf.h>
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace elf {
+
+namespace {
+
+class StringTable {
+public:
+  StringTable() : data(1, '\0') {}
+
+  uint32_t add(const std::string &s) {
+    auto res = data.size();
+    data.insert(data.end(), s.begin(), s.end());
+    data.push_back('\0');
+    return res;
+  }
+
+  std::vector<char> data;
+};
+
+template <typename T> void append(std::vector<char> &buf, const T &v) {
+  auto p = reinterpret_cast<const char *>(&v);
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+} // namespace
+
+/*
+ * Layout
+ *   ELF header
+ *   section contents (.text, ..., .rela.text, ..., .symtab, .strtab,
+ *                     .shstrtab)
+ *   section headers
+ */
+void write_object(std::ostream &o, x86::Object &obj) {
+  StringTable shstrtab, strtab;
+  std::vector<Elf64_Shdr> headers(1); // SHN_UNDEF
+  std::vector<std::vector<char>> contents(1);
+
+  auto add_section = [&](const std::string &name, uint32_t type,
+                         uint64_t flags, uint64_t align,
+                         std::vector<char> data) {
+    Elf64_Shdr sh;
+    std::memset(&sh, 0, sizeof(sh));
+    sh.sh_name = shstrtab.add(name);
+    sh.sh_type = type;
+    sh.sh_flags = flags;
+    sh.sh_addralign = align;
+    sh.sh_size = data.size();
+    headers.push_back(sh);
+    contents.push_back(data);
+    return headers.size() - 1;
+  };
+
+  // x86::Object section i -> ELF section i + 1
+  for (auto &section : obj.sections) {
+    auto idx = add_section(section.name, section.type, section.flags,
+                           section.align,
+                           std::vector<char>(section.data.begin(),
+                                             section.data.end()));
+    headers[idx].sh_size = section.size;
+  }
+
+  // symbols: null, sections, locals, globals
+  std::vector<Elf64_Sym> symtab;
+  std::map<std::string, uint32_t> symbols_numbered;
+
+  auto add_symbol = [&](const std::string &name, unsigned char bind,
+                        unsigned char type, uint16_t shndx, uint64_t value,
+                        uint64_t size) {
+    Elf64_Sym sym;
+    std::memset(&sym, 0, sizeof(sym));
+    sym.st_name = name.empty() ? 0 : strtab.add(name);
+    sym.st_info = ELF64_ST_INFO(bind, type);
+    sym.st_shndx = shndx;
+    sym.st_value = value;
+    sym.st_size = size;
+    symtab.push_back(sym);
+    return symtab.size() - 1;
+  };
+
+  add_symbol("", STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0, 0);
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    add_symbol("", STB_LOCAL, STT_SECTION, i + 1, 0, 0);
+  }
+  for (auto &sym : obj.symbols) {
+    if (!sym.global && sym.section >= 0 && !x86::is_local_label(sym.name)) {
+      symbols_numbered[sym.name] =
+          add_symbol(sym.name, STB_LOCAL, sym.type, sym.section + 1,
+                     sym.value, sym.size);
+    }
+  }
+  uint32_t first_global = symtab.size();
+  for (auto &sym : obj.symbols) {
+    if (sym.global || sym.section < 0) {
+      symbols_numbered[sym.name] = add_symbol(
+          sym.name, STB_GLOBAL, sym.type,
+          sym.section < 0 ? SHN_UNDEF : sym.section + 1, sym.value, sym.size);
+    }
+  }
+
+  // relocations against local symbols refer to their sections instead
+  std::vector<size_t> rela_sections;
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    auto &section = obj.sections[i];
+    if (section.relocations.empty()) {
+      continue;
+    }
+    std::vector<char> data;
+    for (auto &r : section.relocations) {
+      auto sym = obj.find_symbol(r.symbol);
+      uint32_t sym_no;
+      int64_t addend = r.addend;
+      if (sym->global || sym->section < 0) {
+        sym_no = symbols_numbered[r.symbol];
+      } else {
+        sym_no = sym->section + 1;
+        addend += sym->value;
+      }
+      Elf64_Rela rela;
+      rela.r_offset = r.offset;
+      rela.r_info = ELF64_R_INFO(sym_no, r.type);
+      rela.r_addend = addend;
+      append(data, rela);
+    }
+    auto idx = add_section(".rela" + section.name, SHT_RELA, SHF_INFO_LINK, 8,
+                           data);
+    headers[idx].sh_entsize = sizeof(Elf64_Rela);
+    headers[idx].sh_info = i + 1;
+    rela_sections.push_back(idx);
+  }
+
+  // no executable stack
+  add_section(".note.GNU-stack", SHT_PROGBITS, 0, 1, std::vector<char>());
+
+  std::vector<char> symtab_data;
+  for (auto &sym : symtab) {
+    append(symtab_data, sym);
+  }
+  auto symtab_idx =
+      add_section(".symtab", SHT_SYMTAB, 0, 8, std::move(symtab_data));
+  headers[symtab_idx].sh_entsize = sizeof(Elf64_Sym);
+  headers[symtab_idx].sh_info = first_global;
+
+  auto strtab_idx =
+      add_section(".strtab", SHT_STRTAB, 0, 1, std::move(strtab.data));
+  headers[symtab_idx].sh_link = strtab_idx;
+  for (auto idx : rela_sections) {
+    headers[idx].sh_link = symtab_idx;
+  }
+
+  auto shstrtab_idx =
+      add_section(".shstrtab", SHT_STRTAB, 0, 1, std::vector<char>());
+  contents[shstrtab_idx] = shstrtab.data;
+  headers[shstrtab_idx].sh_size = shstrtab.data.size();
+
+  // place the contents
+  std::vector<char> file(sizeof(Elf64_Ehdr), 0);
+  for (size_t i = 1; i < headers.size(); ++i) {
+    auto align = headers[i].sh_addralign ? headers[i].sh_addralign : 1;
+    file.resize((file.size() + align - 1) / align * align, 0);
+    headers[i].sh_offset = file.size();
+    if (headers[i].sh_type != SHT_NOBITS) {
+      file.insert(file.end(), contents[i].begin(), contents[i].end());
+    }
+  }
+  file.resize((file.size() + 7) / 8 * 8, 0);
+
+  Elf64_Ehdr eh;
+  std::memset(&eh, 0, sizeof(eh));
+  std::memcpy(eh.e_ident, ELFMAG, SELFMAG);
+  eh.e_ident[EI_CLASS] = ELFCLASS64;
+  eh.e_ident[EI_DATA] = ELFDATA2LSB;
+  eh.e_ident[EI_VERSION] = EV_CURRENT;
+  eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  eh.e_type = ET_REL;
+  eh.e_machine = EM_X86_64;
+  eh.e_version = EV_CURRENT;
+  eh.e_shoff = file.size();
+  eh.e_ehsize = sizeof(Elf64_Ehdr);
+  eh.e_shentsize = sizeof(Elf64_Shdr);
+  eh.e_shnum = headers.size();
+  eh.e_shstrndx = shstrtab_idx;
+  std::memcpy(file.data(), &eh, sizeof(eh));
+
+  for (auto &sh : headers) {
+    append(file, sh);
+  }
+
+  o.write(file.data(), file.size());
+}
+
+} /* namespace elf */
@@ -0,0 +1,15 @@
+#ifndef _ELF_HH
+#define _ELF_HH
+
+#include <iostream>
+
+#include "x86.hh"
+
+namespace elf {
+
+// write `obj` as an ELF64 relocatable object file
+void write_object(std::ostream &o, x86::Object &obj);
+
+} /* namespace elf */
+
+#endif /* _ELF_HH */
@@ -0,0 +1,203 @@
+#include "ast.hh"
+
+/*
+ * Constant folding over the analysed AST, shared by all backends.
+ *
+ * Int operations on literals wrap around like they do at run time; division
+ * by zero and the overflowing division are left to trap at run time.
+ * Strings are C strings at run time, so those with a NUL in them are not
+ * touched.
+ */
+
+namespace ast {
+
+namespace {
+
+// replace `expr` by its value if known
+void fold_expr(std::shared_ptr<Expression> &expr) {
+  if (!expr) {
+    return;
+  }
+  auto res = expr->fold();
+  if (res) {
+    res->set_loc(expr->get_loc());
+    expr = res;
+  }
+}
+
+bool int_const(std::shared_ptr<Expression> &expr, int64_t &v) {
+  auto k = std::dynamic_pointer_cast<IntConst>(expr);
+  if (k) {
+    v = k->value;
+  }
+  return k != nullptr;
+}
+
+bool str_const(std::shared_ptr<Expression> &expr, std::string &v) {
+  auto k = std::dynamic_pointer_cast<StrConst>(expr);
+  if (k && k->value.find('\0') == std::string::npos) {
+    v = k->value;
+    return true;
+  }
+  return false;
+}
+
+std::shared_ptr<Expression> int_op_fold(std::shared_ptr<Expression> &a,
+                                        std::shared_ptr<Expression> &b,
+                                        char op) {
+  fold_expr(a);
+  fold_expr(b);
+
+  int64_t x, y;
+  if (!int_const(a, x) || !int_const(b, y)) {
+    return nullptr;
+  }
+  switch (op) {
+  case '+':
+    return std::make_shared<IntConst>((uint64_t)x + (uint64_t)y);
+  case '-':
+    return std::make_shared<IntConst>((uint64_t)x - (uint64_t)y);
+  case '*':
+    return std::make_shared<IntConst>((uint64_t)x * (uint64_t)y);
+  case '/':
+    if (y == 0 || (x == INT64_MIN && y == -1)) {
+      return nullptr;
+    }
+    return std::make_shared<IntConst>(x / y);
+  case '<':
+    return std::make_shared<BoolConst>(x < y);
+  case '=':
+    return std::make_shared<BoolConst>(x == y);
+  case 'l':
+    return std::make_shared<BoolConst>(x <= y);
+  }
+  return nullptr;
+}
+
+} // namespace
+
+std::shared_ptr<Expression> Assign::fold() {
+  fold_expr(expr);
+  return nullptr;
+}
+
+std::shared_ptr<Expression> Invoke::fold() {
+  bool same = expr_sa == expr;
+  fold_expr(expr_sa);
+  if (same) {
+    expr = expr_sa;
+  }
+  for (auto &arg : arguments) {
+    fold_expr(arg);
+  }
+
+  std::string s1, s2;
+  int64_t i;
+  if (type_sa->name == "String" && str_const(expr_sa, s1)) {
+    if (name == "concat" && str_const(arguments.front(), s2)) {
+      return std::make_shared<StrConst>(s1 + s2);
+    }
+    if (name == "length") {
+      return std::make_shared<IntConst>(s1.size());
+    }
+  }
+  if (type_sa->name == "Int" && int_const(expr_sa, i) && name == "to_string") {
+    return std::make_shared<StrConst>(std::to_string(i));
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Expression> If::fold() {
+  fold_expr(a);
+  fold_expr(b);
+  fold_expr(c);
+  return nullptr;
+}
+
+std::shared_ptr<Expression> While::fold() {
+  fold_expr(a);
+  fold_expr(b);
+  return nullptr;
+}
+
+std::shared_ptr<Expression> Block::fold() {
+  for (auto &expr : expressions) {
+    fold_expr(expr);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Expression> Let::fold() {
+  fold_expr(expr);
+  fold_expr(body);
+  return nullptr;
+}
+
+std::shared_ptr<Expression> Case::fold() {
+  fold_expr(expr);
+  for (auto &branch : branches) {
+    fold_expr(branch->expr);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Expression> IsVoid::fold() {
+  fold_expr(expr);
+  if (std::dynamic_pointer_cast<IntConst>(expr) ||
+      std::dynamic_pointer_cast<StrConst>(expr) ||
+      std::dynamic_pointer_cast<BoolConst>(expr)) {
+    return std::make_shared<BoolConst>(false);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Expression> Add::fold() { return int_op_fold(a, b, '+'); }
+
+std::shared_ptr<Expression> Sub::fold() { return int_op_fold(a, b, '-'); }
+
+std::shared_ptr<Expression> Mul::fold() { return int_op_fold(a, b, '*'); }
+
+std::shared_ptr<Expression> Div::fold() { return int_op_fold(a, b, '/'); }
+
+std::shared_ptr<Expression> Neg::fold() {
+  fold_expr(expr);
+  int64_t x;
+  if (int_const(expr, x)) {
+    return std::make_shared<IntConst>(-(uint64_t)x);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Expression> LessThan::fold() { return int_op_fold(a, b, '<'); }
+
+std::shared_ptr<Expression> Equal::fold() { return int_op_fold(a, b, '='); }
+
+std::shared_ptr<Expression> LessOrEqual::fold() {
+  return int_op_fold(a, b, 'l');
+}
+
+std::shared_ptr<Expression> Not::fold() {
+  fold_expr(expr);
+  auto k = std::dynamic_pointer_cast<BoolConst>(expr);
+  if (k) {
+    return std::make_shared<BoolConst>(!k->value);
+  }
+  return nullptr;
+}
+
+void Program::fold() {
+  for (auto &cls : classes) {
+    for (auto &feature : cls->features) {
+      auto method = std::dynamic_pointer_cast<Method>(feature);
+      if (method) {
+        fold_expr(method->expr);
+      }
+      auto field = std::dynamic_pointer_cast<Field>(feature);
+      if (field) {
+        fold_expr(field->expr);
+      }
+    }
+  }
+}
+
+} /* namespace ast */
@@ -0,0 +1,922 @@
+#include "ir.hh"
+
+#include <algorithm>
+
+#include "cg.hh"
+#include "util.hh"
+
+namespace ir {
+
+namespace {
+
+const char *opcode_names[] = {
+    "mov",   "const",  "obj_const", "self",     "arg",   "field",
+    "set_field", "box", "unbox",    "add",      "sub",   "mul",
+    "div",   "mul_imm", "div_imm",  "neg",      "lt",    "le",
+    "eq",    "not",    "isvoid",    "class_id", "alloc", "call",
+    "dispatch", "check_void", "count", "clock", "elem",  "set_elem",
+    "length", "jump",  "branch",    "ret",      "fail"};
+
+static_assert(sizeof(opcode_names) / sizeof(opcode_names[0]) == FAIL + 1,
+              "opcode_names is out of date");
+
+const char *type_names[] = {"obj", "int", "bool"};
+
+std::string temp(int t) { return "t" + std::to_string(t); }
+
+std::string block(int b) { return "B" + std::to_string(b); }
+
+} // namespace
+
+bool Instr::is_pure() const {
+  switch (op) {
+  case MOV:
+  case CONST:
+  case OBJ_CONST:
+  case SELF:
+  case ARG:
+  case FIELD:
+  case BOX:
+  case UNBOX:
+  case ADD:
+  case SUB:
+  case MUL:
+  case MUL_IMM:
+  case NEG:
+  case LT:
+  case LE:
+  case EQ:
+  case NOT:
+  case ISVOID:
+  case CLASS_ID:
+  case LENGTH:
+    return true;
+  case DIV_IMM:
+    // these trap like DIV
+    return imm != 0 && imm != -1;
+  default:
+    return false;
+  }
+}
+
+int Function::new_temp(Type type) {
+  temps.push_back(type);
+  return temps.size() - 1;
+}
+
+int Function::new_block() {
+  blocks.emplace_back();
+  return blocks.size() - 1;
+}
+
+void Function::print(std::ostream &o) {
+  o << name << ":\n";
+  for (int i = 0; i < blocks.size(); ++i) {
+    if (!blocks[i].reachable) {
+      continue;
+    }
+    o << block(i) << ":\n";
+    for (auto &instr : blocks[i].instrs) {
+      o << "  ";
+      if (instr.dst >= 0) {
+        o << temp(instr.dst) << ":" << type_names[temps[instr.dst]] << " = ";
+      }
+      o << opcode_names[instr.op];
+      std::string sep = " ";
+      for (auto arg : instr.args) {
+        o << sep << temp(arg);
+        sep = ", ";
+      }
+      switch (instr.op) {
+      case CONST:
+      case ARG:
+      case FIELD:
+      case SET_FIELD:
+      case MUL_IMM:
+      case DIV_IMM:
+      case DISPATCH:
+      case CLOCK:
+        o << sep << instr.imm;
+        break;
+      case OBJ_CONST:
+      case CALL:
+      case CHECK_VOID:
+      case COUNT:
+      case FAIL:
+        o << sep << instr.sym;
+        break;
+      case ALLOC:
+        o << sep << instr.cls->name;
+        break;
+      case JUMP:
+        o << sep << block(instr.target[0]);
+        break;
+      case BRANCH:
+        o << sep << block(instr.target[0]) << ", " << block(instr.target[1]);
+        break;
+      default:
+        break;
+      }
+      o << "\n";
+    }
+  }
+  o << "\n";
+}
+
+// --- lowering ---
+
+class Variable {
+public:
+  enum Kind { TEMP, FIELD };
+
+  Variable(Kind kind, int no) : kind(kind), no(no) {}
+
+  Kind kind;
+  int no; // temporary or field number
+};
+
+Builder::Builder(cool::CodeGenerator *cg)
+    : current(0), loc(nullptr), self(-1), cg(cg) {}
+
+int Builder::emit(Instr instr) {
+  instr.loc = loc;
+  f->blocks[current].instrs.push_back(instr);
+  return instr.dst;
+}
+
+int Builder::emit(Opcode op, Type type, std::vector<int> args, int64_t imm) {
+  return emit(Instr(op, f->new_temp(type), args, imm));
+}
+
+int Builder::convert(int t, Type type) {
+  if (f->temps[t] == type) {
+    return t;
+  }
+  if (type == OBJ) {
+    return emit(BOX, OBJ, {t});
+  }
+  return emit(UNBOX, type, {t});
+}
+
+int Builder::string_constant(const std::string &s) {
+  Instr instr(OBJ_CONST, f->new_temp(OBJ));
+  instr.sym = "string_constant_" + std::to_string(cg->get_string_constant_no(s));
+  return emit(instr);
+}
+
+int Builder::load(const std::string &name) {
+  auto var = scope.find(name);
+  if (var->kind == Variable::FIELD) {
+    return emit(FIELD, OBJ, {self}, var->no);
+  }
+  return emit(MOV, f->temps[var->no], {var->no});
+}
+
+void Builder::store(const std::string &name, int t) {
+  auto var = scope.find(name);
+  if (var->kind == Variable::FIELD) {
+    emit(Instr(SET_FIELD, -1, {self, convert(t, OBJ)}, var->no));
+  } else {
+    emit(Instr(MOV, var->no, {convert(t, f->temps[var->no])}));
+  }
+}
+
+Type Builder::type_of(ast::Class *cls) {
+  if (cls == cg->sa->intClass.get()) {
+    return INT;
+  }
+  if (cls == cg->sa->boolClass.get()) {
+    return BOOL;
+  }
+  return OBJ;
+}
+
+Function Builder::lower(ast::Class *cls, ast::Method *method) {
+  LocationScope location(this, method);
+  f.reset(new Function(cls->name + "." + method->name, method->formals.size()));
+  current = f->new_block();
+  self = emit(SELF, OBJ);
+
+  scope.enter();
+  for (auto &name : cls->fields_ordered) {
+    scope.add(name, std::make_shared<Variable>(Variable::FIELD,
+                                               cls->fields_numbered[name]));
+  }
+
+  scope.enter();
+  int i = 0;
+  for (auto &formal : method->formals) {
+    auto arg = emit(ARG, OBJ, {}, i++);
+    auto type = type_of(cg->sa->name2Class[formal->type_name].get());
+    auto var = f->new_temp(type);
+    emit(Instr(MOV, var, {convert(arg, type)}));
+    scope.add(formal->name, std::make_shared<Variable>(Variable::TEMP, var));
+  }
+
+  auto res = method->expr->lower(this);
+  emit(Instr(RET, -1, {convert(res, OBJ)}));
+
+  scope.exit();
+  scope.exit();
+  return std::move(*f);
+}
+
+// --- code generation ---
+
+namespace {
+
+x86::Operand slot(int t) { return x86::mem(-8 * (t + 1), x86::RBP); }
+
+// whether temporary `t`, defined by instruction `i` of block `b`, is only
+// copied until it is returned
+bool returned(Function &f, int b, int i, int t) {
+  for (int hops = 0; hops <= f.blocks.size(); ++hops) {
+    auto &instrs = f.blocks[b].instrs;
+    for (++i; i < instrs.size(); ++i) {
+      auto &instr = instrs[i];
+      if (instr.op == MOV && instr.args[0] == t) {
+        t = instr.dst;
+      } else if (instr.op == RET) {
+        return instr.args[0] == t;
+      } else if (instr.op == JUMP) {
+        b = instr.target[0];
+        i = -1;
+        break;
+      } else {
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+/*
+ * Every temporary lives in its own stack slot below %rbp; instructions go
+ * through %rax, %rcx and %rdx. Arguments are above the return address, as
+ * in Method::generate.
+ */
+void generate(Function &f, cool::CodeGenerator *cg, x86::Emitter &o) {
+  // temporaries defined once by CONST, so that boxing them needs no Object.copy
+  std::vector<int> defs(f.temps.size());
+  std::map<int, int64_t> constants;
+  for (auto &b : f.blocks) {
+    for (auto &instr : b.instrs) {
+      if (instr.dst >= 0) {
+        defs[instr.dst]++;
+        if (instr.op == CONST) {
+          constants[instr.dst] = instr.imm;
+        }
+      }
+    }
+  }
+
+  // Int boxes that are only unboxed, tested or given to built-in methods
+  // that keep no reference to them cannot escape; they are built in the
+  // frame, 6 slots each below the temporaries
+  std::vector<bool> escapes(f.temps.size());
+  for (auto &b : f.blocks) {
+    for (auto &instr : b.instrs) {
+      bool borrows = instr.op == UNBOX || instr.op == ISVOID ||
+                     instr.op == CHECK_VOID || instr.op == CLASS_ID;
+      if (instr.op == CALL) {
+        auto dot = instr.sym.find('.');
+        auto cls = cg->sa->name2Class[instr.sym.substr(0, dot)].get();
+        borrows = cg->keeps_no_reference(cls, instr.sym.substr(dot + 1));
+      }
+      if (!borrows) {
+        for (auto arg : instr.args) {
+          escapes[arg] = true;
+        }
+      }
+    }
+  }
+  std::map<int, int> stack_boxes; // temporary -> offset from %rbp
+  for (auto &b : f.blocks) {
+    for (auto &instr : b.instrs) {
+      if (instr.op == BOX && f.temps[instr.args[0]] == INT &&
+          defs[instr.dst] == 1 && !escapes[instr.dst] &&
+          !constants.count(instr.args[0])) {
+        auto offset = -8 * (int)f.temps.size() - 48 * (stack_boxes.size() + 1);
+        stack_boxes[instr.dst] = offset;
+      }
+    }
+  }
+
+  std::vector<int> order;
+  std::vector<std::string> labels;
+  for (int i = 0; i < f.blocks.size(); ++i) {
+    labels.push_back(cg->next_label());
+    if (f.blocks[i].reachable) {
+      order.push_back(i);
+    }
+  }
+
+  // the prologue belongs to the method, whose location the entry starts with
+  const yy::location *loc = nullptr;
+  if (!f.blocks[0].instrs.empty() && f.blocks[0].instrs[0].loc) {
+    loc = f.blocks[0].instrs[0].loc;
+    cg->loc_generate(o, *loc);
+  }
+  cg->prologue_generate(o);
+  auto frame = (f.temps.size() * 8 + stack_boxes.size() * 48 + 15) / 16 * 16;
+  if (frame) {
+    o.ins("subq", x86::imm(frame), x86::RSP);
+  }
+  cg->entry_probe_generate(o, f.name);
+  cg->call_enter_generate(o);
+
+  // blocks jumped to from themselves or later ones head loops
+  std::vector<bool> loop_head(f.blocks.size());
+  for (int k = 0; k < order.size(); ++k) {
+    for (auto &instr : f.blocks[order[k]].instrs) {
+      for (auto t : instr.target) {
+        if (t >= 0 && std::find(order.begin(), order.begin() + k + 1, t) !=
+                          order.begin() + k + 1) {
+          loop_head[t] = true;
+        }
+      }
+    }
+  }
+
+  for (int k = 0; k < order.size(); ++k) {
+    auto &b = f.blocks[order[k]];
+    int next = k + 1 < order.size() ? order[k + 1] : -1;
+
+    if (loop_head[order[k]]) {
+      o.directive(".p2align", "4,,10");
+    }
+    o.label(labels[order[k]]);
+    for (auto &instr : b.instrs) {
+      if (instr.loc && instr.loc != loc) {
+        loc = instr.loc;
+        cg->loc_generate(o, *loc);
+      }
+      auto arg = [&](int i) { return slot(instr.args[i]); };
+      auto known = [&](int i) {
+        return defs[instr.args[i]] == 1 && constants.count(instr.args[i]);
+      };
+      auto store = [&]() { o.ins("movq", x86::RAX, slot(instr.dst)); };
+
+      switch (instr.op) {
+      case MOV:
+        o.ins("movq", arg(0), x86::RAX);
+        store();
+        break;
+      case CONST:
+        if (util::fits_int32(instr.imm)) {
+          o.ins("movq", x86::imm(instr.imm), x86::RAX);
+        } else {
+          o.ins("movabsq", x86::imm(instr.imm), x86::RAX);
+        }
+        store();
+        break;
+      case OBJ_CONST:
+        o.ins("movq", x86::imm(instr.sym), x86::RAX);
+        store();
+        break;
+      case SELF:
+        o.ins("movq", x86::RBX, slot(instr.dst));
+        break;
+      case ARG:
+        o.ins("movq", x86::mem((2 + instr.imm) * 8, x86::RBP), x86::RAX);
+        store();
+        break;
+      case FIELD:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("movq", x86::mem((5 + instr.imm) * 8, x86::RAX), x86::RAX);
+        store();
+        break;
+      case SET_FIELD:
+        o.ins("movq", arg(0), x86::RCX);
+        o.ins("movq", arg(1), x86::RAX);
+        o.ins("movq", x86::RAX, x86::mem((5 + instr.imm) * 8, x86::RCX));
+        break;
+      case BOX: {
+        auto a = instr.args[0];
+        if (f.temps[a] == BOOL) {
+          if (known(0)) {
+            o.ins("movq",
+                  x86::imm(constants[a] ? "bool_constant_true"
+                                        : "bool_constant_false"),
+                  x86::RAX);
+          } else {
+            o.ins("movq", x86::imm("bool_constant_false"), x86::RAX);
+            o.ins("movq", x86::imm("bool_constant_true"), x86::RCX);
+            o.ins("cmpq", x86::imm(0), arg(0));
+            o.ins("cmovneq", x86::RCX, x86::RAX);
+          }
+        } else if (known(0)) {
+          o.ins("movq",
+                x86::imm("int_constant_" +
+                         std::to_string(cg->get_int_constant_no(constants[a]))),
+                x86::RAX);
+        } else if (stack_boxes.count(instr.dst)) {
+          o.ins("movq", arg(0), x86::RAX);
+          cg->stack_int_generate(o, stack_boxes[instr.dst]);
+        } else {
+          ast::new_generate(cg, o, cg->sa->intClass.get());
+          o.ins("movq", arg(0), x86::RCX);
+          o.ins("movq", x86::RCX, x86::mem(40, x86::RAX));
+        }
+        store();
+        break;
+      }
+      case UNBOX:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("movq", x86::mem(40, x86::RAX), x86::RAX);
+        store();
+        break;
+      case ADD:
+      case SUB:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins(instr.op == ADD ? "addq" : "subq", arg(1), x86::RAX);
+        store();
+        break;
+      case MUL:
+        if (known(1) || known(0)) {
+          int i = known(1) ? 1 : 0;
+          o.ins("movq", arg(1 - i), x86::RAX);
+          cg->mul_constant_generate(o, constants[instr.args[i]]);
+        } else {
+          o.ins("movq", arg(0), x86::RAX);
+          o.ins("imulq", arg(1), x86::RAX);
+        }
+        store();
+        break;
+      case DIV:
+        o.ins("movq", arg(0), x86::RAX);
+        if (known(1)) {
+          cg->div_constant_generate(o, constants[instr.args[1]]);
+        } else {
+          o.ins("cqto");
+          o.ins("idivq", arg(1));
+        }
+        store();
+        break;
+      case MUL_IMM:
+        o.ins("movq", arg(0), x86::RAX);
+        cg->mul_constant_generate(o, instr.imm);
+        store();
+        break;
+      case DIV_IMM:
+        o.ins("movq", arg(0), x86::RAX);
+        cg->div_constant_generate(o, instr.imm);
+        store();
+        break;
+      case NEG:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("negq", x86::RAX);
+        store();
+        break;
+      case LT:
+      case LE:
+      case EQ:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("cmpq", arg(1), x86::RAX);
+        o.ins(instr.op == LT ? "setl" : instr.op == LE ? "setle" : "sete",
+              x86::byte(x86::RAX));
+        o.ins("movzbq", x86::byte(x86::RAX), x86::RAX);
+        store();
+        break;
+      case NOT:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("xorq", x86::imm(1), x86::RAX);
+        store();
+        break;
+      case ISVOID:
+        o.ins("xorq", x86::RAX, x86::RAX);
+        o.ins("cmpq", x86::imm(0), arg(0));
+        o.ins("sete", x86::byte(x86::RAX));
+        store();
+        break;
+      case CLASS_ID:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("movq", x86::mem(16, x86::RAX), x86::RAX);
+        store();
+        break;
+      case ALLOC:
+        // invoke `copy` method of the prototype object
+        o.ins("movq", x86::imm(instr.cls->name + "_prototype"), x86::RBX);
+        o.ins("call",
+              x86::sym(instr.cls->methods_resolved["copy"]->name + ".copy"));
+        store();
+        break;
+      case CALL:
+      case DISPATCH:
+        // a call whose value is returned reuses the frame if the arguments
+        // fit in it and none of them lives in it
+        if (instr.op == CALL &&
+            (instr.sym == f.name || instr.args.size() - 1 <= f.nargs) &&
+            std::none_of(instr.args.begin(), instr.args.end(),
+                         [&](int t) { return stack_boxes.count(t); }) &&
+            returned(f, order[k], &instr - b.instrs.data(), instr.dst)) {
+          for (int i = 1; i < instr.args.size(); ++i) {
+            o.ins("movq", arg(i), x86::RAX);
+            o.ins("movq", x86::RAX, x86::mem((1 + i) * 8, x86::RBP));
+          }
+          o.ins("movq", arg(0), x86::RBX);
+          if (instr.sym == f.name) {
+            o.ins("jmp", x86::sym(labels[0])); // after the prologue
+          } else {
+            o.ins("movq", x86::RBP, x86::RSP);
+            cg->epilogue_generate(o, instr.sym);
+          }
+          break;
+        }
+        for (int i = instr.args.size() - 1; i > 0; --i) {
+          o.ins("pushq", arg(i));
+        }
+        o.ins("movq", arg(0), x86::RBX);
+        if (instr.op == CALL) {
+          o.ins("call", x86::sym(instr.sym));
+        } else {
+          cg->dispatch_generate(
+              o, instr.cls,
+              *std::next(instr.cls->methods_ordered.begin(), instr.imm),
+              instr.sym);
+        }
+        if (instr.args.size() > 1) {
+          o.ins("addq", x86::imm((instr.args.size() - 1) * 8), x86::RSP);
+        }
+        store();
+        break;
+      case CHECK_VOID:
+        o.ins("cmpq", x86::imm(0), arg(0));
+        o.ins("je", x86::sym(instr.sym));
+        break;
+      case COUNT:
+        o.ins("incq", x86::sym(instr.sym));
+        break;
+      case CLOCK:
+        if (instr.imm < 0) {
+          o.ins("rdtsc");
+          o.ins("shlq", x86::imm(32), x86::RDX);
+          o.ins("orq", x86::RDX, x86::RAX);
+        } else {
+          o.ins("movq", x86::imm(instr.imm), x86::RDI);
+          o.ins("call", x86::sym("_clock_ns"));
+        }
+        store();
+        break;
+      case ELEM:
+      case SET_ELEM:
+        o.ins("movq", arg(0), x86::RCX);
+        o.ins("movq", arg(1), x86::RAX);
+        o.ins("cmpq", x86::mem(40, x86::RCX), x86::RAX);
+        o.ins("jae", x86::sym("_array_bounds")); // a negative index too
+        if (instr.op == ELEM) {
+          o.ins("movq", x86::mem(48, x86::RCX, x86::RAX, 8), x86::RAX);
+          store();
+        } else {
+          o.ins("movq", arg(2), x86::RDX);
+          o.ins("movq", x86::RDX, x86::mem(48, x86::RCX, x86::RAX, 8));
+        }
+        break;
+      case LENGTH:
+        o.ins("movq", arg(0), x86::RAX);
+        o.ins("movq", x86::mem(40, x86::RAX), x86::RAX);
+        store();
+        break;
+      case JUMP:
+        if (instr.target[0] != next) {
+          o.ins("jmp", x86::sym(labels[instr.target[0]]));
+        }
+        break;
+      case BRANCH:
+        o.ins("cmpq", x86::imm(0), arg(0));
+        if (instr.target[0] == next) {
+          o.ins("je", x86::sym(labels[instr.target[1]]));
+        } else {
+          o.ins("jne", x86::sym(labels[instr.target[0]]));
+          if (instr.target[1] != next) {
+            o.ins("jmp", x86::sym(labels[instr.target[1]]));
+          }
+        }
+        break;
+      case RET:
+        o.ins("movq", arg(0), x86::RAX);
+        cg->call_exit_generate(o);
+        o.ins("movq", x86::RBP, x86::RSP);
+        cg->epilogue_generate(o);
+        break;
+      case FAIL:
+        o.ins("jmp", x86::sym(instr.sym));
+        break;
+      }
+    }
+  }
+}
+
+} /* namespace ir */
+
+namespace ast {
+
+int Assign::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto res = expr->lower(bld);
+  bld->store(name, res);
+  return res;
+}
+
+int Invoke::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  // as in Invoke::generate
+  if (name != cool::init_method_name) {
+    ir::Instr count(ir::COUNT);
+    count.sym = "stats_dispatches";
+    bld->emit(count);
+  }
+  // arguments right to left, then the receiver
+  std::vector<int> args(arguments.size() + 1);
+  int i = arguments.size();
+  for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) {
+    args[i--] = bld->convert(it->get()->lower(bld), ir::OBJ);
+  }
+  args[0] = bld->convert(expr_sa->lower(bld), ir::OBJ);
+
+  if (!receiver_non_void) {
+    ir::Instr check(ir::CHECK_VOID, -1, {args[0]});
+    check.sym = "_invoke_on_void";
+    bld->emit(check);
+  }
+
+  auto cls = target_class();
+  // the methods of Clock read the clocks in place, and box nothing
+  if (cls == bld->cg->sa->clockClass.get()) {
+    auto clock = name == "now_ns" ? 1 : name == "cpu_time_ns" ? 2 : -1;
+    return bld->emit(ir::CLOCK, ir::INT, {}, clock);
+  }
+  // the elements of arrays are read and written in place, the Ints of an
+  // IntArray unboxed
+  auto sa = bld->cg->sa;
+  if ((cls == sa->arrayClass.get() || cls == sa->intArrayClass.get()) &&
+      (name == "get" || name == "set" || name == "length")) {
+    auto type = cls == sa->arrayClass.get() ? ir::OBJ : ir::INT;
+    if (name == "length") {
+      return bld->emit(ir::LENGTH, ir::INT, {args[0]});
+    }
+    auto i = bld->convert(args[1], ir::INT);
+    if (name == "get") {
+      return bld->emit(ir::ELEM, type, {args[0], i});
+    }
+    bld->emit(
+        ir::Instr(ir::SET_ELEM, -1, {args[0], i, bld->convert(args[2], type)}));
+    return args[0];
+  }
+  if (!cls) {
+    ir::Instr dispatch(ir::DISPATCH, bld->f->new_temp(ir::OBJ), args,
+                       type_sa->methods_numbered[name]);
+    dispatch.cls = type_sa;
+    dispatch.sym = site();
+    return bld->emit(dispatch);
+  }
+  ir::Instr call(ir::CALL, bld->f->new_temp(ir::OBJ), args);
+  call.sym = cls->name + "." + name;
+  return bld->emit(call);
+}
+
+int If::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto cond = bld->convert(a->lower(bld), ir::BOOL);
+
+  ir::Instr branch(ir::BRANCH, -1, {cond});
+  branch.target[0] = bld->f->new_block();
+  branch.target[1] = bld->f->new_block();
+  bld->emit(branch);
+
+  bld->current = branch.target[0];
+  auto res_b = b->lower(bld);
+  auto end_b = bld->current;
+
+  bld->current = branch.target[1];
+  auto res_c = c->lower(bld);
+  auto end_c = bld->current;
+
+  // keep the result raw if both branches are
+  auto type = bld->f->temps[res_b] == bld->f->temps[res_c]
+                  ? bld->f->temps[res_b]
+                  : ir::OBJ;
+  auto res = bld->f->new_temp(type);
+  ir::Instr jump(ir::JUMP);
+  jump.target[0] = bld->f->new_block();
+
+  bld->current = end_b;
+  bld->emit(ir::Instr(ir::MOV, res, {bld->convert(res_b, type)}));
+  bld->emit(jump);
+
+  bld->current = end_c;
+  bld->emit(ir::Instr(ir::MOV, res, {bld->convert(res_c, type)}));
+  bld->emit(jump);
+
+  bld->current = jump.target[0];
+  return res;
+}
+
+int While::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  ir::Instr loop(ir::JUMP);
+  loop.target[0] = bld->f->new_block();
+  bld->emit(loop);
+
+  bld->current = loop.target[0];
+  auto cond = bld->convert(a->lower(bld), ir::BOOL);
+  ir::Instr branch(ir::BRANCH, -1, {cond});
+  branch.target[0] = bld->f->new_block();
+  branch.target[1] = bld->f->new_block();
+  bld->emit(branch);
+
+  bld->current = branch.target[0];
+  b->lower(bld);
+  bld->emit(loop);
+
+  bld->current = branch.target[1];
+  return bld->emit(ir::CONST, ir::OBJ);
+}
+
+int Block::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  int res = -1;
+  for (auto &expr : expressions) {
+    res = expr->lower(bld);
+  }
+  return res;
+}
+
+int Let::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto cls = bld->cg->sa->name2Class[type_name].get();
+  auto type = bld->type_of(cls);
+
+  int init;
+  if (!std::dynamic_pointer_cast<Void>(expr)) {
+    init = bld->convert(expr->lower(bld), type);
+  } else if (cls == bld->cg->sa->stringClass.get()) {
+    init = bld->string_constant("");
+  } else {
+    init = bld->emit(ir::CONST, type);
+  }
+
+  auto var = bld->f->new_temp(type);
+  bld->emit(ir::Instr(ir::MOV, var, {init}));
+
+  bld->scope.enter();
+  bld->scope.add(name, std::make_shared<ir::Variable>(ir::Variable::TEMP, var));
+  auto res = body->lower(bld);
+  bld->scope.exit();
+  return res;
+}
+
+int Case::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  ir::Instr count(ir::COUNT);
+  count.sym = "stats_cases";
+  bld->emit(count);
+  auto value = bld->convert(expr->lower(bld), ir::OBJ);
+  if (!expr_non_void) {
+    ir::Instr check(ir::CHECK_VOID, -1, {value});
+    check.sym = "_case_on_void";
+    bld->emit(check);
+  }
+  auto id = bld->emit(ir::CLASS_ID, ir::INT, {value});
+
+  auto res = bld->f->new_temp(ir::OBJ);
+  ir::Instr done(ir::JUMP);
+  done.target[0] = bld->f->new_block();
+
+  for (auto &branch : branches) {
+    auto match = bld->emit(ir::EQ, ir::BOOL,
+                           {id, bld->emit(ir::CONST, ir::INT, {},
+                                          branch->type->id)});
+    ir::Instr br(ir::BRANCH, -1, {match});
+    br.target[0] = bld->f->new_block();
+    br.target[1] = bld->f->new_block();
+    bld->emit(br);
+
+    bld->current = br.target[0];
+    auto type = bld->type_of(branch->type);
+    auto var = bld->f->new_temp(type);
+    bld->emit(ir::Instr(ir::MOV, var, {bld->convert(value, type)}));
+    bld->scope.enter();
+    bld->scope.add(branch->name,
+                   std::make_shared<ir::Variable>(ir::Variable::TEMP, var));
+    auto res_branch = branch->expr->lower(bld);
+    bld->scope.exit();
+    bld->emit(ir::Instr(ir::MOV, res, {bld->convert(res_branch, ir::OBJ)}));
+    bld->emit(done);
+
+    bld->current = br.target[1];
+  }
+
+  ir::Instr fail(ir::FAIL);
+  fail.sym = "_case_no_match";
+  bld->emit(fail);
+
+  bld->current = done.target[0];
+  return res;
+}
+
+int New::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  ir::Instr alloc(ir::ALLOC, bld->f->new_temp(ir::OBJ));
+  alloc.cls = type_sa;
+  bld->emit(alloc);
+
+  ir::Instr init(ir::CALL, bld->f->new_temp(ir::OBJ), {alloc.dst});
+  init.sym = type_sa->name + "." + cool::init_method_name;
+  return bld->emit(init);
+}
+
+int IsVoid::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  return bld->emit(ir::ISVOID, ir::BOOL,
+                   {bld->convert(expr->lower(bld), ir::OBJ)});
+}
+
+// operands of arithmetic operators are evaluated right to left
+int Add::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  return bld->emit(ir::ADD, ir::INT, {x, y});
+}
+
+int Sub::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  return bld->emit(ir::SUB, ir::INT, {x, y});
+}
+
+int Mul::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  return bld->emit(ir::MUL, ir::INT, {x, y});
+}
+
+int Div::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  return bld->emit(ir::DIV, ir::INT, {x, y});
+}
+
+int Neg::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  return bld->emit(ir::NEG, ir::INT,
+                   {bld->convert(expr->lower(bld), ir::INT)});
+}
+
+int LessThan::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  return bld->emit(ir::LT, ir::BOOL, {x, y});
+}
+
+int Equal::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  return bld->emit(ir::EQ, ir::BOOL, {x, y});
+}
+
+int LessOrEqual::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  auto x = bld->convert(a->lower(bld), ir::INT);
+  auto y = bld->convert(b->lower(bld), ir::INT);
+  return bld->emit(ir::LE, ir::BOOL, {x, y});
+}
+
+int Not::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  return bld->emit(ir::NOT, ir::BOOL,
+                   {bld->convert(expr->lower(bld), ir::BOOL)});
+}
+
+int Var::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  if (name == "self") {
+    return bld->self;
+  }
+  return bld->load(name);
+}
+
+int IntConst::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  return bld->emit(ir::CONST, ir::INT, {}, value);
+}
+
+int StrConst::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  return bld->string_constant(value);
+}
+
+int BoolConst::lower(ir::Builder *bld) {
+  ir::LocationScope location(bld, this);
+  return bld->emit(ir::CONST, ir::BOOL, {}, value ? 1 : 0);
+}
+
+} /* namespace ast */
@@ -0,0 +1,189 @@
+#ifndef _IR_HH
+#define _IR_HH
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.hh"
+#include "sa.hh"
+
+/*
+ * A three-address IR between the semantic analyser and the code generator.
+ *
+ * A Function is a list of basic blocks of instructions on numbered
+ * temporaries. Temporaries are typed: OBJ holds a pointer to an object
+ * (0 is void), INT and BOOL hold raw values that are boxed only when they
+ * have to become objects. Temporaries made by lowering an expression are
+ * defined once; those standing for variables may be assigned by MOV many
+ * times.
+ *
+ * Every block ends with exactly one terminator (JUMP, BRANCH, RET or FAIL).
+ */
+
+namespace cool {
+class CodeGenerator;
+} // namespace cool
+
+namespace ir {
+
+enum Type { OBJ, INT, BOOL };
+
+enum Opcode {
+  MOV,        // dst = a
+  CONST,      // dst = imm (void if OBJ)
+  OBJ_CONST,  // dst = the constant object sym
+  SELF,       // dst = self
+  ARG,        // dst = argument imm
+  FIELD,      // dst = field imm of a, which is self
+  SET_FIELD,  // field imm of a, which is self, = b
+  BOX,        // dst = a as an Int or Bool object
+  UNBOX,      // dst = the value of a
+  ADD,        // dst = a + b
+  SUB,        // dst = a - b
+  MUL,        // dst = a * b
+  DIV,        // dst = a / b
+  MUL_IMM,    // dst = a * imm
+  DIV_IMM,    // dst = a / imm
+  NEG,        // dst = -a
+  LT,         // dst = a < b
+  LE,         // dst = a <= b
+  EQ,         // dst = a == b
+  NOT,        // dst = !a
+  ISVOID,     // dst = a is void
+  CLASS_ID,   // dst = class id of a
+  ALLOC,      // dst = a copy of the prototype of cls
+  CALL,       // dst = sym(args), args[0] is the receiver
+  DISPATCH,   // dst = method imm of the class of args[0](args), which is
+              // of static type cls, at site sym
+  CHECK_VOID, // fail with sym if a is void
+  COUNT,      // add 1 to the counter at sym
+  CLOCK,      // dst = the time of clock imm (a clockid_t) in ns, or the
+              // cycle counter if imm is -1
+  ELEM,       // dst = element b of array a, failing if there is none
+  SET_ELEM,   // element b of array a = args[2], failing if there is none
+  LENGTH,     // dst = the length of array a
+
+  // terminators
+  JUMP,   // goto target[0]
+  BRANCH, // if a goto target[0] else goto target[1]
+  RET,    // return a
+  FAIL,   // fail with sym
+};
+
+class Instr {
+public:
+  Instr(Opcode op, int dst = -1, std::vector<int> args = {}, int64_t imm = 0)
+      : op(op), dst(dst), args(args), imm(imm), cls(nullptr), target{-1, -1},
+        loc(nullptr) {}
+
+  bool is_terminator() const { return op >= JUMP; }
+  // whether removing it, when dst is unused, changes nothing
+  bool is_pure() const;
+
+  Opcode op;
+  int dst; // -1 if none
+  std::vector<int> args;
+  int64_t imm;
+  std::string sym;
+  ast::Class *cls;
+  int target[2];
+  const yy::location *loc; // of the node it was lowered from
+};
+
+class Block {
+public:
+  Block() : reachable(true) {}
+
+  std::vector<Instr> instrs;
+  bool reachable;
+};
+
+class Function {
+public:
+  Function(const std::string &name, int nargs) : name(name), nargs(nargs) {}
+
+  int new_temp(Type type);
+  int new_block();
+
+  void print(std::ostream &o);
+
+  std::string name; // Class.method
+  int nargs;
+  std::vector<Type> temps;
+  std::vector<Block> blocks; // blocks[0] is the entry
+};
+
+class Variable;
+
+// lowers methods of the analysed AST, used by ast::*::lower
+class Builder {
+public:
+  Builder(cool::CodeGenerator *cg);
+
+  Function lower(ast::Class *cls, ast::Method *method);
+
+  // append an instruction to the current block; returns its dst
+  int emit(Instr instr);
+  int emit(Opcode op, Type type, std::vector<int> args = {}, int64_t imm = 0);
+
+  // `t` in the representation of `type`
+  int convert(int t, Type type);
+  int string_constant(const std::string &s);
+
+  int load(const std::string &name);
+  void store(const std::string &name, int t);
+  Type type_of(ast::Class *cls);
+
+  // the block instructions go to
+  int current;
+  // of the innermost node being lowered, given to the instructions emitted
+  const yy::location *loc;
+
+  int self;
+  std::unique_ptr<Function> f;
+  cool::Scope<std::shared_ptr<Variable>> scope;
+  cool::CodeGenerator *cg;
+};
+
+// the instructions emitted during its lifetime come from `node`
+class LocationScope {
+public:
+  LocationScope(Builder *bld, ast::Node *node) : bld(bld), saved(bld->loc) {
+    bld->loc = &node->get_loc();
+  }
+  ~LocationScope() { bld->loc = saved; }
+
+private:
+  Builder *bld;
+  const yy::location *saved;
+};
+
+class PassManager {
+public:
+  // `level` is 0, 1 or 2; the IR is printed to `dump` after each pass
+  PassManager(int level, std::ostream *dump = nullptr);
+
+  void run(Function &f);
+
+private:
+  std::list<std::pair<std::string, std::function<bool(Function &)>>> passes;
+  std::ostream *dump;
+};
+
+bool constant_folding(Function &f);
+bool copy_propagation(Function &f);
+bool dead_code_elimination(Function &f);
+bool common_subexpression_elimination(Function &f);
+
+// emit `f` as x86-64 assembly following the COOL calling convention
+void generate(Function &f, cool::CodeGenerator *cg, x86::Emitter &o);
+
+} /* namespace ir */
+
+#endif /* _IR_HH */
@@ -0,0 +1,205 @@
+#include "jit.hh"
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace jit {
+
+namespace {
+
+uint64_t align_up(uint64_t v, uint64_t align) {
+  return (v + align - 1) / align * align;
+}
+
+bool is_loaded(const x86::Section &section) {
+  return section.flags & SHF_ALLOC;
+}
+
+bool is_pc_relative(uint32_t type) {
+  return type == R_X86_64_PC32 || type == R_X86_64_PLT32;
+}
+
+// `jmp *0(%rip)` followed by the target address
+const int stub_size = 16;
+
+void write_stub(uint8_t *p, uint64_t target) {
+  const uint8_t jmp[] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+  std::memcpy(p, jmp, sizeof(jmp));
+  std::memcpy(p + sizeof(jmp), &target, 8);
+}
+
+} // namespace
+
+/*
+ * Memory layout (a single mapping in the low 2GB, so that the absolute
+ * 32-bit addresses the code generator relies on keep working)
+ *   sections, each page-aligned; those that are not SHF_ALLOC (notes and
+ *                debugging information) are left out, and .eh_frame gets
+ *                the zero terminator __register_frame looks for
+ *   stubs        calls into the host process, which may be out of rel32 range
+ *   copies       host data referenced by absolute 32-bit addresses, e.g.
+ *                `movq stdin, %rdx`; copied like a copy relocation would
+ */
+int run(x86::Object &obj) {
+  const uint64_t page = ::sysconf(_SC_PAGESIZE);
+
+  std::vector<uint64_t> section_offsets;
+  uint64_t size = 0;
+  for (auto &section : obj.sections) {
+    size = align_up(size, page);
+    section_offsets.push_back(size);
+    if (is_loaded(section)) {
+      size += section.size + (section.name == ".eh_frame" ? 4 : 0);
+    }
+  }
+
+  std::map<std::string, void *> host;
+  std::map<std::string, uint64_t> stubs, copies;
+  std::map<std::string, size_t> copy_sizes;
+  for (auto &section : obj.sections) {
+    if (!is_loaded(section)) {
+      continue;
+    }
+    for (auto &r : section.relocations) {
+      auto sym = obj.find_symbol(r.symbol);
+      if (sym->section >= 0 || host.count(r.symbol)) {
+        continue;
+      }
+      Dl_info info;
+      const ElfW(Sym) *entry = nullptr;
+      void *addr = ::dlsym(RTLD_DEFAULT, r.symbol.c_str());
+      if (!addr) {
+        throw LinkError("undefined symbol \"" + r.symbol + "\"");
+      }
+      host[r.symbol] = addr;
+      copy_sizes[r.symbol] = 8;
+      if (::dladdr1(addr, &info, (void **)&entry, RTLD_DL_SYMENT) && entry &&
+          entry->st_size) {
+        copy_sizes[r.symbol] = entry->st_size;
+      }
+    }
+  }
+
+  size = align_up(size, page);
+  uint64_t stubs_offset = size;
+  for (auto &h : host) {
+    stubs[h.first] = size;
+    size += stub_size;
+  }
+
+  size = align_up(size, page);
+  uint64_t copies_offset = size;
+  for (auto &h : host) {
+    copies[h.first] = size;
+    size += align_up(copy_sizes[h.first], 16);
+  }
+  size = align_up(size, page);
+
+  auto mem = (uint8_t *)::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  if (mem == MAP_FAILED) {
+    throw LinkError(std::string("mmap: ") + std::strerror(errno));
+  }
+  auto base = (uint64_t)mem;
+
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    auto &section = obj.sections[i];
+    if (is_loaded(section) && section.type != SHT_NOBITS) {
+      std::memcpy(mem + section_offsets[i], section.data.data(),
+                  section.data.size());
+    }
+  }
+  for (auto &h : host) {
+    write_stub(mem + stubs[h.first], (uint64_t)h.second);
+    std::memcpy(mem + copies[h.first], h.second, copy_sizes[h.first]);
+  }
+
+  auto address = [&](const std::string &name, uint32_t type) -> uint64_t {
+    auto sym = obj.find_symbol(name);
+    if (sym->section >= 0) {
+      return base + section_offsets[sym->section] + sym->value;
+    }
+    if (is_pc_relative(type)) {
+      return base + stubs[name];
+    }
+    if (type == R_X86_64_64) {
+      return (uint64_t)host[name];
+    }
+    return base + copies[name];
+  };
+
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    if (!is_loaded(obj.sections[i])) {
+      continue;
+    }
+    for (auto &r : obj.sections[i].relocations) {
+      auto p = mem + section_offsets[i] + r.offset;
+      auto v = address(r.symbol, r.type) + r.addend;
+      if (is_pc_relative(r.type)) {
+        v -= (uint64_t)p;
+      }
+
+      if (r.type == R_X86_64_64) {
+        std::memcpy(p, &v, 8);
+        continue;
+      }
+      bool fits = r.type == R_X86_64_32
+                      ? v <= UINT32_MAX
+                      : (int64_t)v >= INT32_MIN && (int64_t)v <= INT32_MAX;
+      if (!fits) {
+        throw LinkError("relocation against \"" + r.symbol +
+                        "\" out of range");
+      }
+      auto v32 = (uint32_t)v;
+      std::memcpy(p, &v32, 4);
+    }
+  }
+
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    auto &section = obj.sections[i];
+    int prot = PROT_READ;
+    if (section.flags & SHF_WRITE) {
+      prot |= PROT_WRITE;
+    }
+    if (section.flags & SHF_EXECINSTR) {
+      prot |= PROT_EXEC;
+    }
+    if (is_loaded(section) && section.size > 0 &&
+        ::mprotect(mem + section_offsets[i], align_up(section.size, page),
+                   prot)) {
+      throw LinkError(std::string("mprotect: ") + std::strerror(errno));
+    }
+  }
+  if (copies_offset > stubs_offset &&
+      ::mprotect(mem + stubs_offset, copies_offset - stubs_offset,
+                 PROT_READ | PROT_EXEC)) {
+    throw LinkError(std::string("mprotect: ") + std::strerror(errno));
+  }
+
+  // unwinders in the process, e.g. of the C++ runtime, can then walk
+  // through the frames of methods
+  auto register_frame =
+      (void (*)(void *))::dlsym(RTLD_DEFAULT, "__register_frame");
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    if (obj.sections[i].name == ".eh_frame" && register_frame) {
+      register_frame(mem + section_offsets[i]);
+    }
+  }
+
+  auto main = obj.find_symbol("main");
+  if (!main || main->section < 0) {
+    throw LinkError("undefined symbol \"main\"");
+  }
+  auto entry = (int (*)())address("main", R_X86_64_64);
+  return entry();
+}
+
+} /* namespace jit */
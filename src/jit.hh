@@ -0,0 +1,22 @@
+#ifndef _JIT_HH
+#define _JIT_HH
+
+#include <stdexcept>
+#include <string>
+
+#include "x86.hh"
+
+namespace jit {
+
+class LinkError : public std::runtime_error {
+public:
+  LinkError(const std::string &what_arg) : std::runtime_error(what_arg) {}
+};
+
+// load `obj` into executable memory, resolve its undefined symbols against
+// the running process and call its `main`
+int run(x86::Object &obj);
+
+} /* namespace jit */
+
+#endif /* _JIT_HH */
@@ -5,49 +5,300 @@
 #include <vector>
 
 #include "cg.hh"
+#include "csrc.hh"
+#include "elf.hh"
+#include "jit.hh"
+#include "nonvoid.hh"
 #include "parser.hh"
 #include "sa.hh"
+#include "timer.hh"
+#include "vm.hh"
+#include "x86.hh"
 
-int build(const std::string &exe_filename, const std::string &asm_filename) {
+int gcc(const std::string &args) {
+  cool::Timer timer("gcc");
   std::cout.flush();
   std::cerr.flush();
 
-  auto cmd = "gcc -ggdb -no-pie -o \"" + exe_filename + "\" \"" + asm_filename + "\"";
+  auto cmd = "gcc " + args;
   int ret = ::system(cmd.c_str());
   if (ret == -1 || ret == 127) {
-    ::perror("build");
+    ::perror("gcc");
   }
   return ret ? -1 : 0;
 }
 
+int build(const std::string &exe_filename, const std::string &asm_filename) {
+  return gcc("-ggdb -no-pie -o \"" + exe_filename + "\" \"" + asm_filename +
+             "\"");
+}
+
+int build_c(const std::string &exe_filename, const std::string &c_filename) {
+  return gcc("-O2 -fwrapv -fno-strict-aliasing -o \"" + exe_filename +
+             "\" \"" + c_filename + "\"");
+}
+
+int link(const std::string &exe_filename, const std::string &obj_filename) {
+  return gcc("-no-pie -o \"" + exe_filename + "\" \"" + obj_filename + "\"");
+}
+
+void usage(const char *prog) {
+  std::cerr << "Usage: " << prog
+            << " [-O0|-O1|-O2] [--dump-ir] [--report-peephole] "
+               "[--type-test-stats] [--alloc-stats] [--instrument-calls] "
+               "[--call-stacks STACKS] "
+               "[--usdt[=methods]] [--time-report[=json]] [--asm | --c] "
+               "EXE_FILE SRC_FILE..."
+            << std::endl
+            << "       " << prog
+            << " [-O0|-O1|-O2] [--dump-ir] [--report-peephole] "
+               "[--type-test-stats] [--alloc-stats] [--instrument-calls] "
+               "[--call-stacks STACKS] "
+               "[--usdt[=methods]] [--time-report[=json]] --run SRC_FILE..."
+            << std::endl
+            << "       " << prog
+            << " [--profile-generate PROFILE] [--profile-use PROFILE] "
+               "[--asm | --run] [EXE_FILE] SRC_FILE..."
+            << std::endl
+            << "       " << prog << " --bytecode BC_FILE SRC_FILE..."
+            << std::endl
+            << "       " << prog << " --vm SRC_FILE... | BC_FILE" << std::endl
+            << std::endl
+            << "  -O0, -O1, -O2  generate methods through the IR, optimized at "
+               "the given level"
+            << std::endl
+            << "  --dump-ir  print the IR of every method after each pass"
+            << std::endl
+            << "  --report-peephole  print how many instructions of every "
+               "method the peephole pass removed (there is none without "
+               "-O1/-O2)"
+            << std::endl
+            << "  --type-test-stats  print how often the compile-time type "
+               "tests of every dynamic dispatch found the class of the "
+               "receiver (hit) and how often the dispatch went through the "
+               "method table (miss) when the program exits"
+            << std::endl
+            << "  --alloc-stats  print how many objects of every class, and "
+               "how many bytes, the program allocated when it exits"
+            << std::endl
+            << "  --instrument-calls  print how often every method was "
+               "called, and the cycles spent in it with and without its "
+               "callees, when the program exits"
+            << std::endl
+            << "  --call-stacks  also write the cycles spent in every call "
+               "stack to STACKS, collapsed for flame graphs"
+            << std::endl
+            << "  --usdt  put SystemTap probes in allocation, IO and "
+               "errors, and with =methods at method entries"
+            << std::endl
+            << "  --time-report  print the time, allocations and peak RSS of "
+               "every phase of the compiler, as JSON with =json"
+            << std::endl
+            << "  --profile-generate  count calls, receivers and branches, "
+               "and write them to PROFILE when the program exits"
+            << std::endl
+            << "  --profile-use  optimize for the counts in PROFILE" << std::endl
+            << "  --asm  write EXE_FILE.s and build it with gcc instead of "
+               "writing EXE_FILE.o directly"
+            << std::endl
+            << "  --c    write EXE_FILE.c and build it with gcc -O2" << std::endl
+            << "  --run  compile into memory and run the program in-process; "
+               "the exit status is that of Main.main"
+            << std::endl
+            << "  --bytecode  write the program as bytecode to BC_FILE"
+            << std::endl
+            << "  --vm   run the program, or a BC_FILE, in the bytecode "
+               "interpreter"
+            << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+x86::Object assemble(cool::CodeGenerator &cg) {
+  x86::Assembler assembler;
+  cg.generate([&](std::list<x86::Line> &lines) {
+    cool::Timer timer("assemble");
+    assembler.add(lines);
+  });
+  cool::Timer timer("assemble");
+  return assembler.finish();
+}
+
 int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " EXE_FILE SRC_FILE..."
-              << std::endl;
-    exit(EXIT_FAILURE);
+  bool via_asm = false;
+  bool via_c = false;
+  bool run = false;
+  bool bytecode = false;
+  bool vm = false;
+  cool::Options options;
+  std::string profile_filename;
+  bool time_report = false;
+  static bool time_report_json = false;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    std::string opt(argv[i]);
+    if (opt == "-O0" || opt == "-O1" || opt == "-O2") {
+      options.opt_level = opt[2] - '0';
+      options.peephole = options.opt_level > 0;
+    } else if (opt == "--dump-ir") {
+      options.dump_ir = true;
+    } else if (opt == "--report-peephole") {
+      options.report_peephole = true;
+    } else if (opt == "--type-test-stats") {
+      options.type_test_stats = true;
+    } else if (opt == "--alloc-stats") {
+      options.alloc_stats = true;
+    } else if (opt == "--instrument-calls") {
+      options.instrument_calls = true;
+    } else if (opt == "--call-stacks" && i + 1 < argc) {
+      options.instrument_calls = true;
+      options.call_stacks = argv[++i];
+    } else if (opt == "--usdt" || opt == "--usdt=methods") {
+      options.usdt = true;
+      options.usdt_methods = opt == "--usdt=methods";
+    } else if (opt == "--time-report" || opt == "--time-report=json") {
+      time_report = true;
+      time_report_json = opt == "--time-report=json";
+    } else if ((opt == "--profile-generate" || opt == "--profile-use") &&
+               i + 1 < argc) {
+      if (opt == "--profile-generate") {
+        options.profile_generate = argv[++i];
+      } else {
+        profile_filename = argv[++i];
+      }
+    } else if (opt == "--asm") {
+      via_asm = true;
+    } else if (opt == "--c") {
+      via_c = true;
+    } else if (opt == "--run") {
+      run = true;
+    } else if (opt == "--bytecode") {
+      bytecode = true;
+    } else if (opt == "--vm") {
+      vm = true;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  bool in_process = run || vm;
+  bool profiling =
+      !options.profile_generate.empty() || !profile_filename.empty();
+  if (argc - i < (in_process ? 1 : 2) ||
+      via_asm + via_c + run + bytecode + vm > 1 ||
+      (profiling && (options.opt_level >= 0 || options.dump_ir || via_c ||
+                     bytecode || vm)) ||
+      ((options.type_test_stats || options.alloc_stats || options.instrument_calls ||
+        options.usdt) &&
+       (via_c || bytecode || vm))) {
+    usage(argv[0]);
   }
 
-  std::string exe_filename(argv[1]);
-  std::string asm_filename = exe_filename + ".s";
-  std::ofstream o(asm_filename);
+  if (vm && argc - i == 1) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (in && vm::is_bytecode(in)) {
+      vm::Program program;
+      program.load(in);
+      return vm::run(program);
+    }
+  }
+
+  std::string exe_filename;
+  if (!in_process) {
+    exe_filename = argv[i++];
+  }
 
   std::vector<std::string> src_filenames;
-  for (int i = 2; i < argc; i++) {
+  for (; i < argc; i++) {
     src_filenames.emplace_back(argv[i]);
   }
 
+  if (time_report) {
+    cool::Timer::enable();
+    std::atexit([] { cool::Timer::report(std::cerr, time_report_json); });
+  }
+
   auto parser = cool::Parser(src_filenames);
-  parser.parse();
+  {
+    cool::Timer timer("parse");
+    parser.parse();
+  }
   // parser.program->print(std::cout);
 
   auto sa = cool::SemanticAnalyser(parser.program.get());
   sa.analyse();
   // sa.objectClass->print_hierarchy(std::cout);
+  {
+    cool::Timer timer("fold");
+    parser.program->fold();
+  }
+  {
+    cool::Timer timer("non-void analysis");
+    cool::NonVoidAnalyser(parser.program.get(), &sa).analyse();
+  }
+
+  if (vm || bytecode) {
+    vm::Program program;
+    {
+      cool::Timer timer("generate");
+      program = vm::Compiler(parser.program.get(), &sa).compile();
+    }
+    if (vm) {
+      return vm::run(program);
+    }
+    std::ofstream o(exe_filename, std::ios::binary);
+    program.save(o);
+    return 0;
+  }
+
+  if (via_c) {
+    std::string c_filename = exe_filename + ".c";
+    std::ofstream o(c_filename);
+    {
+      cool::Timer timer("generate");
+      csrc::Translator(parser.program.get(), &sa).translate(o);
+    }
+
+    o.close(); // !!!
+
+    return build_c(exe_filename, c_filename);
+  }
+
+  if (options.dump_ir && options.opt_level < 0) {
+    options.opt_level = 0;
+  }
+  cool::Profile profile_used;
+  if (!profile_filename.empty()) {
+    profile_used.load(profile_filename);
+    options.profile = &profile_used;
+  }
+  auto cg = cool::CodeGenerator(parser.program.get(), &sa, options);
+
+  if (run) {
+    auto obj = assemble(cg);
+    return jit::run(obj);
+  }
+
+  if (via_asm) {
+    std::string asm_filename = exe_filename + ".s";
+    std::ofstream o(asm_filename);
+    cg.generate(o);
 
-  auto cg = cool::CodeGenerator(parser.program.get(), &sa);
-  cg.generate(o);
+    o.close(); // !!!
+
+    return build(exe_filename, asm_filename);
+  }
+
+  auto obj = assemble(cg);
+
+  std::string obj_filename = exe_filename + ".o";
+  std::ofstream o(obj_filename, std::ios::binary);
+  {
+    cool::Timer timer("write object");
+    elf::write_object(o, obj);
+  }
 
   o.close(); // !!!
 
-  return build(exe_filename, asm_filename);
+  return link(exe_filename, obj_filename);
 }
@@ -0,0 +1,208 @@
+#include "nonvoid.hh"
+
+namespace cool {
+
+void NonVoidAnalyser::analyse() {
+  for (auto &cls : program->classes) {
+    analyse(cls.get());
+  }
+}
+
+void NonVoidAnalyser::analyse(ast::Class *cls) {
+  do {
+    changed = false;
+
+    scope.enter();
+    for (auto c = cls; c; c = c->parent) {
+      for (auto &field : c->name2Field) {
+        scope.add(field.first, is_basic(field.second->type_name) ? &always
+                                                                 : &never);
+      }
+    }
+    scope.add("self", &always);
+
+    for (auto &feature : cls->features) {
+      auto method = std::dynamic_pointer_cast<ast::Method>(feature);
+      if (method) {
+        scope.enter();
+        for (auto &formal : method->formals) {
+          scope.add(formal->name,
+                    is_basic(formal->type_name) ? &always : &never);
+        }
+        method->expr->non_void(this);
+        scope.exit();
+      }
+      auto field = std::dynamic_pointer_cast<ast::Field>(feature);
+      if (field) {
+        field->expr->non_void(this);
+      }
+    }
+    scope.exit();
+  } while (changed);
+}
+
+bool NonVoidAnalyser::is_basic(const std::string &type_name) {
+  return type_name == "Int" || type_name == "String" || type_name == "Bool";
+}
+
+bool NonVoidAnalyser::returns_non_void(ast::Invoke *invoke) {
+  auto cls = invoke->type_sa->get_method_class(invoke->name);
+  if (is_basic(cls->name2Method[invoke->name]->ret_type_name)) {
+    return true;
+  }
+  // built-in methods return objects, or do not return; but the elements of
+  // an Array may be void
+  if (cls == sa->arrayClass.get() && invoke->name == "get") {
+    return false;
+  }
+  for (auto &builtin : sa->builtin) {
+    if (builtin.get() == cls) {
+      return invoke->target_class() != nullptr;
+    }
+  }
+  return false;
+}
+
+void NonVoidAnalyser::assigned(const std::string &name, bool non_void) {
+  auto var = scope.find(name);
+  if (var && *var && !non_void && var != &always) {
+    *var = false;
+    changed = true;
+  }
+}
+
+} // namespace cool
+
+namespace ast {
+
+bool Assign::non_void(cool::NonVoidAnalyser *nva) {
+  auto res = expr->non_void(nva);
+  nva->assigned(name, res);
+  return res;
+}
+
+bool Invoke::non_void(cool::NonVoidAnalyser *nva) {
+  for (auto &arg : arguments) {
+    arg->non_void(nva);
+  }
+  receiver_non_void = expr_sa->non_void(nva);
+  return nva->returns_non_void(this);
+}
+
+bool If::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  auto b_non_void = b->non_void(nva);
+  auto c_non_void = c->non_void(nva);
+  return b_non_void && c_non_void;
+}
+
+bool While::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return false;
+}
+
+bool Block::non_void(cool::NonVoidAnalyser *nva) {
+  bool res = false;
+  for (auto &expr : expressions) {
+    res = expr->non_void(nva);
+  }
+  return res;
+}
+
+bool Let::non_void(cool::NonVoidAnalyser *nva) {
+  if (!expr->non_void(nva)) {
+    var_non_void = false;
+  }
+  nva->scope.enter();
+  nva->scope.add(name, nva->is_basic(type_name) ? &nva->always : &var_non_void);
+  auto res = body->non_void(nva);
+  nva->scope.exit();
+  return res;
+}
+
+bool Case::non_void(cool::NonVoidAnalyser *nva) {
+  expr_non_void = expr->non_void(nva);
+  bool res = true;
+  for (auto &branch : branches) {
+    nva->scope.enter();
+    nva->scope.add(branch->name, nva->is_basic(branch->type_name)
+                                     ? &nva->always
+                                     : &branch->var_non_void);
+    res = branch->expr->non_void(nva) && res;
+    nva->scope.exit();
+  }
+  return res;
+}
+
+bool New::non_void(cool::NonVoidAnalyser *nva) { return true; }
+
+bool IsVoid::non_void(cool::NonVoidAnalyser *nva) {
+  expr->non_void(nva);
+  return true;
+}
+
+bool Add::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool Sub::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool Mul::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool Div::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool Neg::non_void(cool::NonVoidAnalyser *nva) {
+  expr->non_void(nva);
+  return true;
+}
+
+bool LessThan::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool Equal::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool LessOrEqual::non_void(cool::NonVoidAnalyser *nva) {
+  a->non_void(nva);
+  b->non_void(nva);
+  return true;
+}
+
+bool Not::non_void(cool::NonVoidAnalyser *nva) {
+  expr->non_void(nva);
+  return true;
+}
+
+bool Var::non_void(cool::NonVoidAnalyser *nva) {
+  auto var = nva->scope.find(name);
+  return var && *var;
+}
+
+bool IntConst::non_void(cool::NonVoidAnalyser *nva) { return true; }
+
+bool StrConst::non_void(cool::NonVoidAnalyser *nva) { return true; }
+
+bool BoolConst::non_void(cool::NonVoidAnalyser *nva) { return true; }
+
+} /* namespace ast */
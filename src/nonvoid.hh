@@ -0,0 +1,50 @@
+#ifndef _NONVOID_HH
+#define _NONVOID_HH
+
+#include "ast.hh"
+#include "sa.hh"
+
+/*
+ * Finds the receivers of dispatches and the expressions of cases that
+ * cannot be void, so that backends can leave out the checks for them.
+ *
+ * Int, String and Bool values, self, new objects and variables bound by a
+ * case are never void. A variable declared by let is not void if its
+ * initial value is not and nothing it is assigned may be; as assignments
+ * can come after uses (in loops), the methods of a class are analysed again
+ * until no such variable is found to be assigned a value that may be void.
+ */
+
+namespace cool {
+
+class NonVoidAnalyser {
+public:
+  NonVoidAnalyser(ast::Program *program, SemanticAnalyser *sa)
+      : always(true), never(false), program(program), sa(sa) {}
+
+  void analyse();
+
+  // --- used by ast::*::non_void ---
+
+  bool is_basic(const std::string &type_name);
+  // whether the method `invoke` calls never returns void
+  bool returns_non_void(ast::Invoke *invoke);
+  // `name` is assigned a value, which may be void unless `non_void`
+  void assigned(const std::string &name, bool non_void);
+
+  // whether variables in scope are not void
+  Scope<bool *> scope;
+  bool always, never;
+
+  bool changed;
+
+private:
+  ast::Program *program;
+  SemanticAnalyser *sa;
+
+  void analyse(ast::Class *cls);
+};
+
+} // namespace cool
+
+#endif /* _NONVOID_HH */
@@ -0,0 +1,435 @@
+#include "ir.hh"
+
+#include <algorithm>
+#include <tuple>
+
+namespace ir {
+
+namespace {
+
+// number of definitions of every temporary
+std::vector<int> count_defs(Function &f) {
+  std::vector<int> defs(f.temps.size());
+  for (auto &b : f.blocks) {
+    for (auto &instr : b.instrs) {
+      if (instr.dst >= 0) {
+        defs[instr.dst]++;
+      }
+    }
+  }
+  return defs;
+}
+
+// the definitions of temporaries defined once
+std::map<int, Instr *> single_defs(Function &f, const std::vector<int> &defs) {
+  std::map<int, Instr *> res;
+  for (auto &b : f.blocks) {
+    for (auto &instr : b.instrs) {
+      if (instr.dst >= 0 && defs[instr.dst] == 1) {
+        res[instr.dst] = &instr;
+      }
+    }
+  }
+  return res;
+}
+
+void replace(Instr &instr, Opcode op, std::vector<int> args, int64_t imm = 0) {
+  instr.op = op;
+  instr.args = args;
+  instr.imm = imm;
+}
+
+// whether folding `op` on constants is safe, and its value
+bool fold(Opcode op, int64_t x, int64_t y, int64_t &res) {
+  switch (op) {
+  case ADD:
+    res = (uint64_t)x + (uint64_t)y;
+    return true;
+  case SUB:
+    res = (uint64_t)x - (uint64_t)y;
+    return true;
+  case MUL:
+    res = (uint64_t)x * (uint64_t)y;
+    return true;
+  case DIV:
+    // leave the traps to run time
+    if (y == 0 || (x == INT64_MIN && y == -1)) {
+      return false;
+    }
+    res = x / y;
+    return true;
+  case NEG:
+    res = -(uint64_t)x;
+    return true;
+  case LT:
+    res = x < y;
+    return true;
+  case LE:
+    res = x <= y;
+    return true;
+  case EQ:
+    res = x == y;
+    return true;
+  case NOT:
+    res = !x;
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+/*
+ * Folds operations on constants, identities (x + 0, x * 1, ...), unboxing
+ * of freshly boxed values, isvoid of objects that cannot be void and
+ * branches on constants. Constant factors and divisors become the imm of
+ * MUL_IMM and DIV_IMM.
+ */
+bool constant_folding(Function &f) {
+  auto defs = count_defs(f);
+  auto def = single_defs(f, defs);
+
+  bool changed = false;
+  for (auto &b : f.blocks) {
+    // constants assigned to temporaries defined more than once, until the
+    // next assignment
+    std::map<int, int64_t> local;
+    auto constant = [&](int t, int64_t &v) {
+      if (defs[t] == 1 && def[t]->op == CONST) {
+        v = def[t]->imm;
+        return true;
+      }
+      if (local.count(t)) {
+        v = local[t];
+        return true;
+      }
+      return false;
+    };
+
+    for (auto &instr : b.instrs) {
+      int64_t x, y, v;
+      bool cx = instr.args.size() > 0 && constant(instr.args[0], x);
+      bool cy = instr.args.size() > 1 && constant(instr.args[1], y);
+
+      switch (instr.op) {
+      case MOV:
+        if (cx) {
+          replace(instr, CONST, {}, x);
+          changed = true;
+        }
+        break;
+      case ADD:
+      case SUB:
+      case MUL:
+      case DIV:
+      case LT:
+      case LE:
+      case EQ:
+        if (cx && cy && fold(instr.op, x, y, v)) {
+          replace(instr, CONST, {}, v);
+          changed = true;
+        } else if (cy && ((y == 0 && (instr.op == ADD || instr.op == SUB)) ||
+                          (y == 1 && (instr.op == MUL || instr.op == DIV)))) {
+          replace(instr, MOV, {instr.args[0]});
+          changed = true;
+        } else if (cx && x == 0 && instr.op == ADD) {
+          replace(instr, MOV, {instr.args[1]});
+          changed = true;
+        } else if (cx && x == 1 && instr.op == MUL) {
+          replace(instr, MOV, {instr.args[1]});
+          changed = true;
+        } else if (cy && (instr.op == MUL || instr.op == DIV)) {
+          // the constant need not live in a temporary
+          replace(instr, instr.op == MUL ? MUL_IMM : DIV_IMM,
+                  {instr.args[0]}, y);
+          changed = true;
+        } else if (cx && instr.op == MUL) {
+          replace(instr, MUL_IMM, {instr.args[1]}, x);
+          changed = true;
+        }
+        break;
+      case MUL_IMM:
+      case DIV_IMM:
+        if (cx && fold(instr.op == MUL_IMM ? MUL : DIV, x, instr.imm, v)) {
+          replace(instr, CONST, {}, v);
+          changed = true;
+        } else if (instr.imm == 1) {
+          replace(instr, MOV, {instr.args[0]});
+          changed = true;
+        } else if (instr.imm == 0 && instr.op == MUL_IMM) {
+          replace(instr, CONST, {}, 0);
+          changed = true;
+        }
+        break;
+      case NEG:
+      case NOT:
+        if (cx && fold(instr.op, x, 0, v)) {
+          replace(instr, CONST, {}, v);
+          changed = true;
+        }
+        break;
+      case UNBOX: {
+        auto a = instr.args[0];
+        if (defs[a] == 1 && def[a]->op == BOX) {
+          replace(instr, MOV, {def[a]->args[0]});
+          changed = true;
+        }
+        break;
+      }
+      case ISVOID: {
+        auto a = instr.args[0];
+        if (cx) {
+          replace(instr, CONST, {}, x == 0);
+          changed = true;
+        } else if (defs[a] == 1 &&
+                   (def[a]->op == BOX || def[a]->op == OBJ_CONST ||
+                    def[a]->op == SELF || def[a]->op == ALLOC)) {
+          replace(instr, CONST, {}, 0);
+          changed = true;
+        }
+        break;
+      }
+      case BRANCH:
+        if (cx || instr.target[0] == instr.target[1]) {
+          auto target = cx && !x ? instr.target[1] : instr.target[0];
+          replace(instr, JUMP, {});
+          instr.target[0] = target;
+          instr.target[1] = -1;
+          changed = true;
+        }
+        break;
+      default:
+        break;
+      }
+
+      if (instr.dst >= 0) {
+        if (instr.op == CONST) {
+          local[instr.dst] = instr.imm;
+        } else {
+          local.erase(instr.dst);
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+/*
+ * Replaces uses of copies by the originals. A temporary defined once as a
+ * copy of another temporary defined once is replaced everywhere; others
+ * only until either is assigned again within the block.
+ */
+bool copy_propagation(Function &f) {
+  auto defs = count_defs(f);
+  auto def = single_defs(f, defs);
+
+  std::map<int, int> global;
+  for (auto &d : def) {
+    if (d.second->op == MOV && defs[d.second->args[0]] == 1) {
+      global[d.first] = d.second->args[0];
+    }
+  }
+  auto resolve = [&](int t) {
+    while (global.count(t)) {
+      t = global[t];
+    }
+    return t;
+  };
+
+  bool changed = false;
+  for (auto &b : f.blocks) {
+    std::map<int, int> local;
+    for (auto &instr : b.instrs) {
+      for (auto &arg : instr.args) {
+        auto t = resolve(arg);
+        if (local.count(t)) {
+          t = local[t];
+        }
+        if (t != arg) {
+          arg = t;
+          changed = true;
+        }
+      }
+
+      if (instr.dst >= 0) {
+        for (auto it = local.begin(); it != local.end();) {
+          if (it->first == instr.dst || it->second == instr.dst) {
+            it = local.erase(it);
+          } else {
+            ++it;
+          }
+        }
+        if (instr.op == MOV && instr.args[0] != instr.dst) {
+          local[instr.dst] = instr.args[0];
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+/*
+ * Removes unreachable blocks, self copies and pure instructions whose
+ * results are never used.
+ */
+bool dead_code_elimination(Function &f) {
+  bool changed = false;
+
+  std::vector<bool> reachable(f.blocks.size());
+  std::list<int> work = {0};
+  reachable[0] = true;
+  while (!work.empty()) {
+    auto b = work.front();
+    work.pop_front();
+    auto &last = f.blocks[b].instrs.back();
+    for (auto t : last.target) {
+      if (t >= 0 && !reachable[t]) {
+        reachable[t] = true;
+        work.push_back(t);
+      }
+    }
+  }
+  for (int i = 0; i < f.blocks.size(); ++i) {
+    if (!reachable[i] && f.blocks[i].reachable) {
+      f.blocks[i].reachable = false;
+      f.blocks[i].instrs.clear();
+      changed = true;
+    }
+  }
+
+  for (bool again = true; again;) {
+    again = false;
+
+    std::vector<int> uses(f.temps.size());
+    for (auto &b : f.blocks) {
+      for (auto &instr : b.instrs) {
+        for (auto arg : instr.args) {
+          uses[arg]++;
+        }
+      }
+    }
+
+    for (auto &b : f.blocks) {
+      auto &instrs = b.instrs;
+      auto size = instrs.size();
+      instrs.erase(std::remove_if(instrs.begin(), instrs.end(),
+                                  [&](const Instr &instr) {
+                                    return instr.is_pure() &&
+                                           (uses[instr.dst] == 0 ||
+                                            (instr.op == MOV &&
+                                             instr.args[0] == instr.dst));
+                                  }),
+                   instrs.end());
+      again |= instrs.size() != size;
+    }
+    changed |= again;
+  }
+  return changed;
+}
+
+/*
+ * Local value numbering: a pure instruction computing what an earlier one
+ * in the same block already has becomes a copy. Arguments are looked
+ * through copies made earlier in the block, the new ones included, so that
+ * what depends on a removed expression goes too. Field loads are forgotten
+ * at stores and calls.
+ */
+bool common_subexpression_elimination(Function &f) {
+  typedef std::tuple<Opcode, std::vector<int>, int64_t, std::string> Key;
+
+  bool changed = false;
+  for (auto &b : f.blocks) {
+    std::map<Key, int> available;
+    std::map<int, int> copies; // until either is assigned again
+    auto original = [&](int t) { return copies.count(t) ? copies[t] : t; };
+
+    for (auto &instr : b.instrs) {
+      bool candidate = instr.is_pure() && instr.op != MOV;
+      std::vector<int> args;
+      for (auto arg : instr.args) {
+        args.push_back(original(arg));
+      }
+      Key key(instr.op, args, instr.imm, instr.sym);
+      if (candidate && available.count(key) &&
+          f.temps[available[key]] == f.temps[instr.dst]) {
+        replace(instr, MOV, {available[key]});
+        changed = true;
+        candidate = false;
+      }
+
+      if (instr.op == SET_FIELD || instr.op == CALL || instr.op == DISPATCH ||
+          instr.op == ALLOC) {
+        for (auto it = available.begin(); it != available.end();) {
+          if (std::get<0>(it->first) == FIELD) {
+            it = available.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+
+      if (instr.dst >= 0) {
+        for (auto it = available.begin(); it != available.end();) {
+          auto &used = std::get<1>(it->first);
+          if (it->second == instr.dst ||
+              std::find(used.begin(), used.end(), instr.dst) != used.end()) {
+            it = available.erase(it);
+          } else {
+            ++it;
+          }
+        }
+        for (auto it = copies.begin(); it != copies.end();) {
+          if (it->first == instr.dst || it->second == instr.dst) {
+            it = copies.erase(it);
+          } else {
+            ++it;
+          }
+        }
+        if (candidate &&
+            std::find(args.begin(), args.end(), instr.dst) == args.end()) {
+          available[key] = instr.dst;
+        }
+        if (instr.op == MOV) {
+          auto t = original(instr.args[0]);
+          if (t != instr.dst) {
+            copies[instr.dst] = t;
+          }
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+PassManager::PassManager(int level, std::ostream *dump) : dump(dump) {
+  if (level >= 1) {
+    passes.emplace_back("constant folding", constant_folding);
+    passes.emplace_back("copy propagation", copy_propagation);
+  }
+  if (level >= 2) {
+    passes.emplace_back("common subexpression elimination",
+                        common_subexpression_elimination);
+    passes.emplace_back("copy propagation", copy_propagation);
+    passes.emplace_back("constant folding", constant_folding);
+  }
+  if (level >= 1) {
+    passes.emplace_back("dead code elimination", dead_code_elimination);
+  }
+}
+
+void PassManager::run(Function &f) {
+  if (dump) {
+    *dump << "# lowered\n";
+    f.print(*dump);
+  }
+  for (auto &pass : passes) {
+    pass.second(f);
+    if (dump) {
+      *dump << "# after " << pass.first << "\n";
+      f.print(*dump);
+    }
+  }
+}
+
+} /* namespace ir */
@@ -0,0 +1,234 @@
+#include "x86.hh"
+
+/*
+ * A peephole pass over the instructions of one function, as emitted by
+ * cool::CodeGenerator. Patterns only look at neighbouring instructions
+ * within a basic block, and are applied until none matches:
+ *
+ *   pushq A; popq B            ->  movq A, B (nothing if A is B)
+ *   movq R, M; movq M, R       ->  movq R, M
+ *   movq M, R; movq R, M       ->  movq M, R
+ *   movq R, R                  ->
+ *   movq X, R; ...; movq Y, R  ->  ...; movq Y, R (R not read in between)
+ *   addq $0, X                 ->  (the flags are overwritten before use)
+ *   jmp L; L:                  ->  L:
+ *   jmp L; <instructions>      ->  jmp L (up to the next label)
+ */
+
+namespace x86 {
+
+namespace {
+
+typedef std::list<Line>::iterator Iterator;
+
+// `name` is a literal, which is compared without making a std::string
+bool is(const Line &line, const char *name, size_t n) {
+  return line.kind == Line::INSTRUCTION && line.name == name &&
+         line.operands.size() == n;
+}
+
+bool is_jump(const Line &line) {
+  return is(line, "jmp", 1) || is(line, "jmpq", 1);
+}
+
+// whether `op` reads register `r` (as a value or in an address)
+bool reads(const Operand &op, int r) {
+  return (op.kind == Operand::REG && op.reg == r) ||
+         (op.kind == Operand::MEM && (op.base == r || op.index == r));
+}
+
+bool is_reg(const Operand &op) { return op.kind == Operand::REG && op.size == 8; }
+
+// a side-effect-free instruction whose only effect is setting a register
+bool only_sets_reg(const Line &line) {
+  return (is(line, "movq", 2) || is(line, "movabsq", 2) ||
+          is(line, "leaq", 2)) &&
+         is_reg(line.operands[1]) && line.operands[1].reg != RSP &&
+         !line.operands[0].indirect;
+}
+
+// whether `line` sets the whole of register `r` without reading it
+bool overwrites(const Line &line, int r) {
+  if (only_sets_reg(line)) {
+    return line.operands[1].reg == r && !reads(line.operands[0], r);
+  }
+  return is(line, "popq", 1) && line.operands[0].is_reg(r);
+}
+
+// whether `line` may read register `r`; calls and returns read everything
+bool may_read(const Line &line, int r) {
+  auto &m = line.name;
+  if (m == "call" || m == "callq" || m == "ret" || m == "retq" ||
+      m == "leave" || m == "leaveq") {
+    return true;
+  }
+  if ((m == "cqto" || m == "cqo" || m == "idivq" || m == "divq" ||
+       m == "mulq" || (m == "imulq" && line.operands.size() == 1)) &&
+      (r == RAX || r == RDX)) {
+    return true;
+  }
+  if (overwrites(line, r)) {
+    return false;
+  }
+  for (auto &op : line.operands) {
+    if (reads(op, r)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool reads_flags(const Line &line) {
+  auto &m = line.name;
+  return m[0] == 'j' ? !is_jump(line)
+                     : m.compare(0, 3, "set") == 0 ||
+                           m.compare(0, 4, "cmov") == 0 ||
+                           m.compare(0, 3, "adc") == 0 ||
+                           m.compare(0, 3, "sbb") == 0;
+}
+
+bool writes_flags(const Line &line) {
+  for (auto m : {"cmpq", "testq", "addq", "subq", "andq", "orq", "xorq"}) {
+    if (line.name == m) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// whether the flags set by `it` are overwritten before anything reads them;
+// labels and jumps end the search pessimistically
+bool flags_dead(Iterator it, Iterator end) {
+  for (++it; it != end && it->kind == Line::INSTRUCTION; ++it) {
+    if (reads_flags(*it) || is_jump(*it)) {
+      return false;
+    }
+    if (writes_flags(*it) || it->name == "call" || it->name == "callq" ||
+        it->name == "ret" || it->name == "retq") {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool is_instruction(Iterator it, Iterator end) {
+  return it != end && it->kind == Line::INSTRUCTION;
+}
+
+// call frame information within a function, which dead code may follow
+bool is_cfi(Iterator it, Iterator end) {
+  return it != end && it->kind == Line::DIRECTIVE &&
+         it->name.compare(0, 5, ".cfi_") == 0 && it->name != ".cfi_endproc";
+}
+
+// whether register `r`, set by `it`, is set again before anything reads it
+// within the basic block
+bool reg_dead(Iterator it, Iterator end, int r) {
+  for (++it; is_instruction(it, end); ++it) {
+    if (may_read(*it, r) || reads_flags(*it) || is_jump(*it)) {
+      return false;
+    }
+    if (overwrites(*it, r)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// try the patterns at `it`; returns how many instructions went away
+int match(std::list<Line> &lines, Iterator &it, Iterator end) {
+  auto next = std::next(it);
+
+  if (is(*it, "movq", 2) && it->operands[0] == it->operands[1]) {
+    it = lines.erase(it);
+    return 1;
+  }
+  if ((is(*it, "addq", 2) || is(*it, "subq", 2)) &&
+      it->operands[0].kind == Operand::IMM && it->operands[0].value == 0 &&
+      it->operands[0].symbol.empty() && flags_dead(it, end)) {
+    it = lines.erase(it);
+    return 1;
+  }
+
+  if (only_sets_reg(*it) && reg_dead(it, end, it->operands[1].reg)) {
+    it = lines.erase(it);
+    return 1;
+  }
+  if (is(*it, "xorq", 2) && it->operands[0] == it->operands[1] &&
+      is_reg(it->operands[0]) && reg_dead(it, end, it->operands[0].reg) &&
+      flags_dead(it, end)) {
+    it = lines.erase(it);
+    return 1;
+  }
+
+  if (is_jump(*it) || is(*it, "ret", 0) || is(*it, "retq", 0)) {
+    int n = 0;
+    // the call frame information of the code after an epilogue stays
+    while (is_instruction(next, end) || is_cfi(next, end)) {
+      if (next->kind == Line::INSTRUCTION) {
+        next = lines.erase(next);
+        n++;
+      } else {
+        ++next;
+      }
+    }
+    if (is_jump(*it) && next != end && next->kind == Line::LABEL &&
+        it->operands[0].is_plain_symbol() && it->operands[0].value == 0 &&
+        it->operands[0].symbol == next->name) {
+      it = lines.erase(it);
+      n++;
+    }
+    return n;
+  }
+
+  if (!is_instruction(next, end)) {
+    return 0;
+  }
+  auto &a = *it, &b = *next;
+
+  if (is(a, "pushq", 1) && is(b, "popq", 1) && !a.operands[0].indirect) {
+    auto src = a.operands[0], dst = b.operands[0];
+    if (src == dst) {
+      lines.erase(next);
+      it = lines.erase(it);
+      return 2;
+    }
+    if ((is_reg(src) || is_reg(dst)) && !reads(dst, RSP)) {
+      lines.erase(next);
+      it->name = "movq";
+      it->operands = {src, dst};
+      return 1;
+    }
+  }
+
+  if (is(a, "movq", 2) && is(b, "movq", 2) &&
+      a.operands[0] == b.operands[1] && a.operands[1] == b.operands[0] &&
+      (is_reg(a.operands[0]) || is_reg(a.operands[1]))) {
+    lines.erase(next);
+    return 1;
+  }
+
+  return 0;
+}
+
+} // namespace
+
+int peephole(std::list<Line> &lines, Iterator begin, Iterator end) {
+  int eliminated = 0;
+  for (bool again = true; again;) {
+    again = false;
+    // `begin` is the label of the function, which stays
+    for (auto it = std::next(begin); it != end;) {
+      int n = match(lines, it, end);
+      if (n) {
+        eliminated += n;
+        again = true;
+      } else {
+        ++it;
+      }
+    }
+  }
+  return eliminated;
+}
+
+} /* namespace x86 */
@@ -0,0 +1,40 @@
+#include "profile.hh"
+
+#include <fstream>
+
+namespace cool {
+
+void Profile::load(const std::string &filename) {
+  std::ifstream in(filename);
+  if (!in) {
+    throw ProfileError("fail to open " + filename);
+  }
+
+  std::string line;
+  for (int no = 1; std::getline(in, line); ++no) {
+    if (line.empty()) {
+      continue;
+    }
+    auto space = line.rfind(' ');
+    size_t end = 0;
+    int64_t n = -1;
+    if (space != std::string::npos && space > 0) {
+      try {
+        n = std::stoll(line.substr(space + 1), &end);
+      } catch (std::logic_error &) {
+      }
+    }
+    if (n < 0 || space + 1 + end != line.size()) {
+      throw ProfileError(filename + ":" + std::to_string(no) +
+                         ": invalid profile line");
+    }
+    counts[line.substr(0, space)] += n;
+  }
+}
+
+int64_t Profile::count(const std::string &key) const {
+  auto it = counts.find(key);
+  return it == counts.end() ? 0 : it->second;
+}
+
+} // namespace cool
@@ -0,0 +1,44 @@
+#ifndef _PROFILE_HH
+#define _PROFILE_HH
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+/*
+ * The counts a program built with --profile-generate writes at exit, one
+ * per line as `KIND SITE [WHAT] COUNT`:
+ *
+ *   method Main.main 1               entries of a method
+ *   call a.cl:12.9-17 B 90           receivers of class B at a dispatch
+ *   if a.cl:20.5-24.6 then 90        arms taken (then, else)
+ *   while a.cl:30.5-33.9 body 1000   iterations
+ *   case a.cl:40.5-44.9 B 7          branches taken, by type
+ *
+ * Sites are named by where they are in the source, so a profile applies to
+ * the program it was collected from, compiled from the same paths. Counts
+ * of the same key add up: profiles of several runs can be concatenated.
+ */
+
+namespace cool {
+
+class ProfileError : public std::runtime_error {
+public:
+  ProfileError(const std::string &what_arg) : std::runtime_error(what_arg) {}
+};
+
+class Profile {
+public:
+  void load(const std::string &filename);
+
+  // 0 if not in the profile
+  int64_t count(const std::string &key) const;
+
+private:
+  std::map<std::string, int64_t> counts;
+};
+
+} // namespace cool
+
+#endif /* _PROFILE_HH */
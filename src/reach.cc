@@ -0,0 +1,177 @@
+#include "reach.hh"
+
+#include <algorithm>
+
+#include "cg.hh"
+
+namespace cool {
+
+namespace {
+
+bool conforms(ast::Class *cls, ast::Class *ancestor) {
+  for (; cls; cls = cls->parent) {
+    if (cls == ancestor) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+void ReachabilityAnalyser::analyse() {
+  // created by the runtime
+  instantiated(sa->intClass.get());
+  instantiated(sa->stringClass.get());
+  instantiated(sa->boolClass.get());
+  instantiated(sa->mainClass.get());
+  called(sa->mainClass.get(), "main");
+
+  while (!work.empty()) {
+    auto ref = work.back();
+    work.pop_back();
+    order.push_back(ref);
+
+    // built-in methods have no body
+    auto method = ref.first->name2Method[ref.second];
+    if (method->expr) {
+      auto n = work.size();
+      method->expr->reach(this);
+      std::reverse(work.begin() + n, work.end());
+    }
+  }
+}
+
+bool ReachabilityAnalyser::is_live(ast::Class *cls) {
+  return classes.count(cls);
+}
+
+bool ReachabilityAnalyser::is_live(ast::Class *cls, const std::string &name) {
+  return methods.count({cls, name});
+}
+
+void ReachabilityAnalyser::instantiated(ast::Class *cls) {
+  if (!classes.insert(cls).second) {
+    return;
+  }
+  called(cls, init_method_name);
+  called(cls, "copy"); // of the prototype
+  for (auto &d : dispatches) {
+    if (conforms(cls, d.first)) {
+      called(cls, d.second);
+    }
+  }
+}
+
+void ReachabilityAnalyser::dispatched(ast::Class *cls,
+                                      const std::string &name) {
+  if (!dispatches.insert({cls, name}).second) {
+    return;
+  }
+  for (auto live : classes) {
+    if (conforms(live, cls)) {
+      called(live, name);
+    }
+  }
+}
+
+void ReachabilityAnalyser::called(ast::Class *cls, const std::string &name) {
+  cls = cls->get_method_class(name);
+  if (methods.insert({cls, name}).second) {
+    work.push_back({cls, name});
+  }
+}
+
+} // namespace cool
+
+namespace ast {
+
+void Assign::reach(cool::ReachabilityAnalyser *ra) { expr->reach(ra); }
+
+void Invoke::reach(cool::ReachabilityAnalyser *ra) {
+  expr_sa->reach(ra);
+  for (auto &arg : arguments) {
+    arg->reach(ra);
+  }
+  // the backends call known targets directly, even if no object can
+  // receive the call
+  if (target_class()) {
+    ra->called(type_sa, name);
+  } else {
+    ra->dispatched(type_sa, name);
+  }
+}
+
+void If::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+  c->reach(ra);
+}
+
+void While::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Block::reach(cool::ReachabilityAnalyser *ra) {
+  for (auto &expr : expressions) {
+    expr->reach(ra);
+  }
+}
+
+void Let::reach(cool::ReachabilityAnalyser *ra) {
+  expr->reach(ra);
+  body->reach(ra);
+}
+
+void Case::reach(cool::ReachabilityAnalyser *ra) {
+  expr->reach(ra);
+  for (auto &branch : branches) {
+    branch->expr->reach(ra);
+  }
+}
+
+void New::reach(cool::ReachabilityAnalyser *ra) { ra->instantiated(type_sa); }
+
+void IsVoid::reach(cool::ReachabilityAnalyser *ra) { expr->reach(ra); }
+
+void Add::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Sub::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Mul::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Div::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Neg::reach(cool::ReachabilityAnalyser *ra) { expr->reach(ra); }
+
+void LessThan::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Equal::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void LessOrEqual::reach(cool::ReachabilityAnalyser *ra) {
+  a->reach(ra);
+  b->reach(ra);
+}
+
+void Not::reach(cool::ReachabilityAnalyser *ra) { expr->reach(ra); }
+
+} /* namespace ast */
@@ -0,0 +1,61 @@
+#ifndef _REACH_HH
+#define _REACH_HH
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ast.hh"
+#include "sa.hh"
+
+/*
+ * Finds the classes and methods reachable from Main.main, so that the code
+ * generator can leave the others out (rapid type analysis).
+ *
+ * A class is live once a reachable method creates one of it; Int, String,
+ * Bool and Main always are. A static dispatch reaches the method it names,
+ * a dynamic dispatch on static type T the method of every live class that
+ * conforms to T, including those that become live later. A method is
+ * identified by the class defining it.
+ *
+ * Methods are walked depth first from Main.main, callees in the order they
+ * are called, which gives a layout keeping callers and callees together.
+ */
+
+namespace cool {
+
+class ReachabilityAnalyser {
+public:
+  ReachabilityAnalyser(SemanticAnalyser *sa) : sa(sa) {}
+
+  // the classes must have been arranged
+  void analyse();
+
+  bool is_live(ast::Class *cls);
+  // whether method `name` defined by `cls` is
+  bool is_live(ast::Class *cls, const std::string &name);
+
+  // --- used by ast::*::reach ---
+
+  void instantiated(ast::Class *cls);
+  void dispatched(ast::Class *cls, const std::string &name);
+  // method `name` of `cls`, which may be inherited
+  void called(ast::Class *cls, const std::string &name);
+
+  typedef std::pair<ast::Class *, std::string> MethodRef;
+
+  // the reachable methods in the order they were walked
+  std::vector<MethodRef> order;
+
+private:
+  SemanticAnalyser *sa;
+
+  std::set<ast::Class *> classes;
+  std::set<MethodRef> methods, dispatches;
+  std::vector<MethodRef> work; // reached methods yet to be walked, a stack
+};
+
+} // namespace cool
+
+#endif /* _REACH_HH */
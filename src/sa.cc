@@ -2,6 +2,8 @@
 
 #include <iostream>
 
+#include "timer.hh"
+
 namespace cool {
 
 SemanticAnalyser::SemanticAnalyser(ast::Program *program)
@@ -65,8 +67,50 @@ SemanticAnalyser::SemanticAnalyser(ast::Program *program)
                   std::make_shared<ast::Formal>("x", "String")},
               "SELF_TYPE", std::shared_ptr<ast::Void>())});
 
+  clockClass = std::make_shared<ast::Class>(
+      "Clock", "",
+      std::list<std::shared_ptr<ast::Feature>>{
+          std::make_shared<ast::Method>(
+              "now_ns", std::list<std::shared_ptr<ast::Formal>>{}, "Int",
+              std::shared_ptr<ast::Void>()),
+          std::make_shared<ast::Method>(
+              "cycles", std::list<std::shared_ptr<ast::Formal>>{}, "Int",
+              std::shared_ptr<ast::Void>()),
+          std::make_shared<ast::Method>(
+              "cpu_time_ns", std::list<std::shared_ptr<ast::Formal>>{}, "Int",
+              std::shared_ptr<ast::Void>())});
+
+  // arrays of `element`, whose elements are void, or 0, at first
+  auto array_class = [](const std::string &name, const std::string &element) {
+    return std::make_shared<ast::Class>(
+        name, "",
+        std::list<std::shared_ptr<ast::Feature>>{
+            std::make_shared<ast::Method>(
+                "new_array",
+                std::list<std::shared_ptr<ast::Formal>>{
+                    std::make_shared<ast::Formal>("n", "Int")},
+                name, std::shared_ptr<ast::Void>()),
+            std::make_shared<ast::Method>(
+                "get",
+                std::list<std::shared_ptr<ast::Formal>>{
+                    std::make_shared<ast::Formal>("i", "Int")},
+                element, std::shared_ptr<ast::Void>()),
+            std::make_shared<ast::Method>(
+                "set",
+                std::list<std::shared_ptr<ast::Formal>>{
+                    std::make_shared<ast::Formal>("i", "Int"),
+                    std::make_shared<ast::Formal>("x", element)},
+                name, std::shared_ptr<ast::Void>()),
+            std::make_shared<ast::Method>(
+                "length", std::list<std::shared_ptr<ast::Formal>>{}, "Int",
+                std::shared_ptr<ast::Void>())});
+  };
+  arrayClass = array_class("Array", "Object");
+  intArrayClass = array_class("IntArray", "Int");
+
   builtin = std::vector<std::shared_ptr<ast::Class>>{
-      objectClass, stringClass, intClass, boolClass, ioClass};
+      objectClass, stringClass, intClass,   boolClass,
+      ioClass,     clockClass,  arrayClass, intArrayClass};
 }
 
 void SemanticAnalyser::error(const yy::location &loc, const std::string &msg) {
@@ -114,7 +158,8 @@ void SemanticAnalyser::build_and_check_class_hierarchy() {
     }
     auto parent = m.find(parent_name)->second;
     if (parent == this->stringClass || parent == this->intClass ||
-        parent == this->boolClass) {
+        parent == this->boolClass || parent == this->arrayClass ||
+        parent == this->intArrayClass) {
       error(cls->get_loc(), "invalid parent class \"" + parent_name + "\"");
       return;
     }
@@ -247,7 +292,12 @@ void SemanticAnalyser::check_type() {
 }
 
 void SemanticAnalyser::analyse() {
-  build_and_check_class_hierarchy();
+  Timer timer("analyse");
+  {
+    Timer timer("class hierarchy");
+    build_and_check_class_hierarchy();
+  }
+  Timer timer_check("type check");
   check_type();
 }
 
@@ -43,7 +43,7 @@ template <typename T> T Scope<T>::find(std::string k) {
       return m->operator[](k);
     }
   }
-  return nullptr;
+  return T();
 }
 
 class SemanticError : public std::runtime_error {
@@ -76,7 +76,7 @@ public:
   std::vector<std::shared_ptr<ast::Class>> builtin;
   std::shared_ptr<ast::Class> errorClass;
   std::shared_ptr<ast::Class> objectClass, stringClass, intClass, boolClass,
-      ioClass;
+      ioClass, clockClass, arrayClass, intArrayClass;
 
   std::vector<std::shared_ptr<ast::Class>> classes;
 
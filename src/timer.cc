@@ -0,0 +1,156 @@
+#include "timer.hh"
+
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+
+// counted by the replacement of operator new below
+uint64_t new_calls = 0, new_bytes = 0;
+
+} // namespace
+
+void *operator new(std::size_t size) {
+  new_calls++;
+  new_bytes += size;
+  void *p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+namespace cool {
+
+namespace {
+
+class Entry {
+public:
+  Entry(const std::string &path, const std::string &name, int depth)
+      : path(path), name(name), depth(depth), seconds(0), allocations(0),
+        allocated(0), max_rss(0) {}
+
+  std::string path; // names from the outermost phase, separated by '/'
+  std::string name;
+  int depth;
+  double seconds;
+  uint64_t allocations, allocated;
+  long max_rss; // KB
+};
+
+std::vector<Entry> &entries() {
+  static std::vector<Entry> entries;
+  return entries;
+}
+
+// the entries of the running timers, innermost last
+std::vector<int> &running() {
+  static std::vector<int> running;
+  return running;
+}
+
+long max_rss() {
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+} // namespace
+
+bool Timer::enabled = false;
+
+Timer::Timer(const std::string &phase) : entry(-1) {
+  if (!enabled) {
+    return;
+  }
+  auto path = running().empty() ? phase
+                                : entries()[running().back()].path + "/" + phase;
+  for (int i = 0; i < entries().size(); ++i) {
+    if (entries()[i].path == path) {
+      entry = i;
+    }
+  }
+  if (entry < 0) {
+    entry = entries().size();
+    entries().emplace_back(path, phase, running().size());
+  }
+  running().push_back(entry);
+
+  calls = new_calls;
+  bytes = new_bytes;
+  start = std::chrono::steady_clock::now();
+}
+
+Timer::~Timer() {
+  if (entry < 0) {
+    return;
+  }
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+  auto &e = entries()[entry];
+  e.seconds += d.count();
+  e.allocations += new_calls - calls;
+  e.allocated += new_bytes - bytes;
+  e.max_rss = max_rss();
+  running().pop_back();
+}
+
+void Timer::enable() {
+  enabled = true;
+  // constructed now, so that a report at exit comes before their destruction
+  entries();
+  running();
+}
+
+void Timer::report(std::ostream &o, bool json) {
+  double seconds = 0;
+  uint64_t allocations = 0, allocated = 0;
+  for (auto &e : entries()) {
+    if (e.depth == 0) {
+      seconds += e.seconds;
+      allocations += e.allocations;
+      allocated += e.allocated;
+    }
+  }
+
+  char buf[128];
+  if (json) {
+    o << "{\n  \"phases\": [\n";
+    for (int i = 0; i < entries().size(); ++i) {
+      auto &e = entries()[i];
+      std::snprintf(buf, sizeof(buf),
+                    "\"seconds\": %.6f, \"allocations\": %lu, \"bytes\": %lu, "
+                    "\"max_rss_kb\": %ld}",
+                    e.seconds, e.allocations, e.allocated, e.max_rss);
+      o << "    {\"phase\": \"" << e.path << "\", " << buf
+        << (i + 1 < entries().size() ? ",\n" : "\n");
+    }
+    std::snprintf(buf, sizeof(buf),
+                  "  \"seconds\": %.6f,\n  \"allocations\": %lu,\n"
+                  "  \"bytes\": %lu,\n  \"max_rss_kb\": %ld\n",
+                  seconds, allocations, allocated, max_rss());
+    o << "  ],\n" << buf << "}\n";
+    return;
+  }
+
+  std::snprintf(buf, sizeof(buf), "%-24s %9s %12s %14s %10s\n", "phase",
+                "seconds", "allocations", "bytes", "RSS (KB)");
+  o << buf;
+  for (auto &e : entries()) {
+    auto name = std::string(2 * e.depth, ' ') + e.name;
+    std::snprintf(buf, sizeof(buf), "%-24s %9.4f %12lu %14lu %10ld\n",
+                  name.c_str(), e.seconds, e.allocations, e.allocated,
+                  e.max_rss);
+    o << buf;
+  }
+  std::snprintf(buf, sizeof(buf), "%-24s %9.4f %12lu %14lu %10ld\n", "total",
+                seconds, allocations, allocated, max_rss());
+  o << buf;
+}
+
+} // namespace cool
@@ -0,0 +1,39 @@
+#ifndef _TIMER_HH
+#define _TIMER_HH
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/*
+ * What the phases of the compiler cost, for --time-report. A Timer adds the
+ * wall time, and the number and bytes of operator new allocations, from its
+ * construction to its destruction to the phase it names; nothing is
+ * measured unless reporting is enabled. Timers nest: a phase timed within
+ * another is one of its steps, reported below it. Phases are reported in
+ * the order they first ran, with the peak RSS at the end of each.
+ */
+
+namespace cool {
+
+class Timer {
+public:
+  explicit Timer(const std::string &phase);
+  ~Timer();
+
+  static void enable();
+  // a table, or JSON if `json`
+  static void report(std::ostream &o, bool json);
+
+private:
+  static bool enabled;
+
+  int entry;
+  std::chrono::steady_clock::time_point start;
+  uint64_t calls, bytes; // of operator new before
+};
+
+} // namespace cool
+
+#endif /* _TIMER_HH */
@@ -29,4 +29,6 @@ std::string escape_string(const std::string &s) {
   return o.str();
 }
 
+bool fits_int32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
 } /* namespace util */
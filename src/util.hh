@@ -1,12 +1,15 @@
 #ifndef _UTIL_HH
 #define _UTIL_HH
 
+#include <cstdint>
 #include <string>
 
 namespace util {
 
 std::string escape_string(const std::string &s);
 
+bool fits_int32(int64_t v);
+
 } /* namespace util */
 
 #endif /* _UTIL_HH */
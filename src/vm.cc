@@ -0,0 +1,1354 @@
+#include "vm.hh"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "cg.hh"
+
+namespace vm {
+
+namespace {
+
+// number of operands following each opcode
+const int operand_counts[] = {
+    0, // PUSH_SELF
+    0, // PUSH_VOID
+    1, // PUSH_INT
+    1, // PUSH_STRING
+    1, // PUSH_BOOL
+    1, // LOAD_ARG
+    1, // STORE_ARG
+    1, // LOAD_LOCAL
+    1, // STORE_LOCAL
+    1, // LOAD_FIELD
+    1, // STORE_FIELD
+    0, // POP
+    1, // NEW
+    3, // DISPATCH
+    3, // STATIC_DISPATCH
+    1, // JUMP
+    1, // JUMP_IF_FALSE
+    0, // ADD
+    0, // SUB
+    0, // MUL
+    0, // DIV
+    0, // NEG
+    0, // LT
+    0, // LE
+    0, // EQ
+    0, // NOT
+    0, // ISVOID
+    0, // CASE_ON_VOID
+    2, // JUMP_IF_NOT_CLASS
+    0, // CASE_NO_MATCH
+    0, // RETURN
+    0, // HALT
+    3, // SELF_DISPATCH
+    4, // FIELD_DISPATCH
+    4, // ARG_DISPATCH
+    4, // LOCAL_DISPATCH
+    1, // ADD_INT
+    1, // SUB_INT
+    1, // JUMP_IF_NOT_LT
+    1, // JUMP_IF_NOT_LE
+    1, // JUMP_IF_NOT_EQ
+};
+
+static_assert(sizeof(operand_counts) / sizeof(int) == OPCODE_END,
+              "operand_counts is out of date");
+
+// the operand holding a jump target, or -1
+int target_operand(int32_t op) {
+  switch (op) {
+  case JUMP:
+  case JUMP_IF_FALSE:
+  case JUMP_IF_NOT_LT:
+  case JUMP_IF_NOT_LE:
+  case JUMP_IF_NOT_EQ:
+    return 0;
+  case JUMP_IF_NOT_CLASS:
+    return 1;
+  default:
+    return -1;
+  }
+}
+
+// the change in stack depth caused by an instruction
+int stack_effect(const int32_t *insn) {
+  switch (insn[0]) {
+  case PUSH_SELF:
+  case PUSH_VOID:
+  case PUSH_INT:
+  case PUSH_STRING:
+  case PUSH_BOOL:
+  case LOAD_ARG:
+  case LOAD_LOCAL:
+  case LOAD_FIELD:
+  case NEW:
+    return 1;
+  case POP:
+  case JUMP_IF_FALSE:
+  case ADD:
+  case SUB:
+  case MUL:
+  case DIV:
+  case LT:
+  case LE:
+  case EQ:
+  case RETURN:
+  case HALT:
+    return -1;
+  case DISPATCH:
+    return -insn[2];
+  case STATIC_DISPATCH:
+    return -insn[3];
+  case SELF_DISPATCH:
+    return 1 - insn[2];
+  case FIELD_DISPATCH:
+  case ARG_DISPATCH:
+  case LOCAL_DISPATCH:
+    return 1 - insn[3];
+  case JUMP_IF_NOT_LT:
+  case JUMP_IF_NOT_LE:
+  case JUMP_IF_NOT_EQ:
+    return -2;
+  default:
+    return 0;
+  }
+}
+
+} // namespace
+
+class Variable {
+public:
+  enum Kind { ARG, LOCAL, FIELD };
+
+  Variable(Kind kind, int no) : kind(kind), no(no) {}
+
+  Kind kind;
+  int no;
+};
+
+// --- compiler ---
+
+Compiler::Label Compiler::new_label() {
+  labels.push_back(-1);
+  return labels.size() - 1;
+}
+
+void Compiler::bind(Label label) {
+  labels[label] = method->code.size();
+  last = -1;
+}
+
+void Compiler::adjust(int delta) {
+  depth += delta;
+  if (depth > max_depth) {
+    max_depth = depth;
+  }
+}
+
+void Compiler::emit(Opcode op) { append({op}); }
+
+void Compiler::emit(Opcode op, int a) { append({op, a}); }
+
+void Compiler::emit(Opcode op, int a, int b) { append({op, a, b}); }
+
+void Compiler::emit(Opcode op, int a, int b, int c) { append({op, a, b, c}); }
+
+void Compiler::emit_jump(Opcode op, Label label) {
+  emit(op, -1);
+  fixups.emplace_back(method->code.size() - 1, label);
+}
+
+void Compiler::emit_jump(Opcode op, int a, Label label) {
+  emit(op, a, -1);
+  fixups.emplace_back(method->code.size() - 1, label);
+}
+
+void Compiler::append(std::initializer_list<int32_t> insn) {
+  auto &code = method->code;
+  int prev = last;
+  last = code.size();
+  code.insert(code.end(), insn);
+  adjust(stack_effect(&code[last]));
+  fuse(prev);
+}
+
+/*
+ * Superinstructions
+ *   PUSH_SELF; DISPATCH                  => SELF_DISPATCH
+ *   LOAD_FIELD/ARG/LOCAL k; DISPATCH     => FIELD/ARG/LOCAL_DISPATCH k
+ *   LT/LE/EQ; JUMP_IF_FALSE              => JUMP_IF_NOT_LT/LE/EQ
+ */
+void Compiler::fuse(int prev) {
+  if (prev < 0) {
+    return;
+  }
+  auto &code = method->code;
+  std::vector<int32_t> insn;
+  switch (code[last]) {
+  case DISPATCH:
+    if (code[prev] == PUSH_SELF) {
+      insn = {SELF_DISPATCH};
+    } else if (code[prev] == LOAD_FIELD) {
+      insn = {FIELD_DISPATCH, code[prev + 1]};
+    } else if (code[prev] == LOAD_ARG) {
+      insn = {ARG_DISPATCH, code[prev + 1]};
+    } else if (code[prev] == LOAD_LOCAL) {
+      insn = {LOCAL_DISPATCH, code[prev + 1]};
+    }
+    break;
+  case JUMP_IF_FALSE:
+    if (code[prev] == LT) {
+      insn = {JUMP_IF_NOT_LT};
+    } else if (code[prev] == LE) {
+      insn = {JUMP_IF_NOT_LE};
+    } else if (code[prev] == EQ) {
+      insn = {JUMP_IF_NOT_EQ};
+    }
+    break;
+  default:
+    break;
+  }
+  if (insn.empty()) {
+    return;
+  }
+  // the stack effects add up, so `depth` is still right
+  insn.insert(insn.end(), code.begin() + last + 1, code.end());
+  code.resize(prev);
+  code.insert(code.end(), insn.begin(), insn.end());
+  last = prev;
+}
+
+void Compiler::emit_invoke(ast::Class *cls, const std::string &name, int nargs,
+                           bool dynamic) {
+  int slot = cls->methods_numbered[name];
+  if (dynamic) {
+    emit(DISPATCH, slot, nargs, res.nsites++);
+  } else {
+    emit(STATIC_DISPATCH, cls->id, slot, nargs);
+  }
+}
+
+void Compiler::emit_load(const std::string &name) {
+  if (name == "self") {
+    emit(PUSH_SELF);
+    return;
+  }
+  auto var = scope.find(name);
+  emit(var->kind == Variable::ARG
+           ? LOAD_ARG
+           : var->kind == Variable::LOCAL ? LOAD_LOCAL : LOAD_FIELD,
+       var->no);
+}
+
+void Compiler::emit_store(const std::string &name) {
+  auto var = scope.find(name);
+  emit(var->kind == Variable::ARG
+           ? STORE_ARG
+           : var->kind == Variable::LOCAL ? STORE_LOCAL : STORE_FIELD,
+       var->no);
+}
+
+void Compiler::emit_default(ast::Class *cls) {
+  if (cls == sa->stringClass.get()) {
+    emit(PUSH_STRING, string_constant(""));
+  } else if (cls == sa->intClass.get()) {
+    emit(PUSH_INT, int_constant(0));
+  } else if (cls == sa->boolClass.get()) {
+    emit(PUSH_BOOL, 0);
+  } else {
+    emit(PUSH_VOID);
+  }
+}
+
+int Compiler::string_constant(const std::string &s) {
+  if (strings_numbered.find(s) == strings_numbered.end()) {
+    strings_numbered[s] = res.strings.size();
+    res.strings.push_back(s);
+  }
+  return strings_numbered[s];
+}
+
+int Compiler::int_constant(int64_t i) {
+  if (ints_numbered.find(i) == ints_numbered.end()) {
+    ints_numbered[i] = res.ints.size();
+    res.ints.push_back(i);
+  }
+  return ints_numbered[i];
+}
+
+int Compiler::enter_local(const std::string &name) {
+  int no = nlocals++;
+  if (nlocals > max_locals) {
+    max_locals = nlocals;
+  }
+  scope.enter().add(name, std::make_shared<Variable>(Variable::LOCAL, no));
+  return no;
+}
+
+void Compiler::exit_local() {
+  scope.exit();
+  nlocals--;
+}
+
+void Compiler::arrange_classes() {
+  for (int i = 0; i < sa->classes.size(); ++i) {
+    sa->classes[i]->id = i + 1;
+  }
+  sa->objectClass->arrange();
+
+  // number the methods first; code refers to them by number
+  for (auto &cls : sa->classes) {
+    for (auto it = cls->name2Method.begin(); it != cls->name2Method.end();
+         ++it) {
+      auto name = cls->name + "." + it->first;
+      methods_numbered[name] = res.methods.size();
+      res.methods.emplace_back();
+      res.methods.back().name = name;
+      res.methods.back().nargs = it->second->formals.size();
+    }
+  }
+
+  for (auto &cls : sa->classes) {
+    res.classes.emplace_back();
+    auto &c = res.classes.back();
+    c.name = cls->name;
+    c.id = cls->id;
+    c.name_string = string_constant(cls->name);
+    c.init = methods_numbered[cls->name + "." + cool::init_method_name];
+
+    auto kind = [this](ast::Class *type) {
+      if (type == sa->stringClass.get()) {
+        return Class::STRING;
+      }
+      if (type == sa->intClass.get()) {
+        return Class::INT;
+      }
+      if (type == sa->boolClass.get()) {
+        return Class::BOOL;
+      }
+      return Class::PLAIN;
+    };
+    c.kind = kind(cls.get());
+    for (auto &name : cls->fields_ordered) {
+      c.fields.push_back(
+          kind(sa->name2Class[cls->get_field(name)->type_name].get()));
+    }
+    for (auto &name : cls->methods_ordered) {
+      c.vtable.push_back(
+          methods_numbered[cls->methods_resolved[name]->name + "." + name]);
+    }
+  }
+}
+
+void Compiler::compile_method(ast::Class *cls, ast::Method *m) {
+  method = &res.methods[methods_numbered[cls->name + "." + m->name]];
+  depth = max_depth = 0;
+  nlocals = max_locals = 0;
+  labels.clear();
+  fixups.clear();
+  last = -1;
+
+  scope.enter();
+  int i = 0;
+  for (auto &formal : m->formals) {
+    scope.add(formal->name,
+              std::make_shared<Variable>(Variable::ARG,
+                                         m->formals.size() - 1 - i++));
+  }
+
+  m->expr->compile(this);
+  emit(RETURN);
+
+  scope.exit();
+
+  for (auto &fixup : fixups) {
+    method->code[fixup.first] = labels[fixup.second];
+  }
+  method->nlocals = max_locals;
+  method->max_stack = max_depth;
+}
+
+// new Main; Main.main()
+void Compiler::compile_bootstrap() {
+  res.entry = res.methods.size();
+  res.methods.emplace_back();
+  method = &res.methods.back();
+  method->name = "__main__";
+  depth = max_depth = 0;
+  last = -1;
+
+  emit(NEW, sa->mainClass->id);
+  emit(STATIC_DISPATCH, sa->mainClass->id,
+       sa->mainClass->methods_numbered["main"], 0);
+  emit(HALT);
+  method->max_stack = max_depth;
+}
+
+Program Compiler::compile() {
+  string_constant("");
+  int_constant(0);
+
+  arrange_classes();
+
+  for (auto &cls : program->classes) {
+    scope.enter();
+    for (auto &name : cls->fields_ordered) {
+      scope.add(name, std::make_shared<Variable>(Variable::FIELD,
+                                                 cls->fields_numbered[name]));
+    }
+    for (auto it = cls->name2Method.begin(); it != cls->name2Method.end();
+         ++it) {
+      compile_method(cls.get(), it->second);
+    }
+    scope.exit();
+  }
+
+  compile_bootstrap();
+  return res;
+}
+
+// --- serialization ---
+
+namespace {
+
+const char magic[] = "COOLVM01";
+
+void write_i64(std::ostream &o, int64_t v) {
+  for (int i = 0; i < 8; ++i) {
+    o.put((char)((uint64_t)v >> (8 * i)));
+  }
+}
+
+void write_i32(std::ostream &o, int32_t v) {
+  for (int i = 0; i < 4; ++i) {
+    o.put((char)((uint32_t)v >> (8 * i)));
+  }
+}
+
+void write_string(std::ostream &o, const std::string &s) {
+  write_i32(o, s.size());
+  o.write(s.data(), s.size());
+}
+
+int64_t read_i64(std::istream &in) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i) {
+    v |= (uint64_t)(uint8_t)in.get() << (8 * i);
+  }
+  if (!in) {
+    throw BytecodeError("truncated bytecode");
+  }
+  return v;
+}
+
+int32_t read_i32(std::istream &in) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; ++i) {
+    v |= (uint32_t)(uint8_t)in.get() << (8 * i);
+  }
+  if (!in) {
+    throw BytecodeError("truncated bytecode");
+  }
+  return v;
+}
+
+int32_t read_count(std::istream &in) {
+  auto n = read_i32(in);
+  if (n < 0 || n > (1 << 28)) {
+    throw BytecodeError("invalid bytecode");
+  }
+  return n;
+}
+
+std::string read_string(std::istream &in) {
+  std::string s(read_count(in), '\0');
+  in.read(&s[0], s.size());
+  if (!in) {
+    throw BytecodeError("truncated bytecode");
+  }
+  return s;
+}
+
+} // namespace
+
+bool is_bytecode(std::istream &in) {
+  char buf[sizeof(magic) - 1];
+  in.read(buf, sizeof(buf));
+  bool res = in && std::memcmp(buf, magic, sizeof(buf)) == 0;
+  in.clear();
+  in.seekg(0);
+  return res;
+}
+
+void Program::save(std::ostream &o) {
+  o.write(magic, sizeof(magic) - 1);
+
+  write_i32(o, strings.size());
+  for (auto &s : strings) {
+    write_string(o, s);
+  }
+  write_i32(o, ints.size());
+  for (auto i : ints) {
+    write_i64(o, i);
+  }
+
+  write_i32(o, classes.size());
+  for (auto &c : classes) {
+    write_string(o, c.name);
+    write_i32(o, c.id);
+    write_i32(o, c.kind);
+    write_i32(o, c.name_string);
+    write_i32(o, c.init);
+    write_i32(o, c.fields.size());
+    for (auto f : c.fields) {
+      write_i32(o, f);
+    }
+    write_i32(o, c.vtable.size());
+    for (auto m : c.vtable) {
+      write_i32(o, m);
+    }
+  }
+
+  write_i32(o, methods.size());
+  for (auto &m : methods) {
+    write_string(o, m.name);
+    write_i32(o, m.nargs);
+    write_i32(o, m.nlocals);
+    write_i32(o, m.max_stack);
+    write_i32(o, m.code.size());
+    for (auto w : m.code) {
+      write_i32(o, w);
+    }
+  }
+
+  write_i32(o, entry);
+  write_i32(o, nsites);
+}
+
+void Program::load(std::istream &in) {
+  char buf[sizeof(magic) - 1];
+  in.read(buf, sizeof(buf));
+  if (!in || std::memcmp(buf, magic, sizeof(buf)) != 0) {
+    throw BytecodeError("not a bytecode file");
+  }
+
+  strings.resize(read_count(in));
+  for (auto &s : strings) {
+    s = read_string(in);
+  }
+  ints.resize(read_count(in));
+  for (auto &i : ints) {
+    i = read_i64(in);
+  }
+
+  classes.resize(read_count(in));
+  for (auto &c : classes) {
+    c.name = read_string(in);
+    c.id = read_i32(in);
+    c.kind = (Class::Kind)read_i32(in);
+    c.name_string = read_i32(in);
+    c.init = read_i32(in);
+    c.fields.resize(read_count(in));
+    for (auto &f : c.fields) {
+      f = (Class::Kind)read_i32(in);
+    }
+    c.vtable.resize(read_count(in));
+    for (auto &m : c.vtable) {
+      m = read_i32(in);
+    }
+  }
+
+  methods.resize(read_count(in));
+  for (auto &m : methods) {
+    m.name = read_string(in);
+    m.nargs = read_i32(in);
+    m.nlocals = read_i32(in);
+    m.max_stack = read_i32(in);
+    m.code.resize(read_count(in));
+    for (auto &w : m.code) {
+      w = read_i32(in);
+    }
+  }
+
+  entry = read_i32(in);
+  nsites = read_i32(in);
+
+  // everything the interpreter relies on without checking
+  auto check = [](bool ok) {
+    if (!ok) {
+      throw BytecodeError("invalid bytecode");
+    }
+  };
+  auto check_method = [&](int m) { check(m >= 0 && m < methods.size()); };
+  for (size_t i = 0; i < classes.size(); ++i) {
+    auto &c = classes[i];
+    check(c.id == i + 1 && c.name_string >= 0 &&
+          c.name_string < strings.size() && c.kind >= Class::PLAIN &&
+          c.kind <= Class::BOOL);
+    check_method(c.init);
+    for (auto m : c.vtable) {
+      check_method(m);
+    }
+  }
+  check_method(entry);
+  check(nsites >= 0);
+  for (auto &m : methods) {
+    for (size_t pc = 0; pc < m.code.size();) {
+      auto op = m.code[pc];
+      check(op >= 0 && op < OPCODE_END &&
+            pc + operand_counts[op] < m.code.size());
+      auto t = target_operand(op);
+      if (t >= 0) {
+        check(m.code[pc + 1 + t] >= 0 && m.code[pc + 1 + t] < m.code.size());
+      }
+      pc += 1 + operand_counts[op];
+    }
+  }
+}
+
+// --- interpreter ---
+
+namespace {
+
+class Type;
+class Function;
+
+class Object {
+public:
+  Object(Type *type) : type(type), value(0) {}
+
+  Type *type;
+  int64_t value; // Int, Bool
+  std::string str;
+  std::vector<Object *> fields; // the elements of an Array too
+  std::vector<int64_t> ints;    // the elements of an IntArray
+};
+
+typedef Object *(*Native)(Object *self, Object **args);
+
+union Word {
+  const void *label;
+  const Word *target;
+  intptr_t n;
+};
+
+class Function {
+public:
+  Function() : method(nullptr), native(nullptr) {}
+
+  const Method *method;
+  Native native;
+  std::vector<Word> code;
+};
+
+class Type {
+public:
+  const Class *cls;
+  Object *prototype;
+  Object *name;
+  Function *init;
+  std::vector<Function *> vtable;
+};
+
+class Frame {
+public:
+  const Word *pc;
+  Object **args, **locals;
+  Object *self;
+};
+
+// monomorphic inline cache of a call site
+class Cache {
+public:
+  Cache() : type(nullptr), fn(nullptr) {}
+
+  Type *type;
+  Function *fn;
+};
+
+Type *string_type, *int_type, *bool_type;
+Object *bool_objects[2];
+Object *small_ints[256 + 16];
+
+[[noreturn]] void fatal(const char *msg) {
+  std::fputs(msg, stderr);
+  std::exit(-1);
+}
+
+Object *new_string(const std::string &s) {
+  auto res = new Object(*string_type->prototype);
+  res->str = s;
+  return res;
+}
+
+// Ints are immutable and compared by value, so small ones can be shared
+Object *new_int(int64_t v) {
+  if (v >= -16 && v < 256) {
+    auto &res = small_ints[v + 16];
+    if (!res) {
+      res = new Object(*int_type->prototype);
+      res->value = v;
+    }
+    return res;
+  }
+  auto res = new Object(*int_type->prototype);
+  res->value = v;
+  return res;
+}
+
+Object *native_self(Object *self, Object **args) { return self; }
+
+Object *native_copy(Object *self, Object **args) { return new Object(*self); }
+
+Object *native_abort(Object *self, Object **args) { std::exit(-1); }
+
+Object *native_type_name(Object *self, Object **args) {
+  return self->type->name;
+}
+
+Object *native_length(Object *self, Object **args) {
+  return new_int(std::strlen(self->str.c_str()));
+}
+
+Object *native_concat(Object *self, Object **args) {
+  return new_string(self->str + args[0]->str);
+}
+
+// the same bounds as String.substr in the native runtime
+Object *native_substr(Object *self, Object **args) {
+  uint64_t len = std::strlen(self->str.c_str());
+  uint64_t i1 = args[1]->value, i2 = args[0]->value;
+  if (i1 >= len) {
+    return new_string("");
+  }
+  if (i2 > len) {
+    i2 = len;
+  }
+  if (i2 <= i1) {
+    return new_string("");
+  }
+  return new_string(self->str.substr(i1, i2 - i1));
+}
+
+Object *native_to_int(Object *self, Object **args) {
+  return new_int(std::atol(self->str.c_str()));
+}
+
+Object *native_to_string(Object *self, Object **args) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%ld", (long)self->value);
+  return new_string(buf);
+}
+
+Object *native_in_string(Object *self, Object **args) {
+  char *line = nullptr;
+  size_t n = 0;
+  auto res = new_string(::getline(&line, &n, stdin) < 0 ? "" : line);
+  std::free(line);
+  return res;
+}
+
+Object *native_out_string(Object *self, Object **args) {
+  std::fputs(args[0]->str.c_str(), stdout);
+  return self;
+}
+
+int64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  ::clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+Object *native_now_ns(Object *self, Object **args) {
+  return new_int(clock_ns(CLOCK_MONOTONIC));
+}
+
+Object *native_cycles(Object *self, Object **args) {
+  return new_int(__builtin_ia32_rdtsc());
+}
+
+Object *native_cpu_time_ns(Object *self, Object **args) {
+  return new_int(clock_ns(CLOCK_PROCESS_CPUTIME_ID));
+}
+
+// the same bounds as the native runtime
+uint64_t array_index(Object *i, size_t length) {
+  if ((uint64_t)i->value >= length) {
+    fatal("fatal error: array index out of bounds\n");
+  }
+  return i->value;
+}
+
+Object *native_new_array(Object *self, Object **args) {
+  if ((uint64_t)args[0]->value >> 31) {
+    fatal("fatal error: array size out of range\n");
+  }
+  auto res = new Object(*self->type->prototype);
+  res->fields.resize(args[0]->value);
+  return res;
+}
+
+Object *native_get(Object *self, Object **args) {
+  return self->fields[array_index(args[0], self->fields.size())];
+}
+
+Object *native_set(Object *self, Object **args) {
+  self->fields[array_index(args[1], self->fields.size())] = args[0];
+  return self;
+}
+
+Object *native_array_length(Object *self, Object **args) {
+  return new_int(self->fields.size());
+}
+
+Object *native_new_int_array(Object *self, Object **args) {
+  if ((uint64_t)args[0]->value >> 31) {
+    fatal("fatal error: array size out of range\n");
+  }
+  auto res = new Object(*self->type->prototype);
+  res->ints.resize(args[0]->value);
+  return res;
+}
+
+Object *native_int_get(Object *self, Object **args) {
+  return new_int(self->ints[array_index(args[0], self->ints.size())]);
+}
+
+Object *native_int_set(Object *self, Object **args) {
+  self->ints[array_index(args[1], self->ints.size())] = args[0]->value;
+  return self;
+}
+
+Object *native_int_array_length(Object *self, Object **args) {
+  return new_int(self->ints.size());
+}
+
+const std::map<std::string, Native> natives = {
+    {"Object.__init__", native_self},     {"Object.copy", native_copy},
+    {"Object.abort", native_abort},       {"Object.type_name", native_type_name},
+    {"String.__init__", native_self},     {"String.length", native_length},
+    {"String.concat", native_concat},     {"String.substr", native_substr},
+    {"String.to_int", native_to_int},     {"Int.__init__", native_self},
+    {"Int.to_string", native_to_string},  {"Bool.__init__", native_self},
+    {"IO.__init__", native_self},         {"IO.in_string", native_in_string},
+    {"IO.out_string", native_out_string}, {"Clock.__init__", native_self},
+    {"Clock.now_ns", native_now_ns},      {"Clock.cycles", native_cycles},
+    {"Clock.cpu_time_ns", native_cpu_time_ns},
+    {"Array.__init__", native_self},      {"Array.new_array", native_new_array},
+    {"Array.get", native_get},            {"Array.set", native_set},
+    {"Array.length", native_array_length},
+    {"IntArray.__init__", native_self},
+    {"IntArray.new_array", native_new_int_array},
+    {"IntArray.get", native_int_get},     {"IntArray.set", native_int_set},
+    {"IntArray.length", native_int_array_length}};
+
+} // namespace
+
+/*
+ * Direct threading: every opcode is replaced by the address of the code
+ * implementing it, and jump targets by the address of the target word.
+ */
+int run(Program &program) {
+  static const void *labels[] = {
+      &&op_PUSH_SELF,      &&op_PUSH_VOID,      &&op_PUSH_INT,
+      &&op_PUSH_STRING,    &&op_PUSH_BOOL,      &&op_LOAD_ARG,
+      &&op_STORE_ARG,      &&op_LOAD_LOCAL,     &&op_STORE_LOCAL,
+      &&op_LOAD_FIELD,     &&op_STORE_FIELD,    &&op_POP,
+      &&op_NEW,            &&op_DISPATCH,       &&op_STATIC_DISPATCH,
+      &&op_JUMP,           &&op_JUMP_IF_FALSE,  &&op_ADD,
+      &&op_SUB,            &&op_MUL,            &&op_DIV,
+      &&op_NEG,            &&op_LT,             &&op_LE,
+      &&op_EQ,             &&op_NOT,            &&op_ISVOID,
+      &&op_CASE_ON_VOID,   &&op_JUMP_IF_NOT_CLASS, &&op_CASE_NO_MATCH,
+      &&op_RETURN,         &&op_HALT,           &&op_SELF_DISPATCH,
+      &&op_FIELD_DISPATCH, &&op_ARG_DISPATCH,   &&op_LOCAL_DISPATCH,
+      &&op_ADD_INT,        &&op_SUB_INT,        &&op_JUMP_IF_NOT_LT,
+      &&op_JUMP_IF_NOT_LE, &&op_JUMP_IF_NOT_EQ};
+  static_assert(sizeof(labels) / sizeof(labels[0]) == OPCODE_END,
+                "labels is out of date");
+
+  // load
+  std::vector<Function> functions(program.methods.size());
+  for (size_t i = 0; i < program.methods.size(); ++i) {
+    auto &m = program.methods[i];
+    auto &fn = functions[i];
+    fn.method = &m;
+    if (m.code.empty()) {
+      auto it = natives.find(m.name);
+      if (it == natives.end()) {
+        throw BytecodeError("unknown built-in method \"" + m.name + "\"");
+      }
+      fn.native = it->second;
+      continue;
+    }
+    fn.code.resize(m.code.size());
+    for (size_t pc = 0; pc < m.code.size();) {
+      auto op = m.code[pc];
+      fn.code[pc].label = labels[op];
+      for (int k = 0; k < operand_counts[op]; ++k) {
+        fn.code[pc + 1 + k].n = m.code[pc + 1 + k];
+      }
+      auto t = target_operand(op);
+      if (t >= 0) {
+        fn.code[pc + 1 + t].target = &fn.code[m.code[pc + 1 + t]];
+      }
+      pc += 1 + operand_counts[op];
+    }
+  }
+
+  std::vector<Object *> strings;
+  std::vector<Type> types(program.classes.size());
+  for (size_t i = 0; i < types.size(); ++i) {
+    auto &c = program.classes[i];
+    types[i].cls = &c;
+    types[i].prototype = new Object(&types[i]);
+    types[i].init = &functions[c.init];
+    for (auto m : c.vtable) {
+      types[i].vtable.push_back(&functions[m]);
+    }
+    if (c.kind == Class::STRING) {
+      string_type = &types[i];
+    } else if (c.kind == Class::INT) {
+      int_type = &types[i];
+    } else if (c.kind == Class::BOOL) {
+      bool_type = &types[i];
+    }
+  }
+  if (!string_type || !int_type || !bool_type) {
+    throw BytecodeError("missing built-in classes");
+  }
+  for (auto &s : program.strings) {
+    strings.push_back(new_string(s));
+  }
+  std::vector<Object *> ints;
+  for (auto i : program.ints) {
+    ints.push_back(new_int(i));
+  }
+  for (int i = 0; i < 2; ++i) {
+    bool_objects[i] = new Object(*bool_type->prototype);
+    bool_objects[i]->value = i;
+  }
+  for (auto &type : types) {
+    type.name = strings[type.cls->name_string];
+    for (auto kind : type.cls->fields) {
+      type.prototype->fields.push_back(
+          kind == Class::STRING
+              ? strings[0]
+              : kind == Class::INT ? new_int(0)
+                                   : kind == Class::BOOL ? bool_objects[0]
+                                                         : nullptr);
+    }
+  }
+
+  std::vector<Cache> caches(program.nsites);
+
+  const size_t stack_size = 1 << 22;
+  std::unique_ptr<Object *[]> stack(new Object *[stack_size]);
+  Object **stack_end = stack.get() + stack_size;
+  std::vector<Frame> frames;
+
+  // registers
+  Object **sp = stack.get();
+  Object **args = sp, **locals = sp;
+  Object *self = nullptr;
+  const Word *pc = functions[program.entry].code.data();
+
+  // operands of `call`
+  Function *callee;
+  Object *receiver;
+  int nargs;
+
+#define NEXT goto *(pc++)->label
+#define BOOL(b) bool_objects[(b) ? 1 : 0]
+#define CHECK_VOID(o)                                                          \
+  if (!(o)) {                                                                  \
+    fatal("fatal error: invoke on void\n");                                    \
+  }
+
+  NEXT;
+
+op_PUSH_SELF:
+  *sp++ = self;
+  NEXT;
+op_PUSH_VOID:
+  *sp++ = nullptr;
+  NEXT;
+op_PUSH_INT:
+  *sp++ = ints[(pc++)->n];
+  NEXT;
+op_PUSH_STRING:
+  *sp++ = strings[(pc++)->n];
+  NEXT;
+op_PUSH_BOOL:
+  *sp++ = BOOL((pc++)->n);
+  NEXT;
+op_LOAD_ARG:
+  *sp++ = args[(pc++)->n];
+  NEXT;
+op_STORE_ARG:
+  args[(pc++)->n] = sp[-1];
+  NEXT;
+op_LOAD_LOCAL:
+  *sp++ = locals[(pc++)->n];
+  NEXT;
+op_STORE_LOCAL:
+  locals[(pc++)->n] = sp[-1];
+  NEXT;
+op_LOAD_FIELD:
+  *sp++ = self->fields[(pc++)->n];
+  NEXT;
+op_STORE_FIELD:
+  self->fields[(pc++)->n] = sp[-1];
+  NEXT;
+op_POP:
+  --sp;
+  NEXT;
+
+op_NEW: {
+  auto &type = types[(pc++)->n - 1];
+  receiver = new Object(*type.prototype);
+  callee = type.init;
+  nargs = 0;
+  goto call;
+}
+
+op_DISPATCH:
+  receiver = *--sp;
+  CHECK_VOID(receiver);
+  goto dispatch;
+op_SELF_DISPATCH:
+  receiver = self;
+  goto dispatch;
+op_FIELD_DISPATCH:
+  receiver = self->fields[(pc++)->n];
+  CHECK_VOID(receiver);
+  goto dispatch;
+op_ARG_DISPATCH:
+  receiver = args[(pc++)->n];
+  CHECK_VOID(receiver);
+  goto dispatch;
+op_LOCAL_DISPATCH:
+  receiver = locals[(pc++)->n];
+  CHECK_VOID(receiver);
+  goto dispatch;
+
+dispatch : {
+  int slot = pc[0].n;
+  nargs = pc[1].n;
+  auto &cache = caches[pc[2].n];
+  pc += 3;
+  if (cache.type != receiver->type) {
+    cache.type = receiver->type;
+    cache.fn = receiver->type->vtable[slot];
+  }
+  callee = cache.fn;
+  goto call;
+}
+
+op_STATIC_DISPATCH:
+  receiver = *--sp;
+  CHECK_VOID(receiver);
+  callee = types[pc[0].n - 1].vtable[pc[1].n];
+  nargs = pc[2].n;
+  pc += 3;
+  goto call;
+
+call:
+  if (callee->native) {
+    auto res = callee->native(receiver, sp - nargs);
+    sp -= nargs;
+    *sp++ = res;
+    NEXT;
+  }
+  if (stack_end - sp < callee->method->nlocals + callee->method->max_stack) {
+    fatal("fatal error: stack overflow\n");
+  }
+  frames.push_back(Frame{pc, args, locals, self});
+  args = sp - nargs;
+  locals = sp;
+  for (int i = 0; i < callee->method->nlocals; ++i) {
+    *sp++ = nullptr;
+  }
+  self = receiver;
+  pc = callee->code.data();
+  NEXT;
+
+op_RETURN: {
+  auto res = sp[-1];
+  auto &frame = frames.back();
+  sp = args;
+  pc = frame.pc;
+  args = frame.args;
+  locals = frame.locals;
+  self = frame.self;
+  frames.pop_back();
+  *sp++ = res;
+  NEXT;
+}
+
+op_HALT:
+  return sp[-1]->value;
+
+op_JUMP:
+  pc = pc->target;
+  NEXT;
+op_JUMP_IF_FALSE:
+  pc = (*--sp)->value ? pc + 1 : pc->target;
+  NEXT;
+
+  // arithmetic operands are evaluated right to left, so the left one is on top
+op_ADD:
+  sp[-2] = new_int(sp[-1]->value + sp[-2]->value);
+  --sp;
+  NEXT;
+op_SUB:
+  sp[-2] = new_int(sp[-1]->value - sp[-2]->value);
+  --sp;
+  NEXT;
+op_MUL:
+  sp[-2] = new_int(sp[-1]->value * sp[-2]->value);
+  --sp;
+  NEXT;
+op_DIV:
+  if (sp[-2]->value == 0) {
+    std::raise(SIGFPE);
+  }
+  sp[-2] = new_int(sp[-1]->value / sp[-2]->value);
+  --sp;
+  NEXT;
+op_NEG:
+  sp[-1] = new_int(-sp[-1]->value);
+  NEXT;
+op_ADD_INT:
+  sp[-1] = new_int(sp[-1]->value + ints[(pc++)->n]->value);
+  NEXT;
+op_SUB_INT:
+  sp[-1] = new_int(sp[-1]->value - ints[(pc++)->n]->value);
+  NEXT;
+
+  // comparisons evaluate left to right, so the right operand is on top
+op_LT:
+  sp[-2] = BOOL(sp[-2]->value < sp[-1]->value);
+  --sp;
+  NEXT;
+op_LE:
+  sp[-2] = BOOL(sp[-2]->value <= sp[-1]->value);
+  --sp;
+  NEXT;
+op_EQ:
+  sp[-2] = BOOL(sp[-2]->value == sp[-1]->value);
+  --sp;
+  NEXT;
+op_JUMP_IF_NOT_LT:
+  sp -= 2;
+  pc = sp[0]->value < sp[1]->value ? pc + 1 : pc->target;
+  NEXT;
+op_JUMP_IF_NOT_LE:
+  sp -= 2;
+  pc = sp[0]->value <= sp[1]->value ? pc + 1 : pc->target;
+  NEXT;
+op_JUMP_IF_NOT_EQ:
+  sp -= 2;
+  pc = sp[0]->value == sp[1]->value ? pc + 1 : pc->target;
+  NEXT;
+op_NOT:
+  sp[-1] = BOOL(!sp[-1]->value);
+  NEXT;
+op_ISVOID:
+  sp[-1] = BOOL(!sp[-1]);
+  NEXT;
+
+op_CASE_ON_VOID:
+  if (!sp[-1]) {
+    fatal("fatal error: case on void\n");
+  }
+  NEXT;
+op_JUMP_IF_NOT_CLASS:
+  pc = sp[-1]->type->cls->id == pc[0].n ? pc + 2 : pc[1].target;
+  NEXT;
+op_CASE_NO_MATCH:
+  fatal("fatal error: case no match\n");
+
+#undef NEXT
+#undef BOOL
+#undef CHECK_VOID
+}
+
+} /* namespace vm */
+
+namespace ast {
+
+void Assign::compile(vm::Compiler *c) {
+  expr->compile(c);
+  c->emit_store(name);
+}
+
+void Invoke::compile(vm::Compiler *c) {
+  for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) {
+    it->get()->compile(c);
+  }
+  expr_sa->compile(c);
+  c->emit_invoke(type_sa, name, arguments.size(), type_name.empty());
+}
+
+void If::compile(vm::Compiler *c) {
+  auto label_else = c->new_label();
+  auto label_done = c->new_label();
+  a->compile(c);
+  c->emit_jump(vm::JUMP_IF_FALSE, label_else);
+  b->compile(c);
+  c->emit_jump(vm::JUMP, label_done);
+  c->bind(label_else);
+  c->depth--; // the result of `b` is not on the stack here
+  this->c->compile(c);
+  c->bind(label_done);
+}
+
+void While::compile(vm::Compiler *c) {
+  auto label_loop = c->new_label();
+  auto label_done = c->new_label();
+  c->bind(label_loop);
+  a->compile(c);
+  c->emit_jump(vm::JUMP_IF_FALSE, label_done);
+  b->compile(c);
+  c->emit(vm::POP);
+  c->emit_jump(vm::JUMP, label_loop);
+  c->bind(label_done);
+  c->emit(vm::PUSH_VOID);
+}
+
+void Block::compile(vm::Compiler *c) {
+  auto last = std::prev(expressions.end());
+  for (auto it = expressions.begin(); it != expressions.end(); ++it) {
+    it->get()->compile(c);
+    if (it != last) {
+      c->emit(vm::POP);
+    }
+  }
+}
+
+void Let::compile(vm::Compiler *c) {
+  if (std::dynamic_pointer_cast<Void>(expr)) {
+    c->emit_default(c->sa->name2Class[type_name].get());
+  } else {
+    expr->compile(c);
+  }
+  c->emit(vm::STORE_LOCAL, c->enter_local(name));
+  c->emit(vm::POP);
+  body->compile(c);
+  c->exit_local();
+}
+
+void Case::compile(vm::Compiler *c) {
+  expr->compile(c);
+  c->emit(vm::CASE_ON_VOID);
+
+  auto label_done = c->new_label();
+  auto depth = c->depth;
+  for (auto &branch : branches) {
+    auto label_next = c->new_label();
+    c->emit_jump(vm::JUMP_IF_NOT_CLASS, branch->type->id, label_next);
+    c->emit(vm::STORE_LOCAL, c->enter_local(branch->name));
+    c->emit(vm::POP);
+    branch->expr->compile(c);
+    c->exit_local();
+    c->emit_jump(vm::JUMP, label_done);
+    c->bind(label_next);
+    c->depth = depth;
+  }
+  c->emit(vm::CASE_NO_MATCH);
+  c->bind(label_done);
+}
+
+void New::compile(vm::Compiler *c) { c->emit(vm::NEW, type_sa->id); }
+
+void IsVoid::compile(vm::Compiler *c) {
+  expr->compile(c);
+  c->emit(vm::ISVOID);
+}
+
+void Add::compile(vm::Compiler *c) {
+  auto k = std::dynamic_pointer_cast<IntConst>(b);
+  if (k) {
+    a->compile(c);
+    c->emit(vm::ADD_INT, c->int_constant(k->value));
+    return;
+  }
+  b->compile(c);
+  a->compile(c);
+  c->emit(vm::ADD);
+}
+
+void Sub::compile(vm::Compiler *c) {
+  auto k = std::dynamic_pointer_cast<IntConst>(b);
+  if (k) {
+    a->compile(c);
+    c->emit(vm::SUB_INT, c->int_constant(k->value));
+    return;
+  }
+  b->compile(c);
+  a->compile(c);
+  c->emit(vm::SUB);
+}
+
+void Mul::compile(vm::Compiler *c) {
+  b->compile(c);
+  a->compile(c);
+  c->emit(vm::MUL);
+}
+
+void Div::compile(vm::Compiler *c) {
+  b->compile(c);
+  a->compile(c);
+  c->emit(vm::DIV);
+}
+
+void Neg::compile(vm::Compiler *c) {
+  expr->compile(c);
+  c->emit(vm::NEG);
+}
+
+void LessThan::compile(vm::Compiler *c) {
+  a->compile(c);
+  b->compile(c);
+  c->emit(vm::LT);
+}
+
+void Equal::compile(vm::Compiler *c) {
+  a->compile(c);
+  b->compile(c);
+  c->emit(vm::EQ);
+}
+
+void LessOrEqual::compile(vm::Compiler *c) {
+  a->compile(c);
+  b->compile(c);
+  c->emit(vm::LE);
+}
+
+void Not::compile(vm::Compiler *c) {
+  expr->compile(c);
+  c->emit(vm::NOT);
+}
+
+void Var::compile(vm::Compiler *c) { c->emit_load(name); }
+
+void IntConst::compile(vm::Compiler *c) {
+  c->emit(vm::PUSH_INT, c->int_constant(value));
+}
+
+void StrConst::compile(vm::Compiler *c) {
+  c->emit(vm::PUSH_STRING, c->string_constant(value));
+}
+
+void BoolConst::compile(vm::Compiler *c) {
+  c->emit(vm::PUSH_BOOL, value ? 1 : 0);
+}
+
+} /* namespace ast */
@@ -0,0 +1,201 @@
+#ifndef _VM_HH
+#define _VM_HH
+
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ast.hh"
+#include "sa.hh"
+
+/*
+ * A bytecode backend: a stack machine whose programs can be saved to disk
+ * and run by a direct-threaded interpreter, without gcc or a link step.
+ *
+ * Values are pointers to heap objects (nullptr is void). Object layouts and
+ * method tables follow Class::arrange, so field and method numbers are the
+ * same as in the native code.
+ *
+ * Calling Convention
+ *   arguments are pushed right to left, then the receiver; a call replaces
+ *   them with the result
+ */
+
+namespace vm {
+
+enum Opcode : int32_t {
+  PUSH_SELF,
+  PUSH_VOID,
+  PUSH_INT,    // constant number
+  PUSH_STRING, // constant number
+  PUSH_BOOL,   // value
+  LOAD_ARG,    // argument number; the last argument is 0
+  STORE_ARG,
+  LOAD_LOCAL, // local number
+  STORE_LOCAL,
+  LOAD_FIELD, // field number
+  STORE_FIELD,
+  POP,
+  NEW,             // class id
+  DISPATCH,        // method number, nargs, call site
+  STATIC_DISPATCH, // class id, method number, nargs
+  JUMP,            // target
+  JUMP_IF_FALSE,   // target
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  NEG,
+  LT,
+  LE,
+  EQ,
+  NOT,
+  ISVOID,
+  CASE_ON_VOID,      // check the scrutinee
+  JUMP_IF_NOT_CLASS, // class id, target
+  CASE_NO_MATCH,
+  RETURN,
+  HALT,
+
+  // superinstructions
+  SELF_DISPATCH,  // method number, nargs, call site
+  FIELD_DISPATCH, // field number, method number, nargs, call site
+  ARG_DISPATCH,   // argument number, method number, nargs, call site
+  LOCAL_DISPATCH, // local number, method number, nargs, call site
+  ADD_INT,        // constant number
+  SUB_INT,        // constant number
+  JUMP_IF_NOT_LT, // target
+  JUMP_IF_NOT_LE, // target
+  JUMP_IF_NOT_EQ, // target
+
+  OPCODE_END
+};
+
+class BytecodeError : public std::runtime_error {
+public:
+  BytecodeError(const std::string &what_arg) : std::runtime_error(what_arg) {}
+};
+
+class Method {
+public:
+  Method() : nargs(0), nlocals(0), max_stack(0) {}
+
+  std::string name; // Class.method
+  int nargs;
+  int nlocals;
+  int max_stack;
+  std::vector<int32_t> code; // empty for built-in methods
+};
+
+class Class {
+public:
+  // how the data part of the prototype is initialized
+  enum Kind { PLAIN, STRING, INT, BOOL };
+
+  Class() : id(0), kind(PLAIN), name_string(0), init(0) {}
+
+  std::string name;
+  int id;
+  Kind kind;
+  int name_string; // constant number
+  int init;        // method number of __init__
+  std::vector<Kind> fields; // PLAIN fields are void, others default values
+  std::vector<int> vtable;  // method numbers
+};
+
+class Program {
+public:
+  Program() : entry(0), nsites(0) {}
+
+  void save(std::ostream &o);
+  void load(std::istream &in);
+
+  std::vector<Class> classes; // class id i is classes[i - 1]
+  std::vector<Method> methods;
+  std::vector<std::string> strings;
+  std::vector<int64_t> ints;
+
+  int entry; // method number of the bootstrap code
+  int nsites;
+};
+
+class Variable;
+
+class Compiler {
+public:
+  Compiler(ast::Program *program, cool::SemanticAnalyser *sa)
+      : depth(0), program(program), sa(sa), method(nullptr), max_depth(0),
+        nlocals(0), max_locals(0), last(-1) {}
+
+  Program compile();
+
+  // --- used by ast::*::compile ---
+  typedef int Label;
+
+  Label new_label();
+  void bind(Label label);
+
+  void emit(Opcode op);
+  void emit(Opcode op, int a);
+  void emit(Opcode op, int a, int b);
+  void emit(Opcode op, int a, int b, int c);
+  void emit_jump(Opcode op, Label label);
+  void emit_jump(Opcode op, int a, Label label);
+  void emit_invoke(ast::Class *cls, const std::string &name, int nargs,
+                   bool dynamic);
+  void emit_load(const std::string &name);
+  void emit_store(const std::string &name);
+  void emit_default(ast::Class *cls);
+
+  int string_constant(const std::string &s);
+  int int_constant(int64_t i);
+
+  int enter_local(const std::string &name);
+  void exit_local();
+
+  // the stack depth after the last instruction; branches reset it
+  int depth;
+
+  ast::Program *program;
+  cool::SemanticAnalyser *sa;
+
+  cool::Scope<std::shared_ptr<Variable>> scope;
+
+private:
+  Program res;
+
+  std::map<std::string, int> methods_numbered;
+  std::map<std::string, int> strings_numbered;
+  std::map<int64_t, int> ints_numbered;
+
+  Method *method;
+  int max_depth;
+  int nlocals, max_locals;
+
+  std::vector<int> labels;
+  std::list<std::pair<int, Label>> fixups;
+  int last; // position of the last instruction, -1 if a label follows it
+
+  void arrange_classes();
+  void compile_method(ast::Class *cls, ast::Method *m);
+  void compile_bootstrap();
+  void adjust(int delta);
+  void append(std::initializer_list<int32_t> insn);
+  void fuse(int prev);
+};
+
+// whether `in` starts with the magic of a saved Program; rewinds `in`
+bool is_bytecode(std::istream &in);
+
+// run `program`; returns what Main.main returns
+int run(Program &program);
+
+} /* namespace vm */
+
+#endif /* _VM_HH */
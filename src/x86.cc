@@ -0,0 +1,1865 @@
+#include "x86.hh"
+
+#include <elf.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace x86 {
+
+namespace {
+
+const char *register_names[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp",
+                                "rsi", "rdi", "r8",  "r9",  "r10", "r11",
+                                "r12", "r13", "r14", "r15", "rip"};
+
+const char *byte_register_names[] = {"al", "cl", "dl", "bl"};
+
+const std::map<std::string, int> condition_codes = {
+    {"o", 0},   {"no", 1},  {"b", 2},    {"c", 2},   {"nae", 2}, {"ae", 3},
+    {"nb", 3},  {"nc", 3},  {"e", 4},    {"z", 4},   {"ne", 5},  {"nz", 5},
+    {"be", 6},  {"na", 6},  {"a", 7},    {"nbe", 7}, {"s", 8},   {"ns", 9},
+    {"p", 10},  {"pe", 10}, {"np", 11},  {"po", 11}, {"l", 12},  {"nge", 12},
+    {"ge", 13}, {"nl", 13}, {"le", 14},  {"ng", 14}, {"g", 15},  {"nle", 15}};
+
+const std::map<std::string, int> alu_ops = {
+    {"add", 0}, {"or", 1},  {"adc", 2}, {"sbb", 3},
+    {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7}};
+
+const std::map<std::string, int> unary_ops = {
+    {"inc", 0}, {"dec", 1}, {"not", 2}, {"neg", 3},
+    {"mul", 4}, {"div", 6}, {"idiv", 7}};
+
+const std::map<std::string, int> shift_ops = {
+    {"rol", 0}, {"ror", 1}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7}};
+
+// the condition code of `m` after `prefix`, e.g. of `jne` after `j`; -1 if
+// none
+int condition_code(const std::string &m, const std::string &prefix) {
+  if (m.compare(0, prefix.size(), prefix) != 0) {
+    return -1;
+  }
+  auto it = condition_codes.find(m.substr(prefix.size()));
+  return it == condition_codes.end() ? -1 : it->second;
+}
+
+std::string trim(const std::string &s) {
+  auto b = s.find_first_not_of(" \t\r");
+  if (b == std::string::npos) {
+    return "";
+  }
+  auto e = s.find_last_not_of(" \t\r");
+  return s.substr(b, e - b + 1);
+}
+
+// split at commas outside of parentheses and quotes, into `res`, which is
+// cleared first so that a caller in a loop can reuse its storage
+void split_args(const std::string &s, std::vector<std::string> &res) {
+  res.clear();
+  int depth = 0;
+  bool quoted = false;
+  std::string cur;
+  for (size_t i = 0; i < s.size(); ++i) {
+    char ch = s[i];
+    if (quoted && ch == '\\' && i + 1 < s.size()) {
+      cur.push_back(ch);
+      cur.push_back(s[++i]);
+      continue;
+    }
+    if (ch == '"') {
+      quoted = !quoted;
+    } else if (!quoted && ch == '(') {
+      depth++;
+    } else if (!quoted && ch == ')') {
+      depth--;
+    } else if (!quoted && depth == 0 && ch == ',') {
+      res.push_back(trim(cur));
+      cur.clear();
+      continue;
+    }
+    cur.push_back(ch);
+  }
+  if (!trim(cur).empty() || !res.empty()) {
+    res.push_back(trim(cur));
+  }
+}
+
+std::vector<std::string> split_args(const std::string &s) {
+  std::vector<std::string> res;
+  split_args(s, res);
+  return res;
+}
+
+bool is_symbol_char(char ch) {
+  return std::isalnum((unsigned char)ch) || ch == '_' || ch == '.' ||
+         ch == '$';
+}
+
+bool is_number(const std::string &s) {
+  if (s.empty() || !std::isdigit((unsigned char)s[0])) {
+    return false;
+  }
+  // `1f`, `1b` refer to numeric local labels
+  return s.size() < 2 || !(s.back() == 'f' || s.back() == 'b') ||
+         s.compare(0, 2, "0x") == 0;
+}
+
+int64_t parse_number(const std::string &s) {
+  size_t pos = 0;
+  int64_t v;
+  try {
+    v = (int64_t)std::stoull(s, &pos, 0);
+  } catch (std::logic_error &) {
+    throw AssemblyError("invalid number \"" + s + "\"");
+  }
+  if (pos != s.size()) {
+    throw AssemblyError("invalid number \"" + s + "\"");
+  }
+  return v;
+}
+
+// A signed sum of numbers and symbols, e.g. `a_END - a`, `sym+8`, `.-f`
+class Terms {
+public:
+  Terms(const std::string &expr) : constant(0) {
+    size_t i = 0;
+    int sign = 1;
+    bool expect_term = true;
+    while (i < expr.size()) {
+      char ch = expr[i];
+      if (std::isspace((unsigned char)ch)) {
+        ++i;
+      } else if (ch == '+' || ch == '-') {
+        if (!expect_term) {
+          expect_term = true;
+          sign = 1;
+        }
+        if (ch == '-') {
+          sign = -sign;
+        }
+        ++i;
+      } else if (is_symbol_char(ch)) {
+        size_t j = i;
+        while (j < expr.size() && is_symbol_char(expr[j])) {
+          ++j;
+        }
+        auto term = expr.substr(i, j - i);
+        if (is_number(term)) {
+          constant += sign * parse_number(term);
+        } else {
+          symbols.emplace_back(term, sign);
+        }
+        i = j;
+        sign = 1;
+        expect_term = false;
+      } else {
+        throw AssemblyError("invalid expression \"" + expr + "\"");
+      }
+    }
+    if (expect_term) {
+      throw AssemblyError("invalid expression \"" + expr + "\"");
+    }
+  }
+
+  int64_t constant;
+  std::list<std::pair<std::string, int>> symbols;
+};
+
+std::string value_str(int64_t value, const std::string &symbol) {
+  if (symbol.empty()) {
+    return std::to_string(value);
+  }
+  if (value > 0) {
+    return symbol + "+" + std::to_string(value);
+  }
+  if (value < 0) {
+    return symbol + std::to_string(value);
+  }
+  return symbol;
+}
+
+bool is_numeric_label(const std::string &name) {
+  for (auto ch : name) {
+    if (!std::isdigit((unsigned char)ch)) {
+      return false;
+    }
+  }
+  return !name.empty();
+}
+
+std::string numeric_label_name(const std::string &n, int instance) {
+  return ".Ll" + n + "_" + std::to_string(instance);
+}
+
+// DWARF numbers of %rax, %rcx, ..., %r15, %rip
+const int dwarf_registers[] = {0, 2, 1, 3, 7, 6, 4, 5, 8,
+                               9, 10, 11, 12, 13, 14, 15, 16};
+
+// the DWARF number of a register, e.g. 6 for `%rbp`
+int dwarf_register(const std::string &name) {
+  for (int i = 0; i <= RIP; ++i) {
+    if (name == std::string("%") + register_names[i]) {
+      return dwarf_registers[i];
+    }
+  }
+  throw AssemblyError("invalid register \"" + name + "\"");
+}
+
+// DWARF constants: of the compile unit, line number programs and call
+// frame instructions
+enum {
+  DW_TAG_compile_unit = 0x11,
+  DW_AT_name = 0x03,
+  DW_AT_stmt_list = 0x10,
+  DW_AT_low_pc = 0x11,
+  DW_AT_language = 0x13,
+  DW_AT_comp_dir = 0x1b,
+  DW_AT_producer = 0x25,
+  DW_AT_ranges = 0x55,
+  DW_FORM_addr = 0x01,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_string = 0x08,
+  DW_LANG_Mips_Assembler = 0x8001, // what gas says
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_set_file = 4,
+  DW_LNS_set_column = 5,
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2,
+  DW_CFA_advance_loc = 0x40,
+  DW_CFA_offset = 0x80,
+  DW_CFA_nop = 0,
+  DW_CFA_advance_loc1 = 2,
+  DW_CFA_advance_loc2 = 3,
+  DW_CFA_advance_loc4 = 4,
+  DW_CFA_remember_state = 0x0a,
+  DW_CFA_restore_state = 0x0b,
+  DW_CFA_def_cfa = 0x0c,
+  DW_CFA_def_cfa_register = 0x0d,
+  DW_CFA_def_cfa_offset = 0x0e
+};
+
+// the line number program header of gas, with opcodes up to 12
+const int line_base = -5, line_range = 14, opcode_base = 13;
+
+void put(std::vector<uint8_t> &buf, uint64_t v, int n) {
+  for (int i = 0; i < n; ++i) {
+    buf.push_back((v >> (8 * i)) & 0xff);
+  }
+}
+
+void put_uleb128(std::vector<uint8_t> &buf, uint64_t v) {
+  do {
+    uint8_t b = v & 0x7f;
+    v >>= 7;
+    buf.push_back(v ? b | 0x80 : b);
+  } while (v);
+}
+
+void put_sleb128(std::vector<uint8_t> &buf, int64_t v) {
+  bool more;
+  do {
+    uint8_t b = v & 0x7f;
+    v >>= 7;
+    more = !((v == 0 && !(b & 0x40)) || (v == -1 && (b & 0x40)));
+    buf.push_back(more ? b | 0x80 : b);
+  } while (more);
+}
+
+void put_string(std::vector<uint8_t> &buf, const std::string &s) {
+  buf.insert(buf.end(), s.begin(), s.end());
+  buf.push_back(0);
+}
+
+// patch the 4 bytes at `offset`
+void patch32(std::vector<uint8_t> &buf, uint64_t offset, uint32_t v) {
+  for (int i = 0; i < 4; ++i) {
+    buf[offset + i] = (v >> (8 * i)) & 0xff;
+  }
+}
+
+} // namespace
+
+bool Operand::operator==(const Operand &other) const {
+  return kind == other.kind && reg == other.reg && size == other.size &&
+         value == other.value && symbol == other.symbol &&
+         base == other.base && index == other.index && scale == other.scale &&
+         indirect == other.indirect;
+}
+
+std::string Operand::str() const {
+  std::string res = indirect ? "*" : "";
+  switch (kind) {
+  case REG:
+    return res + "%" +
+           (size == 1 ? byte_register_names[reg] : register_names[reg]);
+  case IMM:
+    return res + "$" + value_str(value, symbol);
+  case MEM:
+    if (!symbol.empty() || value != 0 || (base == NOREG && index == NOREG)) {
+      res += value_str(value, symbol);
+    }
+    if (base != NOREG || index != NOREG) {
+      res += "(";
+      if (base != NOREG) {
+        res += std::string("%") + register_names[base];
+      }
+      if (index != NOREG) {
+        res += std::string(",%") + register_names[index] + "," +
+               std::to_string(scale);
+      }
+      res += ")";
+    }
+    return res;
+  default:
+    return res;
+  }
+}
+
+std::string Line::str() const {
+  switch (kind) {
+  case LABEL:
+    return name + ":";
+  case DIRECTIVE:
+    return "  " + name + (args.empty() ? "" : " " + args);
+  default:
+    std::string res = "  " + name;
+    for (size_t i = 0; i < operands.size(); ++i) {
+      res += (i ? ", " : " ") + operands[i].str();
+    }
+    return res;
+  }
+}
+
+Operand imm(int64_t value) {
+  Operand op;
+  op.kind = Operand::IMM;
+  op.value = value;
+  return op;
+}
+
+Operand imm(const std::string &symbol, int64_t value) {
+  auto op = imm(value);
+  op.symbol = symbol;
+  return op;
+}
+
+Operand mem(int64_t value, Register base, Register index, int scale) {
+  if (index == RSP || index == RIP) {
+    throw AssemblyError("invalid index register");
+  }
+  Operand op;
+  op.kind = Operand::MEM;
+  op.value = value;
+  op.base = base;
+  op.index = index;
+  op.scale = scale;
+  return op;
+}
+
+Operand mem(const std::string &symbol, int64_t value, Register base,
+            Register index, int scale) {
+  auto op = mem(value, base, index, scale);
+  op.symbol = symbol;
+  return op;
+}
+
+Operand sym(const std::string &symbol, int64_t value) {
+  return mem(symbol, value, NOREG);
+}
+
+Operand byte(Register reg) {
+  Operand op(reg);
+  op.size = 1;
+  return op;
+}
+
+Operand indirect(Operand op) {
+  op.indirect = true;
+  return op;
+}
+
+void Emitter::label(const std::string &name) {
+  if (is_numeric_label(name)) {
+    lines.emplace_back(Line::LABEL, numeric_label_name(name, ++defined[name]));
+  } else {
+    lines.emplace_back(Line::LABEL, name);
+  }
+}
+
+void Emitter::directive(const std::string &name, const std::string &args) {
+  lines.emplace_back(Line::DIRECTIVE, name);
+  lines.back().args = args;
+}
+
+void Emitter::ins(const std::string &mnemonic) {
+  add(mnemonic, 0);
+  resolve();
+}
+
+void Emitter::ins(const std::string &mnemonic, Operand a) {
+  auto &operands = add(mnemonic, 1);
+  operands.push_back(std::move(a));
+  resolve();
+}
+
+void Emitter::ins(const std::string &mnemonic, Operand a, Operand b) {
+  auto &operands = add(mnemonic, 2);
+  operands.push_back(std::move(a));
+  operands.push_back(std::move(b));
+  resolve();
+}
+
+void Emitter::ins(const std::string &mnemonic, Operand a, Operand b,
+                  Operand c) {
+  auto &operands = add(mnemonic, 3);
+  operands.push_back(std::move(a));
+  operands.push_back(std::move(b));
+  operands.push_back(std::move(c));
+  resolve();
+}
+
+void Emitter::flush() {
+  if (sink) {
+    sink(lines);
+  }
+  lines.clear();
+}
+
+std::vector<Operand> &Emitter::add(const std::string &mnemonic, int n) {
+  lines.emplace_back(Line::INSTRUCTION, mnemonic);
+  auto &line = lines.back();
+  line.loc = loc;
+  line.operands.reserve(n);
+  return line.operands;
+}
+
+// `jmp 1b` / `jmp 1f` and `jmp .` refer to ordinary local labels
+void Emitter::resolve() {
+  for (auto &op : lines.back().operands) {
+    auto &sym = op.symbol;
+    if (sym == ".") {
+      sym = ".Lhere" + std::to_string(++here);
+      lines.insert(std::prev(lines.end()), Line(Line::LABEL, sym));
+    } else if (sym.size() > 1 && std::isdigit((unsigned char)sym[0]) &&
+               (sym.back() == 'f' || sym.back() == 'b') &&
+               is_numeric_label(sym.substr(0, sym.size() - 1))) {
+      auto n = sym.substr(0, sym.size() - 1);
+      sym = numeric_label_name(n, defined[n] + (sym.back() == 'f' ? 1 : 0));
+    }
+  }
+}
+
+void print(std::ostream &o, const std::list<Line> &lines) {
+  Loc loc;
+  for (auto &line : lines) {
+    if (line.kind == Line::LABEL) {
+      o << "\n";
+    }
+    if (line.kind == Line::INSTRUCTION && line.loc != loc) {
+      loc = line.loc;
+      if (loc.file) {
+        o << "  .loc " << loc.file << " " << loc.line << " " << loc.column
+          << "\n";
+      }
+    }
+    o << line.str() << "\n";
+  }
+}
+
+bool is_local_label(const std::string &name) {
+  return name.compare(0, 2, ".L") == 0;
+}
+
+Section::Section(std::string name)
+    : name(name), type(SHT_PROGBITS), flags(SHF_ALLOC), align(1), size(0) {
+  if (name.compare(0, 5, ".text") == 0) {
+    flags |= SHF_EXECINSTR;
+  } else if (name.compare(0, 5, ".data") == 0) {
+    flags |= SHF_WRITE;
+  } else if (name.compare(0, 4, ".bss") == 0) {
+    type = SHT_NOBITS;
+    flags |= SHF_WRITE;
+  } else if (name.compare(0, 5, ".note") == 0) {
+    type = SHT_NOTE;
+    flags = 0;
+  }
+}
+
+Symbol *Object::find_symbol(const std::string &name) {
+  auto it = symbols_numbered.find(name);
+  return it == symbols_numbered.end() ? nullptr : &symbols[it->second];
+}
+
+bool Assembler::known_mnemonic(const std::string &m, Opcode &op, int &k) {
+  static const std::map<std::string, Opcode> plain_ops = {
+      {"mov", MOV},     {"movabs", MOVABS}, {"movzb", MOVZB}, {"lea", LEA},
+      {"push", PUSH},   {"pop", POP},       {"test", TEST},   {"imul", IMUL},
+      {"call", CALL},   {"jmp", JMP},       {"ret", RET},     {"cqto", CQTO},
+      {"cqo", CQTO},    {"nop", NOP},       {"leave", LEAVE}, {"rdtsc", RDTSC},
+      {"ud2", UD2},     {"int3", INT3}};
+
+  std::map<std::string, int>::const_iterator it;
+  auto plain = plain_ops.find(m);
+  if (plain != plain_ops.end()) {
+    op = plain->second;
+  } else if ((it = alu_ops.find(m)) != alu_ops.end()) {
+    op = ALU;
+    k = it->second;
+  } else if ((it = unary_ops.find(m)) != unary_ops.end()) {
+    op = UNARY;
+    k = it->second;
+  } else if ((it = shift_ops.find(m)) != shift_ops.end()) {
+    op = SHIFT;
+    k = it->second;
+  } else if ((k = condition_code(m, "j")) >= 0) {
+    op = JCC;
+  } else if ((k = condition_code(m, "set")) >= 0) {
+    op = SETCC;
+  } else if ((k = condition_code(m, "cmov")) >= 0) {
+    op = CMOVCC;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+Assembler::Mnemonic Assembler::decode_mnemonic(const std::string &m) {
+  Opcode op;
+  int k = 0;
+  if (known_mnemonic(m, op, k) ||
+      (m.size() > 1 && m.back() == 'q' &&
+       known_mnemonic(m.substr(0, m.size() - 1), op, k))) {
+    return Mnemonic(op, k);
+  }
+  throw AssemblyError("unknown instruction \"" + m + "\"");
+}
+
+void Assembler::emit(uint64_t v, int n) {
+  for (int i = 0; i < n; ++i) {
+    buf.push_back((v >> (8 * i)) & 0xff);
+  }
+}
+
+bool fits_int8(int64_t v) { return v >= -128 && v <= 127; }
+
+bool fits_int32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+void Assembler::emit_rex(bool w, int reg, const Operand &rm) {
+  uint8_t rex = 0x40;
+  if (w) {
+    rex |= 8;
+  }
+  if (reg >= 8) {
+    rex |= 4;
+  }
+  if (rm.kind == Operand::MEM) {
+    if (rm.index != NOREG && rm.index >= 8) {
+      rex |= 2;
+    }
+    if (rm.base != NOREG && rm.base != RIP && rm.base >= 8) {
+      rex |= 1;
+    }
+  } else if (rm.kind == Operand::REG && rm.reg >= 8) {
+    rex |= 1;
+  }
+  if (rex != 0x40) {
+    emit(rex);
+  }
+}
+
+void Assembler::emit_abs32(int64_t value, const std::string &symbol) {
+  if (!symbol.empty()) {
+    relocs.emplace_back(buf.size(), R_X86_64_32S, symbol, value);
+    value = 0;
+  } else if (!fits_int32(value)) {
+    throw AssemblyError("value out of range: " + std::to_string(value));
+  }
+  emit((uint64_t)value, 4);
+}
+
+void Assembler::emit_modrm(int reg, const Operand &rm, int imm_bytes) {
+  reg &= 7;
+  if (rm.kind == Operand::REG) {
+    emit(0xc0 | reg << 3 | (rm.reg & 7));
+    return;
+  }
+  if (rm.kind != Operand::MEM) {
+    throw AssemblyError("invalid operand \"" + rm.str() + "\"");
+  }
+
+  int scale_bits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+  if (rm.index != NOREG && (1 << scale_bits) != rm.scale) {
+    throw AssemblyError("invalid scale in \"" + rm.str() + "\"");
+  }
+
+  if (rm.base == RIP) {
+    emit(0x05 | reg << 3);
+    if (rm.symbol.empty()) {
+      emit((uint64_t)rm.value, 4);
+      return;
+    }
+    int section;
+    uint64_t value;
+    if (final && lookup(rm.symbol, section, value) &&
+        section == item->section) {
+      auto next = item->addr + buf.size() + 4 + imm_bytes;
+      emit(value + rm.value - next, 4);
+    } else {
+      relocs.emplace_back(buf.size(), R_X86_64_PC32, rm.symbol,
+                          rm.value - 4 - imm_bytes);
+      emit(0, 4);
+    }
+    return;
+  }
+
+  if (rm.base == NOREG) {
+    emit(0x04 | reg << 3);
+    if (rm.index != NOREG) {
+      emit(scale_bits << 6 | (rm.index & 7) << 3 | 5);
+    } else {
+      emit(0x25);
+    }
+    emit_abs32(rm.value, rm.symbol);
+    return;
+  }
+
+  int mod;
+  if (!rm.symbol.empty() || !fits_int8(rm.value)) {
+    mod = 2;
+  } else if (rm.value == 0 && (rm.base & 7) != RBP) {
+    mod = 0;
+  } else {
+    mod = 1;
+  }
+
+  if (rm.index != NOREG || (rm.base & 7) == RSP) {
+    emit(mod << 6 | reg << 3 | 4);
+    int index = rm.index == NOREG ? RSP : rm.index;
+    emit(scale_bits << 6 | (index & 7) << 3 | (rm.base & 7));
+  } else {
+    emit(mod << 6 | reg << 3 | (rm.base & 7));
+  }
+
+  if (mod == 1) {
+    emit((uint64_t)rm.value, 1);
+  } else if (mod == 2) {
+    emit_abs32(rm.value, rm.symbol);
+  }
+}
+
+void Assembler::emit_op(std::initializer_list<uint8_t> opcode, bool w,
+                        int reg, const Operand &rm, int imm_bytes) {
+  emit_rex(w, reg, rm);
+  for (auto b : opcode) {
+    emit(b);
+  }
+  emit_modrm(reg, rm, imm_bytes);
+}
+
+void Assembler::emit_imm(const Operand &imm, int n) {
+  if (n == 4) {
+    emit_abs32(imm.value, imm.symbol);
+  } else if (n == 8 && !imm.symbol.empty()) {
+    relocs.emplace_back(buf.size(), R_X86_64_64, imm.symbol, imm.value);
+    emit(0, 8);
+  } else {
+    emit((uint64_t)imm.value, n);
+  }
+}
+
+void Assembler::emit_rel32(const Operand &target, uint32_t reloc_type) {
+  int section;
+  uint64_t value;
+  auto defined = lookup_target(target, section, value);
+  if (final && defined && section == item->section) {
+    auto next = item->addr + buf.size() + 4;
+    emit(value + target.value - next, 4);
+    return;
+  }
+  if (defined) {
+    reloc_type = R_X86_64_PC32;
+  }
+  relocs.emplace_back(buf.size(), reloc_type, target.symbol, target.value - 4);
+  emit(0, 4);
+}
+
+int Assembler::section_no(const std::string &name) {
+  for (size_t i = 0; i < obj.sections.size(); ++i) {
+    if (obj.sections[i].name == name) {
+      return i;
+    }
+  }
+  obj.sections.emplace_back(name);
+  return obj.sections.size() - 1;
+}
+
+void Assembler::switch_section(const std::string &args,
+                               const std::string &directive) {
+  if (directive == ".popsection") {
+    if (stack.empty()) {
+      throw AssemblyError(".popsection without .pushsection");
+    }
+    cur = stack.back();
+    stack.pop_back();
+    return;
+  }
+  if (directive == ".pushsection") {
+    stack.push_back(cur);
+  }
+  if (directive != ".section" && directive != ".pushsection") {
+    cur = section_no(directive); // .text, .data, .bss
+    return;
+  }
+
+  auto parts = split_args(args);
+  if (parts.empty()) {
+    throw AssemblyError(directive + " without a name");
+  }
+  cur = section_no(parts[0]);
+  auto &section = obj.sections[cur];
+  if (parts.size() > 1) {
+    auto flags = parts[1];
+    if (flags.size() < 2 || flags.front() != '"' || flags.back() != '"') {
+      throw AssemblyError("invalid section flags " + flags);
+    }
+    section.flags = 0;
+    for (auto ch : flags.substr(1, flags.size() - 2)) {
+      switch (ch) {
+      case 'a':
+        section.flags |= SHF_ALLOC;
+        break;
+      case 'w':
+        section.flags |= SHF_WRITE;
+        break;
+      case 'x':
+        section.flags |= SHF_EXECINSTR;
+        break;
+      case '?':
+        break;
+      default:
+        throw AssemblyError(std::string("unsupported section flag ") + ch);
+      }
+    }
+  }
+  if (parts.size() > 2) {
+    if (parts[2] == "@progbits") {
+      section.type = SHT_PROGBITS;
+    } else if (parts[2] == "@nobits") {
+      section.type = SHT_NOBITS;
+    } else if (parts[2] == "@note") {
+      section.type = SHT_NOTE;
+    } else {
+      throw AssemblyError("unsupported section type " + parts[2]);
+    }
+  }
+}
+
+int Assembler::symbol_no(const std::string &name) {
+  auto it = obj.symbols_numbered.find(name);
+  if (it != obj.symbols_numbered.end()) {
+    return it->second;
+  }
+  obj.symbols_numbered[name] = obj.symbols.size();
+  obj.symbols.emplace_back();
+  obj.symbols.back().name = name;
+  return obj.symbols.size() - 1;
+}
+
+Symbol &Assembler::symbol(const std::string &name) {
+  return obj.symbols[symbol_no(name)];
+}
+
+bool Assembler::lookup(const std::string &name, int &section,
+                       uint64_t &value) {
+  if (name == ".") {
+    section = item->section;
+    value = item->addr + buf.size();
+    return true;
+  }
+  auto sym = obj.find_symbol(name);
+  if (!sym || sym->section < 0) {
+    return false;
+  }
+  section = sym->section;
+  value = sym->value;
+  return true;
+}
+
+bool Assembler::lookup_target(const Operand &target, int &section,
+                              uint64_t &value) {
+  if (item->symbol < 0) {
+    return lookup(target.symbol, section, value);
+  }
+  auto &sym = obj.symbols[item->symbol];
+  section = sym.section;
+  value = sym.value;
+  return section >= 0;
+}
+
+int64_t Assembler::absolute(const std::string &expr) {
+  std::string sym;
+  int64_t value;
+  if (!relocatable(expr, sym, value) || !sym.empty()) {
+    throw AssemblyError("expression \"" + expr + "\" is not absolute");
+  }
+  return value;
+}
+
+// evaluate `expr` to `sym + addend`; `sym` is empty for absolute values
+bool Assembler::relocatable(const std::string &expr, std::string &sym,
+                            int64_t &addend) {
+  Terms terms(expr);
+  addend = terms.constant;
+  sym.clear();
+
+  std::map<int, int> sections;
+  std::map<int, std::pair<std::string, uint64_t>> candidates;
+  std::list<std::pair<std::string, int>> undefined;
+  for (auto &term : terms.symbols) {
+    int section;
+    uint64_t value;
+    if (!lookup(term.first, section, value)) {
+      undefined.push_back(term);
+      continue;
+    }
+    addend += term.second * (int64_t)value;
+    sections[section] += term.second;
+    if (term.second > 0) {
+      candidates[section] = std::make_pair(term.first, value);
+    }
+  }
+
+  // labels of the same section cancel out, e.g. `a_END - a`
+  int relative_to = -1;
+  for (auto &s : sections) {
+    if (s.second == 0) {
+      continue;
+    }
+    if (s.second != 1 || relative_to >= 0) {
+      return false;
+    }
+    relative_to = s.first;
+  }
+
+  if (relative_to < 0) {
+    if (undefined.empty()) {
+      return true;
+    }
+    if (undefined.size() == 1 && undefined.front().second == 1) {
+      sym = undefined.front().first;
+      return true;
+    }
+    return false;
+  }
+
+  auto &candidate = candidates[relative_to];
+  if (!undefined.empty() || candidate.first == ".") {
+    return false;
+  }
+  sym = candidate.first;
+  addend -= candidate.second;
+  return true;
+}
+
+void Assembler::data(const std::string &args, int size) {
+  for (auto &arg : split_args(args)) {
+    if (!final) {
+      emit(0, size);
+      continue;
+    }
+    std::string sym;
+    int64_t value;
+    if (!relocatable(arg, sym, value)) {
+      throw AssemblyError("cannot evaluate \"" + arg + "\"");
+    }
+    if (!sym.empty()) {
+      if (size != 8 && size != 4) {
+        throw AssemblyError("cannot relocate \"" + arg + "\"");
+      }
+      relocs.emplace_back(buf.size(), size == 8 ? R_X86_64_64 : R_X86_64_32,
+                          sym, value);
+      value = 0;
+    }
+    emit((uint64_t)value, size);
+  }
+}
+
+void Assembler::string_data(const std::string &args, bool terminate) {
+  for (auto &arg : split_args(args)) {
+    if (arg.size() < 2 || arg.front() != '"' || arg.back() != '"') {
+      throw AssemblyError("invalid string " + arg);
+    }
+    for (size_t i = 1; i + 1 < arg.size(); ++i) {
+      char ch = arg[i];
+      if (ch != '\\') {
+        emit((uint8_t)ch);
+        continue;
+      }
+      ch = arg[++i];
+      switch (ch) {
+      case 'n':
+        emit((uint8_t)'\n');
+        break;
+      case 't':
+        emit((uint8_t)'\t');
+        break;
+      case 'f':
+        emit((uint8_t)'\f');
+        break;
+      case 'b':
+        emit((uint8_t)'\b');
+        break;
+      case 'r':
+        emit((uint8_t)'\r');
+        break;
+      case 'x': {
+        int v = 0;
+        while (i + 2 < arg.size() && std::isxdigit((unsigned char)arg[i + 1])) {
+          v = v * 16 + std::stoi(std::string(1, arg[++i]), nullptr, 16);
+        }
+        emit((uint8_t)v);
+        break;
+      }
+      default:
+        if (ch >= '0' && ch <= '7') {
+          int v = ch - '0';
+          for (int k = 0; k < 2 && arg[i + 1] >= '0' && arg[i + 1] <= '7';
+               ++k) {
+            v = v * 8 + (arg[++i] - '0');
+          }
+          emit((uint8_t)v);
+        } else {
+          emit((uint8_t)ch);
+        }
+      }
+    }
+    if (terminate) {
+      emit((uint8_t)0);
+    }
+  }
+}
+
+// recommended multi-byte nops
+const std::vector<std::vector<uint8_t>> nops = {
+    {},
+    {0x90},
+    {0x66, 0x90},
+    {0x0f, 0x1f, 0x00},
+    {0x0f, 0x1f, 0x40, 0x00},
+    {0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+    {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
+void Assembler::align(uint64_t n, bool power_of_two, uint64_t max) {
+  if (power_of_two) {
+    n = 1ull << n;
+  }
+  if (n == 0 || (n & (n - 1))) {
+    throw AssemblyError("invalid alignment " + std::to_string(n));
+  }
+  auto &section = obj.sections[item->section];
+  if (n > section.align) {
+    section.align = n;
+  }
+  auto pad = (n - item->addr % n) % n;
+  if (max && pad > max) {
+    return;
+  }
+  if (!(section.flags & SHF_EXECINSTR)) {
+    emit(0, pad);
+    return;
+  }
+  while (pad > 0) {
+    auto k = pad < nops.size() ? pad : nops.size() - 1;
+    for (auto b : nops[k]) {
+      emit(b);
+    }
+    pad -= k;
+  }
+}
+
+void Assembler::directive() {
+  auto &name = item->line->name;
+  auto &args = item->line->args;
+
+  if (name == ".quad" || name == ".8byte") {
+    data(args, 8);
+  } else if (name == ".long" || name == ".4byte" || name == ".int") {
+    data(args, 4);
+  } else if (name == ".short" || name == ".2byte" || name == ".word") {
+    data(args, 2);
+  } else if (name == ".byte") {
+    data(args, 1);
+  } else if (name == ".string" || name == ".asciz") {
+    string_data(args, true);
+  } else if (name == ".ascii") {
+    string_data(args, false);
+  } else if (name == ".zero" || name == ".skip") {
+    emit(0, absolute(args));
+  } else if (name == ".balign" || name == ".align" || name == ".p2align") {
+    auto parts = split_args(args);
+    // the fill byte is ignored; code is padded with nops and data with 0
+    uint64_t max = 0;
+    if (parts.size() > 2 && !parts[2].empty()) {
+      max = absolute(parts[2]);
+    }
+    align(absolute(parts[0]), name == ".p2align", max);
+  } else if (name == ".globl" || name == ".global") {
+    if (final) {
+      symbol(args).global = true;
+    }
+  } else if (name == ".type") {
+    auto parts = split_args(args);
+    if (final && parts.size() == 2) {
+      symbol(parts[0]).type =
+          parts[1] == "@function" ? STT_FUNC
+                                  : parts[1] == "@object" ? STT_OBJECT : 0;
+    }
+  } else if (name == ".size") {
+    auto parts = split_args(args);
+    if (final && parts.size() == 2) {
+      symbol(parts[0]).size = absolute(parts[1]);
+    }
+  } else if (name == ".text" || name == ".data" || name == ".bss" ||
+             name == ".section" || name == ".pushsection" ||
+             name == ".popsection") {
+    // handled in `assemble`
+  } else if (name == ".file") {
+    // `.file 1 "a.cl"`
+    auto space = args.find(' ');
+    auto filename = space == std::string::npos ? "" : trim(args.substr(space));
+    if (filename.size() < 2 || filename.front() != '"' ||
+        filename.back() != '"') {
+      throw AssemblyError("invalid .file \"" + args + "\"");
+    }
+    auto n = absolute(args.substr(0, space));
+    if (n < 1) {
+      throw AssemblyError("invalid file number " + std::to_string(n));
+    }
+    if (final) {
+      files.resize(std::max<size_t>(files.size(), n));
+      files[n - 1] = filename.substr(1, filename.size() - 2);
+    }
+  } else if (name.compare(0, 5, ".cfi_") == 0) {
+    if (final) {
+      cfi(name, args);
+    }
+  } else if (name == ".ident") {
+  } else {
+    throw AssemblyError("unsupported directive \"" + name + "\"");
+  }
+}
+
+void Assembler::instruction() {
+  auto &line = *item->line;
+  auto op = item->mnemonic->op;
+  int k = item->mnemonic->k;
+  auto &ops = line.operands;
+  auto n = ops.size();
+
+  auto bad = [&]() {
+    return AssemblyError("invalid operands for \"" + line.str().substr(2) +
+                         "\"");
+  };
+  auto need = [&](size_t k) {
+    if (n != k) {
+      throw bad();
+    }
+  };
+
+  switch (op) {
+  case MOV: {
+    need(2);
+    auto &src = ops[0], &dst = ops[1];
+    if (src.kind == Operand::IMM) {
+      if (src.symbol.empty() && !fits_int32(src.value)) {
+        if (dst.kind != Operand::REG) {
+          throw bad();
+        }
+        emit_rex(true, 0, dst);
+        emit(0xb8 + (dst.reg & 7));
+        emit_imm(src, 8);
+      } else {
+        emit_op({0xc7}, true, 0, dst, 4);
+        emit_imm(src, 4);
+      }
+    } else if (src.kind == Operand::REG) {
+      emit_op({0x89}, true, src.reg, dst, 0);
+    } else if (dst.kind == Operand::REG) {
+      emit_op({0x8b}, true, dst.reg, src, 0);
+    } else {
+      throw bad();
+    }
+    break;
+  }
+  case TEST: {
+    need(2);
+    auto &src = ops[0], &dst = ops[1];
+    if (dst.kind == Operand::IMM) {
+      throw bad();
+    }
+    if (src.kind == Operand::IMM) {
+      emit_op({0xf7}, true, 0, dst, 4);
+      emit_imm(src, 4);
+    } else if (src.kind == Operand::REG) {
+      emit_op({0x85}, true, src.reg, dst, 0);
+    } else if (dst.kind == Operand::REG) {
+      emit_op({0x85}, true, dst.reg, src, 0);
+    } else {
+      throw bad();
+    }
+    break;
+  }
+  case ALU: {
+    need(2);
+    auto &src = ops[0], &dst = ops[1];
+    if (dst.kind == Operand::IMM) {
+      throw bad();
+    }
+    if (src.kind == Operand::IMM) {
+      if (src.symbol.empty() && fits_int8(src.value)) {
+        emit_op({0x83}, true, k, dst, 1);
+        emit_imm(src, 1);
+      } else {
+        emit_op({0x81}, true, k, dst, 4);
+        emit_imm(src, 4);
+      }
+    } else if (src.kind == Operand::REG) {
+      emit_op({(uint8_t)(k * 8 + 1)}, true, src.reg, dst, 0);
+    } else if (dst.kind == Operand::REG) {
+      emit_op({(uint8_t)(k * 8 + 3)}, true, dst.reg, src, 0);
+    } else {
+      throw bad();
+    }
+    break;
+  }
+  case MOVABS:
+    need(2);
+    if (ops[0].kind != Operand::IMM || ops[1].kind != Operand::REG) {
+      throw bad();
+    }
+    emit_rex(true, 0, ops[1]);
+    emit(0xb8 + (ops[1].reg & 7));
+    emit_imm(ops[0], 8);
+    break;
+  case MOVZB:
+    need(2);
+    if (ops[1].kind != Operand::REG ||
+        (ops[0].kind == Operand::REG && ops[0].size != 1)) {
+      throw bad();
+    }
+    emit_op({0x0f, 0xb6}, true, ops[1].reg, ops[0], 0);
+    break;
+  case LEA:
+    need(2);
+    if (!ops[0].is_mem() || ops[1].kind != Operand::REG) {
+      throw bad();
+    }
+    emit_op({0x8d}, true, ops[1].reg, ops[0], 0);
+    break;
+  case PUSH: {
+    need(1);
+    auto &op = ops[0];
+    if (op.kind == Operand::REG) {
+      emit_rex(false, 0, op);
+      emit(0x50 + (op.reg & 7));
+    } else if (op.kind == Operand::IMM) {
+      if (op.symbol.empty() && fits_int8(op.value)) {
+        emit(0x6a);
+        emit_imm(op, 1);
+      } else {
+        emit(0x68);
+        emit_imm(op, 4);
+      }
+    } else {
+      emit_op({0xff}, false, 6, op, 0);
+    }
+    break;
+  }
+  case POP: {
+    need(1);
+    auto &op = ops[0];
+    if (op.kind == Operand::REG) {
+      emit_rex(false, 0, op);
+      emit(0x58 + (op.reg & 7));
+    } else if (op.kind == Operand::MEM) {
+      emit_op({0x8f}, false, 0, op, 0);
+    } else {
+      throw bad();
+    }
+    break;
+  }
+  case UNARY:
+    need(1);
+    if (ops[0].kind == Operand::IMM) {
+      throw bad();
+    }
+    emit_op({(uint8_t)(k < 2 ? 0xff : 0xf7)}, true, k, ops[0], 0);
+    break;
+  case IMUL: {
+    if (n == 1) {
+      // `imulq %rcx`: %rdx:%rax = %rax * %rcx
+      if (ops[0].kind == Operand::IMM) {
+        throw bad();
+      }
+      emit_op({0xf7}, true, 5, ops[0], 0);
+      break;
+    }
+    if (n == 2 && ops[0].kind != Operand::IMM) {
+      if (ops[1].kind != Operand::REG) {
+        throw bad();
+      }
+      emit_op({0x0f, 0xaf}, true, ops[1].reg, ops[0], 0);
+      break;
+    }
+    if (n < 2 || n > 3) {
+      throw bad();
+    }
+    // `imulq $k, %rax` is short for `imulq $k, %rax, %rax`
+    auto &imm = ops[0], &src = ops[1], &dst = ops[n - 1];
+    if (imm.kind != Operand::IMM || dst.kind != Operand::REG) {
+      throw bad();
+    }
+    if (imm.symbol.empty() && fits_int8(imm.value)) {
+      emit_op({0x6b}, true, dst.reg, src, 1);
+      emit_imm(imm, 1);
+    } else {
+      emit_op({0x69}, true, dst.reg, src, 4);
+      emit_imm(imm, 4);
+    }
+    break;
+  }
+  case SHIFT:
+    if (n == 1) {
+      emit_op({0xd1}, true, k, ops[0], 0);
+    } else if (n == 2 && ops[0].kind == Operand::IMM) {
+      if (ops[0].value == 1) {
+        emit_op({0xd1}, true, k, ops[1], 0);
+      } else {
+        emit_op({0xc1}, true, k, ops[1], 1);
+        emit_imm(ops[0], 1);
+      }
+    } else if (n == 2 && ops[0].kind == Operand::REG && ops[0].size == 1 &&
+               ops[0].reg == RCX) {
+      emit_op({0xd3}, true, k, ops[1], 0);
+    } else {
+      throw bad();
+    }
+    break;
+  case CALL:
+  case JMP: {
+    need(1);
+    auto &target = ops[0];
+    if (target.indirect) {
+      emit_op({0xff}, false, op == CALL ? 2 : 4, target, 0);
+    } else if (!target.is_plain_symbol()) {
+      throw bad();
+    } else if (op == CALL) {
+      emit(0xe8);
+      emit_rel32(target, R_X86_64_PLT32);
+    } else if (item->long_branch) {
+      emit(0xe9);
+      emit_rel32(target, R_X86_64_PLT32);
+    } else {
+      emit(0xeb);
+      emit(0);
+    }
+    break;
+  }
+  case JCC:
+    need(1);
+    if (!ops[0].is_plain_symbol() || ops[0].indirect) {
+      throw bad();
+    }
+    if (item->long_branch) {
+      emit(0x0f);
+      emit(0x80 + k);
+      emit_rel32(ops[0], R_X86_64_PLT32);
+    } else {
+      emit(0x70 + k);
+      emit(0);
+    }
+    break;
+  case SETCC:
+    need(1);
+    if (ops[0].kind == Operand::REG && ops[0].size != 1) {
+      throw bad();
+    }
+    emit_op({0x0f, (uint8_t)(0x90 + k)}, false, 0, ops[0], 0);
+    break;
+  case CMOVCC:
+    need(2);
+    if (ops[1].kind != Operand::REG || ops[0].kind == Operand::IMM) {
+      throw bad();
+    }
+    emit_op({0x0f, (uint8_t)(0x40 + k)}, true, ops[1].reg, ops[0], 0);
+    break;
+  case RET:
+    need(0);
+    emit(0xc3);
+    break;
+  case CQTO:
+    need(0);
+    emit(0x48);
+    emit(0x99);
+    break;
+  case NOP:
+    need(0);
+    emit(0x90);
+    break;
+  case LEAVE:
+    need(0);
+    emit(0xc9);
+    break;
+  case RDTSC:
+    need(0);
+    emit(0x0f);
+    emit(0x31);
+    break;
+  case UD2:
+    need(0);
+    emit(0x0f);
+    emit(0x0b);
+    break;
+  case INT3:
+    need(0);
+    emit(0xcc);
+    break;
+  }
+}
+
+void Assembler::encode() {
+  buf.clear();
+  relocs.clear();
+  if (item->line->kind == Line::DIRECTIVE) {
+    directive();
+  } else if (item->line->kind == Line::INSTRUCTION) {
+    instruction();
+  }
+
+  // short branches are patched here, once every label is known
+  if (final && item->branch && !item->long_branch) {
+    int section;
+    uint64_t value;
+    auto &target = item->line->operands[0];
+    if (!lookup_target(target, section, value) || section != item->section) {
+      throw AssemblyError("bad short branch " + item->line->str());
+    }
+    auto disp = (int64_t)(value + target.value) -
+                (int64_t)(item->addr + buf.size());
+    if (!fits_int8(disp)) {
+      throw AssemblyError("bad short branch " + item->line->str());
+    }
+    buf.back() = (uint8_t)disp;
+  }
+}
+
+// place the items; once `sized`, only `resized` ones are encoded again
+void Assembler::layout(bool sized) {
+  std::vector<uint64_t> offsets;
+  for (auto &section : obj.sections) {
+    offsets.push_back(section.size);
+  }
+  for (auto &it : items) {
+    item = &it;
+    it.addr = offsets[it.section];
+    if (it.line->kind == Line::LABEL) {
+      auto &sym = obj.symbols[it.symbol];
+      sym.section = it.section;
+      sym.value = it.addr;
+      continue;
+    }
+    if (!sized || it.resized) {
+      encode();
+      it.size = buf.size();
+    }
+    if (!sized && it.line->kind == Line::INSTRUCTION && !it.branch &&
+        relocs.empty() && obj.sections[it.section].type != SHT_NOBITS) {
+      it.fixed = true;
+      it.draft = drafts.size();
+      drafts.insert(drafts.end(), buf.begin(), buf.end());
+    }
+    offsets[it.section] += it.size;
+  }
+}
+
+bool Assembler::fits_rel8(const Operand &target, int size) {
+  int section;
+  uint64_t value;
+  if (!lookup_target(target, section, value) || section != item->section) {
+    return false;
+  }
+  auto disp =
+      (int64_t)(value + target.value) - (int64_t)(item->addr + size);
+  return fits_int8(disp);
+}
+
+// grow short branches that cannot reach their target; true if anything grew
+bool Assembler::relax() {
+  bool changed = false;
+  for (auto &it : items) {
+    item = &it;
+    if (it.branch && !it.long_branch && !fits_rel8(it.line->operands[0], 2)) {
+      it.long_branch = true;
+      encode();
+      it.size = buf.size();
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+Assembler::Assembler()
+    : cur(0), fde(-1), fde_section(0), fde_start(0), fde_addr(0), final(false),
+      item(nullptr) {
+  section_no(".text");
+}
+
+void Assembler::add(const std::list<Line> &lines) {
+  items.clear();
+  drafts.clear();
+  loc = Loc(); // as x86::print starts
+  items.reserve(lines.size());
+  for (auto &line : lines) {
+    if (line.kind == Line::DIRECTIVE &&
+        (line.name == ".text" || line.name == ".data" || line.name == ".bss" ||
+         line.name == ".section" || line.name == ".pushsection" ||
+         line.name == ".popsection")) {
+      switch_section(line.args, line.name);
+    }
+    items.emplace_back(&line, cur);
+    auto &it = items.back();
+    if (line.kind == Line::LABEL) {
+      it.symbol = symbol_no(line.name);
+      auto &sym = obj.symbols[it.symbol];
+      if (sym.section >= 0) {
+        throw AssemblyError("symbol \"" + line.name + "\" is already defined");
+      }
+      sym.section = cur;
+    } else if (line.kind == Line::INSTRUCTION) {
+      auto m = mnemonics.find(line.name);
+      if (m == mnemonics.end()) {
+        m = mnemonics.emplace(line.name, decode_mnemonic(line.name)).first;
+      }
+      it.mnemonic = &m->second;
+      auto &ops = line.operands;
+      bool jump = m->second.op == JMP || m->second.op == JCC;
+      if (ops.size() == 1 && !ops[0].indirect && ops[0].is_plain_symbol() &&
+          (jump || m->second.op == CALL)) {
+        it.branch = jump;
+        if (ops[0].symbol != ".") {
+          it.symbol = symbol_no(ops[0].symbol);
+        }
+      }
+    } else if (line.kind == Line::DIRECTIVE) {
+      it.resized = line.name == ".balign" || line.name == ".align" ||
+                   line.name == ".p2align" || line.name == ".zero" ||
+                   line.name == ".skip";
+    }
+  }
+
+  final = false;
+  layout(false);
+  while (relax()) {
+    layout(true);
+  }
+
+  final = true;
+  // runs of fixed items are copied at once, as their drafts are contiguous
+  uint64_t run = 0, run_size = 0;
+  int run_section = 0;
+  auto flush = [&]() {
+    auto &section = obj.sections[run_section];
+    section.data.insert(section.data.end(), drafts.begin() + run,
+                        drafts.begin() + run + run_size);
+    section.size += run_size;
+    run_size = 0;
+  };
+  for (auto &it : items) {
+    item = &it;
+    if (it.line->kind == Line::LABEL) {
+      continue;
+    }
+    if (it.line->kind == Line::INSTRUCTION && it.line->loc != loc) {
+      loc = it.line->loc;
+      if (loc.file) {
+        line_row(it.section, it.addr, loc);
+      }
+    }
+    auto &section = obj.sections[it.section];
+    if (it.fixed) {
+      if (run_size && it.section != run_section) {
+        flush();
+      }
+      if (!run_size) {
+        run = it.draft;
+        run_section = it.section;
+      }
+      run_size += it.size;
+      continue;
+    }
+    if (run_size) {
+      flush();
+    }
+    try {
+      encode();
+    } catch (AssemblyError &e) {
+      throw AssemblyError(std::string(e.what()) + " in \"" +
+                          it.line->str().substr(2) + "\"");
+    }
+    if (section.size != it.addr) {
+      throw AssemblyError("internal error: layout mismatch at " +
+                          it.line->str());
+    }
+    for (auto &r : relocs) {
+      symbol(r.symbol); // undefined symbols enter the table here
+      r.offset += it.addr;
+      section.relocations.push_back(std::move(r));
+    }
+    if (section.type == SHT_NOBITS) {
+      for (auto b : buf) {
+        if (b) {
+          throw AssemblyError("non-zero data in " + section.name);
+        }
+      }
+    } else {
+      section.data.insert(section.data.end(), buf.begin(), buf.end());
+    }
+    section.size += buf.size();
+  }
+  if (run_size) {
+    flush();
+  }
+}
+
+Object Assembler::finish() {
+  // calls and jumps to labels defined after them, as in encode()
+  for (int i = 0; i < obj.sections.size(); ++i) {
+    auto &section = obj.sections[i];
+    std::vector<Relocation> relocations;
+    for (auto &r : section.relocations) {
+      auto sym = obj.find_symbol(r.symbol);
+      if ((r.type == R_X86_64_PLT32 || r.type == R_X86_64_PC32) &&
+          sym->section == i) {
+        auto disp = (uint32_t)(sym->value + r.addend - r.offset);
+        for (int j = 0; j < 4; ++j) {
+          section.data[r.offset + j] = disp >> (8 * j);
+        }
+        continue;
+      }
+      if (r.type == R_X86_64_PLT32 && sym->section >= 0) {
+        r.type = R_X86_64_PC32;
+      }
+      relocations.push_back(std::move(r));
+    }
+    section.relocations = std::move(relocations);
+  }
+  eh_frame_section();
+  debug_sections();
+  return std::move(obj);
+}
+
+std::string Assembler::section_label(int i) {
+  auto name = ".Lsection" + std::to_string(i);
+  auto &sym = symbol(name);
+  sym.section = i;
+  sym.value = 0;
+  return name;
+}
+
+void Assembler::line_row(int section, uint64_t addr, const Loc &loc) {
+  auto &program = line_programs[section];
+  auto &data = program.data;
+  if (data.empty()) {
+    // the address is relocated in debug_sections()
+    data.push_back(0);
+    put_uleb128(data, 9);
+    data.push_back(DW_LNE_set_address);
+    put(data, 0, 8);
+    program.start = program.addr = addr;
+    program.loc = Loc(1, 1, 0);
+  }
+  if (loc.file != program.loc.file) {
+    data.push_back(DW_LNS_set_file);
+    put_uleb128(data, loc.file);
+  }
+  if (loc.column != program.loc.column) {
+    data.push_back(DW_LNS_set_column);
+    put_uleb128(data, loc.column);
+  }
+
+  int64_t line = loc.line - program.loc.line;
+  uint64_t advance = addr - program.addr;
+  program.addr = addr;
+  program.loc = loc;
+  // a special opcode advances both and adds the row in a byte
+  if (line >= line_base && line < line_base + line_range &&
+      (line - line_base) + line_range * advance + opcode_base <= 255) {
+    data.push_back((line - line_base) + line_range * advance + opcode_base);
+    return;
+  }
+  if (line) {
+    data.push_back(DW_LNS_advance_line);
+    put_sleb128(data, line);
+  }
+  if (advance) {
+    data.push_back(DW_LNS_advance_pc);
+    put_uleb128(data, advance);
+  }
+  data.push_back(DW_LNS_copy);
+}
+
+void Assembler::cfi(const std::string &name, const std::string &args) {
+  auto addr = item->addr;
+  if (name == ".cfi_startproc") {
+    if (fde >= 0) {
+      throw AssemblyError(".cfi_startproc before .cfi_endproc");
+    }
+    if (eh_frame.empty()) {
+      // the CIE: code alignment 1, data alignment -8, the return address
+      // in %rip (16), FDE addresses 4 bytes relative to themselves (0x1b),
+      // and a CFA of %rsp + 8 with the return address below it
+      put(eh_frame, 0, 4);
+      put(eh_frame, 0, 4);
+      eh_frame.push_back(1);
+      put_string(eh_frame, "zR");
+      put_uleb128(eh_frame, 1);
+      put_sleb128(eh_frame, -8);
+      put_uleb128(eh_frame, 16);
+      put_uleb128(eh_frame, 1);
+      eh_frame.push_back(0x1b);
+      eh_frame.push_back(DW_CFA_def_cfa);
+      put_uleb128(eh_frame, dwarf_register("%rsp"));
+      put_uleb128(eh_frame, 8);
+      eh_frame.push_back(DW_CFA_offset | dwarf_register("%rip"));
+      put_uleb128(eh_frame, 1);
+      while (eh_frame.size() % 8) {
+        eh_frame.push_back(DW_CFA_nop);
+      }
+      patch32(eh_frame, 0, eh_frame.size() - 4);
+    }
+    // the FDE: its length, the distance back to the CIE, the address and
+    // size of the function, and no augmentation data
+    fde = eh_frame.size();
+    fde_section = item->section;
+    fde_start = fde_addr = addr;
+    put(eh_frame, 0, 4);
+    put(eh_frame, fde + 4, 4);
+    eh_relocations.emplace_back(eh_frame.size(), R_X86_64_PC32,
+                                section_label(fde_section), addr);
+    put(eh_frame, 0, 4);
+    put(eh_frame, 0, 4);
+    put_uleb128(eh_frame, 0);
+    return;
+  }
+  if (fde < 0 || item->section != fde_section) {
+    throw AssemblyError(name + " outside of .cfi_startproc");
+  }
+  if (name == ".cfi_endproc") {
+    patch32(eh_frame, fde + 12, addr - fde_start);
+    while ((eh_frame.size() - fde) % 8) {
+      eh_frame.push_back(DW_CFA_nop);
+    }
+    patch32(eh_frame, fde, eh_frame.size() - fde - 4);
+    fde = -1;
+    return;
+  }
+
+  // the rule changes at the address of the directive
+  auto advance = addr - fde_addr;
+  fde_addr = addr;
+  if (advance > 0xffff) {
+    eh_frame.push_back(DW_CFA_advance_loc4);
+    put(eh_frame, advance, 4);
+  } else if (advance > 0xff) {
+    eh_frame.push_back(DW_CFA_advance_loc2);
+    put(eh_frame, advance, 2);
+  } else if (advance >= 0x40) {
+    eh_frame.push_back(DW_CFA_advance_loc1);
+    put(eh_frame, advance, 1);
+  } else if (advance) {
+    eh_frame.push_back(DW_CFA_advance_loc | advance);
+  }
+
+  auto parts = split_args(args);
+  if (name == ".cfi_def_cfa" && parts.size() == 2) {
+    eh_frame.push_back(DW_CFA_def_cfa);
+    put_uleb128(eh_frame, dwarf_register(parts[0]));
+    put_uleb128(eh_frame, absolute(parts[1]));
+  } else if (name == ".cfi_def_cfa_offset" && parts.size() == 1) {
+    eh_frame.push_back(DW_CFA_def_cfa_offset);
+    put_uleb128(eh_frame, absolute(parts[0]));
+  } else if (name == ".cfi_def_cfa_register" && parts.size() == 1) {
+    eh_frame.push_back(DW_CFA_def_cfa_register);
+    put_uleb128(eh_frame, dwarf_register(parts[0]));
+  } else if (name == ".cfi_offset" && parts.size() == 2 &&
+             absolute(parts[1]) < 0 && absolute(parts[1]) % 8 == 0) {
+    // in units of the data alignment
+    eh_frame.push_back(DW_CFA_offset | dwarf_register(parts[0]));
+    put_uleb128(eh_frame, absolute(parts[1]) / -8);
+  } else if (name == ".cfi_remember_state" && parts.empty()) {
+    eh_frame.push_back(DW_CFA_remember_state);
+  } else if (name == ".cfi_restore_state" && parts.empty()) {
+    eh_frame.push_back(DW_CFA_restore_state);
+  } else {
+    throw AssemblyError("unsupported directive \"" + name + "\"");
+  }
+}
+
+void Assembler::eh_frame_section() {
+  if (fde >= 0) {
+    throw AssemblyError(".cfi_startproc without .cfi_endproc");
+  }
+  if (eh_frame.empty()) {
+    return;
+  }
+  auto &section = obj.sections[section_no(".eh_frame")];
+  section.align = 8;
+  section.size = eh_frame.size();
+  section.data = std::move(eh_frame);
+  section.relocations = std::move(eh_relocations);
+}
+
+/*
+ * A compile unit whose line table has a sequence for each section with
+ * rows, which runs to the end of the section, as are the ranges of the
+ * unit. Offsets into the other sections are relocated against them, as the
+ * linker puts the sections of all objects together.
+ */
+void Assembler::debug_sections() {
+  if (line_programs.empty()) {
+    return;
+  }
+  int line = section_no(".debug_line"), info = section_no(".debug_info"),
+      abbrev = section_no(".debug_abbrev"),
+      aranges = section_no(".debug_aranges"),
+      ranges = section_no(".debug_ranges");
+  for (auto n : {line, info, abbrev, aranges, ranges}) {
+    obj.sections[n].flags = 0;
+  }
+  obj.sections[aranges].align = 16;
+
+  // .debug_line: the header, as gas writes it, then the sequences
+  auto &l = obj.sections[line].data;
+  put(l, 0, 4); // the length, patched below
+  put(l, 3, 2); // DWARF 3
+  put(l, 0, 4); // the header length, patched below
+  l.push_back(1); // minimum instruction length
+  l.push_back(1); // rows are statements by default
+  l.push_back((uint8_t)line_base);
+  l.push_back(line_range);
+  l.push_back(opcode_base);
+  for (auto n : {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1}) {
+    l.push_back(n); // the operands of the standard opcodes
+  }
+  l.push_back(0); // no include directories
+  for (auto &file : files) {
+    put_string(l, file);
+    put_uleb128(l, 0); // directory, time and size
+    put_uleb128(l, 0);
+    put_uleb128(l, 0);
+  }
+  l.push_back(0);
+  patch32(l, 6, l.size() - 10);
+  for (auto &p : line_programs) {
+    auto end = obj.sections[p.first].size;
+    obj.sections[line].relocations.emplace_back(
+        l.size() + 3, R_X86_64_64, section_label(p.first), p.second.start);
+    l.insert(l.end(), p.second.data.begin(), p.second.data.end());
+    if (end > p.second.addr) {
+      l.push_back(DW_LNS_advance_pc);
+      put_uleb128(l, end - p.second.addr);
+    }
+    l.push_back(0);
+    put_uleb128(l, 1);
+    l.push_back(DW_LNE_end_sequence);
+  }
+  patch32(l, 0, l.size() - 4);
+
+  // .debug_abbrev: the only abbreviation, 1
+  auto &a = obj.sections[abbrev].data;
+  a.push_back(1);
+  a.push_back(DW_TAG_compile_unit);
+  a.push_back(0); // no children
+  const int attributes[] = {
+      DW_AT_stmt_list, DW_FORM_data4,  DW_AT_low_pc,   DW_FORM_addr,
+      DW_AT_ranges,    DW_FORM_data4,  DW_AT_name,     DW_FORM_string,
+      DW_AT_comp_dir,  DW_FORM_string, DW_AT_producer, DW_FORM_string,
+      DW_AT_language,  DW_FORM_data2,  0,              0};
+  for (auto attr : attributes) {
+    a.push_back(attr);
+  }
+  a.push_back(0);
+
+  // .debug_ranges: of the sections with rows, from a base address of 0
+  auto &r = obj.sections[ranges].data;
+  for (auto &p : line_programs) {
+    auto label = section_label(p.first);
+    obj.sections[ranges].relocations.emplace_back(r.size(), R_X86_64_64,
+                                                  label, 0);
+    put(r, 0, 8);
+    obj.sections[ranges].relocations.emplace_back(
+        r.size(), R_X86_64_64, label, obj.sections[p.first].size);
+    put(r, 0, 8);
+  }
+  put(r, 0, 16);
+
+  // .debug_info: the compile unit, named after the first file
+  auto cwd = ::getcwd(nullptr, 0);
+  std::string comp_dir = cwd ? cwd : "";
+  free(cwd);
+  auto &u = obj.sections[info].data;
+  put(u, 0, 4); // the length, patched below
+  put(u, 3, 2);
+  obj.sections[info].relocations.emplace_back(u.size(), R_X86_64_32,
+                                              section_label(abbrev), 0);
+  put(u, 0, 4);
+  u.push_back(8); // address size
+  put_uleb128(u, 1);
+  obj.sections[info].relocations.emplace_back(u.size(), R_X86_64_32,
+                                              section_label(line), 0);
+  put(u, 0, 4);
+  put(u, 0, 8);
+  obj.sections[info].relocations.emplace_back(u.size(), R_X86_64_32,
+                                              section_label(ranges), 0);
+  put(u, 0, 4);
+  put_string(u, files.empty() ? "" : files[0]);
+  put_string(u, comp_dir);
+  put_string(u, "coolc");
+  put(u, DW_LANG_Mips_Assembler, 2);
+  patch32(u, 0, u.size() - 4);
+
+  // .debug_aranges: the ranges again, for lookups by address
+  auto &ar = obj.sections[aranges].data;
+  put(ar, 0, 4); // the length, patched below
+  put(ar, 2, 2);
+  obj.sections[aranges].relocations.emplace_back(ar.size(), R_X86_64_32,
+                                                 section_label(info), 0);
+  put(ar, 0, 4);
+  ar.push_back(8); // address size
+  ar.push_back(0); // no segments
+  put(ar, 0, 4);   // tuples are aligned to 16
+  for (auto &p : line_programs) {
+    obj.sections[aranges].relocations.emplace_back(
+        ar.size(), R_X86_64_64, section_label(p.first), 0);
+    put(ar, 0, 8);
+    put(ar, obj.sections[p.first].size, 8);
+  }
+  put(ar, 0, 16);
+  patch32(ar, 0, ar.size() - 4);
+
+  for (auto n : {line, info, abbrev, aranges, ranges}) {
+    obj.sections[n].size = obj.sections[n].data.size();
+  }
+}
+
+
+} /* namespace x86 */
@@ -0,0 +1,384 @@
+#ifndef _X86_HH
+#define _X86_HH
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace x86 {
+
+/*
+ * A small in-process assembler for the subset of AT&T syntax that
+ * cool::CodeGenerator emits. It lets the compiler produce a relocatable
+ * object (or executable memory) without spawning `as`.
+ */
+
+enum Register {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+  RIP,
+  NOREG = -1
+};
+
+class AssemblyError : public std::runtime_error {
+public:
+  AssemblyError(const std::string &what_arg) : std::runtime_error(what_arg) {}
+};
+
+class Operand {
+public:
+  enum Kind { NONE, REG, IMM, MEM };
+
+  Operand()
+      : kind(NONE), reg(NOREG), size(8), value(0), base(NOREG), index(NOREG),
+        scale(1), indirect(false) {}
+  // %rax, ...
+  Operand(Register reg)
+      : kind(REG), reg(reg), size(8), value(0), base(NOREG), index(NOREG),
+        scale(1), indirect(false) {}
+
+  bool is_reg(int r) const { return kind == REG && reg == r && size == 8; }
+  bool is_mem() const { return kind == MEM; }
+
+  // `1234` or `sym`, `sym+8` -- an absolute address or a branch target
+  bool is_plain_symbol() const {
+    return kind == MEM && base == NOREG && index == NOREG && !symbol.empty();
+  }
+
+  bool operator==(const Operand &other) const;
+  bool operator!=(const Operand &other) const { return !(*this == other); }
+
+  std::string str() const;
+
+  Kind kind;
+
+  int reg;
+  int size; // register width in bytes (8, or 1 for %al, %cl, ...)
+
+  int64_t value;      // immediate value, or displacement
+  std::string symbol; // symbolic part of the immediate or displacement
+
+  int base, index, scale;
+
+  bool indirect; // `*` prefix of call/jmp
+};
+
+// `$value`
+Operand imm(int64_t value);
+// `$symbol+value`, the address of a symbol
+Operand imm(const std::string &symbol, int64_t value = 0);
+// `value(%base,%index,scale)`
+Operand mem(int64_t value, Register base, Register index = NOREG,
+            int scale = 1);
+// `symbol+value(%base,%index,scale)`
+Operand mem(const std::string &symbol, int64_t value, Register base,
+            Register index = NOREG, int scale = 1);
+// `symbol+value`, a branch target or the memory at an absolute address;
+// numeric labels are referred to as `1f` and `1b`, the instruction itself
+// as `.`
+Operand sym(const std::string &symbol, int64_t value = 0);
+// `%al`, `%cl`, ...
+Operand byte(Register reg);
+// `*op`, of call and jmp
+Operand indirect(Operand op);
+
+// the arguments of a .loc: the source position of an instruction
+class Loc {
+public:
+  Loc() : file(0), line(0), column(0) {}
+  Loc(int file, int line, int column)
+      : file(file), line(line), column(column) {}
+
+  bool operator==(const Loc &other) const {
+    return file == other.file && line == other.line && column == other.column;
+  }
+  bool operator!=(const Loc &other) const { return !(*this == other); }
+
+  int file; // as numbered by .file, 0 if the instruction has no location
+  int line, column;
+};
+
+class Line {
+public:
+  enum Kind { LABEL, DIRECTIVE, INSTRUCTION };
+
+  Line(Kind kind, std::string name) : kind(kind), name(std::move(name)) {}
+
+  std::string str() const;
+
+  Kind kind;
+  std::string name; // label name, directive name or mnemonic
+  std::string args; // raw arguments of a directive
+  std::vector<Operand> operands;
+  Loc loc; // of an instruction
+};
+
+/*
+ * The lines of a program as its generator adds them. Locations are not
+ * lines but stamped on the instructions added after them, so that they
+ * neither block nor get lost in the peephole pass. Numeric labels, which
+ * can be defined again and again, are renamed to ordinary local labels.
+ */
+class Emitter {
+public:
+  Emitter() : here(0) {}
+
+  void label(const std::string &name);
+  void directive(const std::string &name, const std::string &args = "");
+  void ins(const std::string &mnemonic);
+  void ins(const std::string &mnemonic, Operand a);
+  void ins(const std::string &mnemonic, Operand a, Operand b);
+  void ins(const std::string &mnemonic, Operand a, Operand b, Operand c);
+  // hand the lines added so far to `sink`, if any, and drop them
+  void flush();
+
+  std::list<Line> lines;
+  Loc loc; // of the instructions added next
+  std::function<void(std::list<Line> &)> sink;
+
+private:
+  std::map<std::string, int> defined; // instances of each numeric label
+  int here;                           // labels made for `.`
+
+  // a new instruction, with room for `n` operands
+  std::vector<Operand> &add(const std::string &mnemonic, int n);
+  // the numeric labels and `.` in the operands of the last instruction
+  void resolve();
+};
+
+// a .loc is printed before instructions whose loc differs from the last one
+void print(std::ostream &o, const std::list<Line> &lines);
+
+// remove redundant instructions of the function whose label is at `begin`,
+// up to `end`; returns how many
+int peephole(std::list<Line> &lines, std::list<Line>::iterator begin,
+             std::list<Line>::iterator end);
+
+class Relocation {
+public:
+  Relocation(uint64_t offset, uint32_t type, std::string symbol,
+             int64_t addend)
+      : offset(offset), type(type), symbol(symbol), addend(addend) {}
+
+  uint64_t offset;
+  uint32_t type; // R_X86_64_*
+  std::string symbol;
+  int64_t addend;
+};
+
+class Section {
+public:
+  Section(std::string name);
+
+  std::string name;
+  uint32_t type;  // SHT_*
+  uint64_t flags; // SHF_*
+  uint64_t align;
+
+  std::vector<uint8_t> data;
+  uint64_t size; // equals data.size() unless SHT_NOBITS
+
+  std::vector<Relocation> relocations;
+};
+
+class Symbol {
+public:
+  Symbol() : section(-1), value(0), global(false), type(0), size(0) {}
+
+  std::string name;
+  int section; // -1 if undefined
+  uint64_t value;
+  bool global;
+  int type; // STT_*
+  uint64_t size;
+};
+
+class Object {
+public:
+  std::vector<Section> sections;
+
+  std::vector<Symbol> symbols;
+  std::unordered_map<std::string, int> symbols_numbered;
+
+  Symbol *find_symbol(const std::string &name);
+};
+
+/*
+ * Assembles a program a function or so at a time, so that the lines of
+ * each can be freed once added. Calls and jumps to labels that later
+ * lines define are relocated until finish() resolves them. The locations
+ * of instructions and the .cfi_* directives become .debug_line (with the
+ * .debug_info, .debug_abbrev, .debug_aranges and .debug_ranges that make it
+ * found) and .eh_frame, as gas would make them.
+ */
+class Assembler {
+public:
+  Assembler();
+
+  void add(const std::list<Line> &lines);
+  Object finish();
+
+private:
+  // what an instruction is encoded as
+  enum Opcode {
+    MOV,
+    ALU, // add, or, ..., cmp, with the operation in `k`
+    TEST,
+    MOVABS,
+    MOVZB,
+    LEA,
+    PUSH,
+    POP,
+    UNARY, // inc, dec, ..., idiv, with the operation in `k`
+    IMUL,
+    SHIFT, // rol, ..., sar, with the operation in `k`
+    CALL,
+    JMP,
+    JCC, // with the condition code in `k`
+    SETCC,
+    CMOVCC,
+    RET,
+    CQTO,
+    NOP,
+    LEAVE,
+    RDTSC,
+    UD2,
+    INT3
+  };
+
+  class Mnemonic {
+  public:
+    Mnemonic(Opcode op, int k = 0) : op(op), k(k) {}
+
+    Opcode op;
+    int k;
+  };
+
+  class Item {
+  public:
+    Item(const Line *line, int section)
+        : line(line), section(section), addr(0), size(0), mnemonic(nullptr),
+          branch(false), long_branch(false), resized(false), fixed(false),
+          draft(0), symbol(-1) {}
+
+    const Line *line;
+    int section;
+    uint64_t addr;
+    uint64_t size;               // as of the last layout
+    const Mnemonic *mnemonic;    // of an instruction
+    bool branch;                 // a jmp or jcc to a label, maybe short
+    bool long_branch;
+    bool resized; // an alignment or .zero, sized again in every layout
+    bool fixed;  // the bytes at `draft` are final, as nothing is relocated
+    uint64_t draft;
+    int symbol; // the number of a label, or of the target of a call or jmp
+  };
+
+  // the DWARF line number program of a section, as its rows are added
+  class LineProgram {
+  public:
+    std::vector<uint8_t> data; // up to the end of the sequence
+    uint64_t start;            // the address of the first row
+    uint64_t addr;             // of the last row
+    Loc loc;                   // of the last row
+  };
+
+  Object obj;
+  int cur;                // the current section
+  std::vector<int> stack; // of .pushsection
+  std::vector<Item> items; // of the lines being added
+
+  std::vector<std::string> files; // of .file, from 1
+  Loc loc;                        // of the last instruction added
+  std::map<int, LineProgram> line_programs; // by section
+
+  std::vector<uint8_t> eh_frame;   // the CIE and the FDEs so far
+  std::vector<Relocation> eh_relocations;
+  int fde;            // the offset of the FDE being made, -1 if none
+  int fde_section;    // where its function is
+  uint64_t fde_start; // the address of its function
+  uint64_t fde_addr;  // of its last instruction
+
+  bool final;
+  Item *item;
+  std::vector<uint8_t> buf;
+  std::vector<Relocation> relocs; // offsets relative to `buf`
+  std::vector<uint8_t> drafts;    // the bytes of the fixed items
+  std::map<std::string, Mnemonic> mnemonics; // by instruction name
+
+  // `m` without its operand size suffix; false if unknown
+  static bool known_mnemonic(const std::string &m, Opcode &op, int &k);
+  // `movq` and `mov` -> MOV, `pushq` -> PUSH, `jne` -> JCC 5, ...
+  static Mnemonic decode_mnemonic(const std::string &m);
+
+  int section_no(const std::string &name);
+  void switch_section(const std::string &args, const std::string &directive);
+
+  // a local label at the start of section `i`, to relocate against
+  std::string section_label(int i);
+  int symbol_no(const std::string &name);
+  Symbol &symbol(const std::string &name);
+  bool lookup(const std::string &name, int &section, uint64_t &value);
+  // where the target of the call or jmp being encoded is, if defined
+  bool lookup_target(const Operand &target, int &section, uint64_t &value);
+
+  void layout(bool sized);
+  bool relax();
+
+  void encode();
+  void directive();
+  void instruction();
+
+  // a row of the line table, for the instruction at `addr`
+  void line_row(int section, uint64_t addr, const Loc &loc);
+  // a .cfi_* directive, at the address of the item being encoded
+  void cfi(const std::string &name, const std::string &args);
+  void debug_sections();
+  void eh_frame_section();
+
+  int64_t absolute(const std::string &expr);
+  bool relocatable(const std::string &expr, std::string &sym, int64_t &addend);
+  void data(const std::string &args, int size);
+  void string_data(const std::string &args, bool terminate);
+  // no padding is added if it would take more than `max` bytes, unless 0
+  void align(uint64_t n, bool power_of_two, uint64_t max);
+
+  void emit(uint8_t b) { buf.push_back(b); }
+  void emit(uint64_t v, int n);
+  void emit_rex(bool w, int reg, const Operand &rm);
+  void emit_modrm(int reg, const Operand &rm, int imm_bytes);
+  void emit_op(std::initializer_list<uint8_t> opcode, bool w, int reg,
+               const Operand &rm, int imm_bytes);
+  void emit_abs32(int64_t value, const std::string &symbol);
+  void emit_imm(const Operand &imm, int n);
+  void emit_rel32(const Operand &target, uint32_t reloc_type);
+
+  bool fits_rel8(const Operand &target, int size);
+};
+
+// a label that never shows up in the symbol table
+bool is_local_label(const std::string &name);
+
+} /* namespace x86 */
+
+#endif /* _X86_HH */
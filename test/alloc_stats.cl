@@ -0,0 +1,22 @@
+class Point {
+    x: Int;
+    y: Int;
+    init(a: Int, b: Int): Point {{ x <- a; y <- b; self; }};
+    sum(): Int { x + y };
+};
+
+class Main inherits IO {
+    main(): Int {
+        let i: Int <- 0, total: Int <- 0, s: String <- "" in {
+            while i < 10 loop {
+                total <- total + (new Point).init(i, i * 2).sum();
+                s <- s.concat("ab");
+                i <- i + 1;
+            } pool;
+            out_string(s.concat(" ").concat(total.to_string()).concat("\n"));
+            0;
+        }
+    };
+};
+
+-- abababababababababab 135
@@ -0,0 +1,36 @@
+class Main inherits IO
+{
+    main(): Int
+    {{
+        let x : Int <- 1000003,
+            y : Int <- ~1000003,
+            z : Int <- ~1073741824 * 1073741824 * 8
+        in {
+            puti(x * 0); -- 0
+            puti(x * 8); -- 8000024
+            puti(y * 10); -- -10000030
+            puti(7 * y); -- -7000021
+            puti(x * 1000); -- 1000003000
+            puti(x * ~9); -- -9000027
+            puti(z * 3); -- -9223372036854775808
+            puti(x / 1); -- 1000003
+            puti(y / 4); -- -250000
+            puti(y / ~4); -- 250000
+            puti(x / 7); -- 142857
+            puti(y / 7); -- -142857
+            puti(y / ~10); -- 100000
+            puti(z / 3); -- -3074457345618258602
+            puti(z / 8); -- -1152921504606846976
+            puti(z / z); -- 1
+            puti(x - x / 97 * 97); -- 30
+            puti(y - y / 97 * 97); -- -30
+        };
+        0;
+    }};
+
+    puti(i: Int) : SELF_TYPE
+    {{
+        out_string(i.to_string().concat("\n"));
+        self;
+    }};
+};
@@ -0,0 +1,90 @@
+class Point {
+    x: Int;
+
+    init(v: Int): Point {{ x <- v; self; }};
+    x(): Int { x };
+};
+
+class Main inherits IO {
+    puts(s: String): SELF_TYPE { out_string(s.concat("\n")) };
+
+    (* the primes below n, by the sieve of Eratosthenes *)
+    primes(n: Int): IntArray {
+        let composite: IntArray <- (new IntArray).new_array(n),
+            res: IntArray <- (new IntArray).new_array(n), count: Int <- 0,
+            i: Int <- 2 in {
+            while i < n loop {
+                if composite.get(i) = 0 then {
+                    res.set(count, i);
+                    count <- count + 1;
+                    let j: Int <- i * i in
+                        while j < n loop {
+                            composite.set(j, 1);
+                            j <- j + i;
+                        } pool;
+                } else 0 fi;
+                i <- i + 1;
+            } pool;
+            let trimmed: IntArray <- res.new_array(count), k: Int <- 0 in {
+                while k < count loop {
+                    trimmed.set(k, res.get(k));
+                    k <- k + 1;
+                } pool;
+                trimmed;
+            };
+        }
+    };
+
+    main(): Int {
+        let p: IntArray <- primes(50), s: String <- "", i: Int <- 0 in {
+            while i < p.length() loop {
+                s <- s.concat(p.get(i).to_string()).concat(" ");
+                i <- i + 1;
+            } pool;
+            puts(s);
+            puts(p.length().to_string());
+
+            let points: Array <- (new Array).new_array(4), sum: Int <- 0,
+                copy: Array, j: Int <- 0 in {
+                puts(if isvoid points.get(3) then "void" else "not void" fi);
+                while j < 3 loop {
+                    points.set(j, (new Point).init(j * 10));
+                    j <- j + 1;
+                } pool;
+                points.set(3, "four");
+                let o: Object <- points.copy() in
+                    case o of c: Array => copy <- c; esac;
+                points.set(0, (new Point).init(100));
+                j <- 0;
+                while j < 3 loop {
+                    case copy.get(j) of
+                        q: Point => sum <- sum + q.x();
+                    esac;
+                    j <- j + 1;
+                } pool;
+                puts(sum.to_string());
+                case points.get(0) of q: Point => puts(q.x().to_string()); esac;
+                case points.get(3) of t: String => puts(t); esac;
+                puts(points.type_name().concat(" ").concat(p.type_name()));
+                puts((new Array).length().to_string());
+            };
+
+            let a: IntArray <- (new IntArray).new_array(3) in {
+                a.set(0, 7).set(1, 0 - 8);
+                a.set(2, a.get(0) * a.get(1));
+                puts(a.get(2).to_string());
+            };
+            0;
+        }
+    };
+};
+
+-- 2 3 5 7 11 13 17 19 23 29 31 37 41 43 47 
+-- 15
+-- void
+-- 30
+-- 100
+-- four
+-- Array IntArray
+-- 0
+-- -56
@@ -0,0 +1,12 @@
+class Main {
+    main(): Int {
+        let a: IntArray <- (new IntArray).new_array(3), i: Int <- 0,
+            sum: Int <- 0 in {
+            while i <= a.length() loop {
+                sum <- sum + a.get(i); -- fatal error: array index out of bounds
+                i <- i + 1;
+            } pool;
+            sum;
+        }
+    };
+};
@@ -0,0 +1,30 @@
+class Main inherits IO {
+    clock: Clock <- new Clock;
+
+    spin(n: Int): Int {
+        let i: Int <- 0 in {
+            while i < n loop i <- i + 1 pool;
+            i;
+        }
+    };
+
+    main(): Int {
+        let t0: Int <- clock.now_ns(), c0: Int <- clock.cycles(),
+            p0: Int <- clock.cpu_time_ns(), n: Int <- spin(1000000),
+            t1: Int <- clock.now_ns(), c1: Int <- clock.cycles(),
+            p1: Int <- clock.cpu_time_ns() in {
+            out_string(if 0 < t0 then "now_ns positive\n" else "now_ns not positive\n" fi);
+            out_string(if t0 < t1 then "now_ns increases\n" else "now_ns does not increase\n" fi);
+            out_string(if c0 < c1 then "cycles increase\n" else "cycles do not increase\n" fi);
+            out_string(if p0 < p1 then "cpu_time_ns increases\n" else "cpu_time_ns does not increase\n" fi);
+            out_string((new Clock).type_name().concat("\n"));
+            0;
+        }
+    };
+};
+
+-- now_ns positive
+-- now_ns increases
+-- cycles increase
+-- cpu_time_ns increases
+-- Clock
@@ -0,0 +1,27 @@
+class Shape {
+    name(): String { "shape" };
+};
+
+class Circle inherits Shape {
+    name(): String { "circle" };
+};
+
+class Main inherits IO {
+    describe(s: Shape): String {
+        case s of
+            c: Circle => "round ".concat(c.name());
+            x: Shape => x.name();
+        esac
+    };
+
+    main(): Int {
+        let shapes: Shape <- new Shape, circle: Shape <- new Circle in {
+            out_string(describe(shapes).concat("\n"));
+            out_string(describe(circle).substr(0, 5).concat("\n"));
+            0;
+        }
+    };
+};
+
+-- shape
+-- round
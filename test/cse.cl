@@ -0,0 +1,36 @@
+class Point {
+    x : Int <- 3;
+    y : Int <- 4;
+
+    init(a : Int, b : Int) : Point {{ x <- a; y <- b; self; }};
+
+    (* -O2 computes x * 10 + y once *)
+    square() : Int { (x * 10 + y) * (x * 10 + y) };
+
+    (* and x / 3 once, as division by 3 cannot trap *)
+    thirds(k : Int) : Int { x / 3 + x / 3 + k * 10 };
+
+    (* but loads x again after it is assigned *)
+    bump() : Int { x * 2 + (x <- x + 1) + x * 2 };
+};
+
+class Main inherits IO
+{
+    main() : Int
+    {
+        let p : Point <- new Point in {
+            puti(p.square()); -- 1156
+            puti(p.thirds(2)); -- 22
+            puti(p.init(~7, 5).square()); -- 4225
+            puti(p.thirds(~1)); -- -14
+            puti(p.bump()); -- -32
+            0;
+        }
+    };
+
+    puti(i : Int) : SELF_TYPE
+    {{
+        out_string(i.to_string().concat("\n"));
+        self;
+    }};
+};
@@ -0,0 +1,52 @@
+class Shape {
+    name() : String { "shape" };
+    area() : Int { 0 };
+    describe() : String { name().concat(" ").concat(area().to_string()) };
+};
+
+class Square inherits Shape {
+    side : Int <- 3;
+    name() : String { "square" };
+    area() : Int { side * side };
+};
+
+class Circle inherits Shape {
+    name() : String { "circle" };
+    area() : Int { 3 };
+};
+
+class Unused inherits IO {
+    never() : Object { out_string("never\n") };
+};
+
+class Base {
+    greet() : String { "base" };
+};
+
+class Derived inherits Base {
+    greet() : String { "derived" };
+    both() : String { greet().concat(self@Base.greet()) };
+};
+
+class Main inherits IO {
+    shapes : Shape;
+
+    puts(s : String) : SELF_TYPE {
+        out_string(s.concat("\n"))
+    };
+
+    show(s : Shape) : SELF_TYPE { puts(s.describe()) };
+
+    main(): Int {{
+        show(new Shape);
+        show(make());
+        puts((new Derived).both());
+        0;
+    }};
+
+    make() : Shape { new Square };
+};
+
+-- shape 0
+-- square 9
+-- derivedbase
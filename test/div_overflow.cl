@@ -0,0 +1,12 @@
+(* INT64_MIN / -1 does not fit, and traps like division by 0 *)
+class Main inherits IO {
+    min(): Int { (~2147483647 - 1) * 1073741824 * 4 };
+
+    main(): Int {
+        let x : Int <- min() / ~1 in {
+            out_string(x.to_string());
+            out_string("not reached\n");
+            0;
+        }
+    };
+};
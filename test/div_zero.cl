@@ -0,0 +1,10 @@
+(* the quotient is unused, but the division still traps *)
+class Main inherits IO {
+    main(): Int {
+        let x : Int <- 7 in {
+            x / 0;
+            out_string("not reached\n");
+            0;
+        }
+    };
+};
@@ -0,0 +1,48 @@
+class A {
+    n : Int <- 3;
+    n() : Int { n };
+    set(m : Int) : Int { n <- m };
+};
+
+class Main inherits IO
+{
+    main(): Int
+    {{
+        let i1 : Int <- 7 / 2,
+            i2 : Int <- ~7 / 2,
+            i3 : Int <- 2147483647 * 2 + 2,
+            i4 : Int <- i3 / ~2,
+            i5 : Int <- (1 + 2) * (1 + 2) + 0 * i1,
+            b : Bool <- not (1 < 2),
+            x : Int <- 1,
+            a : A <- new A
+        in {
+            puti(i1); -- 3
+            puti(i2); -- -3
+            puti(i3); -- 4294967296
+            puti(i4); -- -2147483648
+            puti(i5); -- 9
+            putb(b); -- false
+            putb(isvoid 1); -- false
+            putb(isvoid (if b then a else a fi)); -- false
+            puti(if b then 1 else 2 fi); -- 2
+            puti(x + (x <- 5)); -- 10
+            putb(x < (x <- 6)); -- true
+            puti(a.n() + a.set(4) + a.n()); -- 11
+            puti(case x of y : Int => y + 1; z : Object => 0; esac); -- 7
+        };
+        0;
+    }};
+
+    puti(i: Int) : SELF_TYPE
+    {{
+        out_string(i.to_string().concat("\n"));
+        self;
+    }};
+
+    putb(b: Bool) : SELF_TYPE
+    {{
+        out_string(if b then "true\n" else "false\n" fi);
+        self;
+    }};
+};
@@ -0,0 +1,40 @@
+class Main inherits IO
+{
+    greeting : String <- "hello, ".concat("world");
+
+    main(): Int
+    {{
+        puts(greeting); -- hello, world
+        puti(greeting.length()); -- 12
+        puti(60 * 60 * 24 * 365); -- 31536000
+        puti(2147483647 * 2147483647 * 4); -- -17179869180
+        puti(~2147483647 * 2147483647 * 4 * 1073741824 * 2); -- -8589934592
+        puti(~1073741824 * 1073741824 * 8); -- -9223372036854775808
+        puti(~1073741824 * 1073741824 * 8 - 1); -- 9223372036854775807
+        puti(~7 / 2); -- -3
+        puts(123.to_string().concat((~45).to_string())); -- 123-45
+        puti("abc".concat("de").length()); -- 5
+        putb(1 + 1 < 3); -- true
+        putb(not (2 * 3 = 6)); -- false
+        putb(4 <= 2 + 2); -- true
+        putb(isvoid 0); -- false
+        puti(let x : Int <- 7 in x + 2 * 3); -- 13
+        0;
+    }};
+
+    puts(s: String) : SELF_TYPE
+    {{
+        out_string(s.concat("\n"));
+        self;
+    }};
+
+    puti(i: Int) : SELF_TYPE
+    {{
+        puts(i.to_string());
+    }};
+
+    putb(b: Bool) : SELF_TYPE
+    {{
+        puts(if b then "true" else "false" fi);
+    }};
+};
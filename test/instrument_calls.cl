@@ -0,0 +1,29 @@
+class Shape {
+    area(): Int { 0 };
+};
+
+class Square inherits Shape {
+    side: Int;
+    init(s: Int): Square {{ side <- s; self; }};
+    area(): Int { side * side };
+};
+
+class Main inherits IO {
+    (* tail-recursive, which instrumented is called again every time *)
+    sum(n: Int, acc: Int): Int {
+        if n = 0 then acc else sum(n - 1, acc + n) fi
+    };
+
+    main(): Int {
+        let s: Shape <- new Square.init(3), total: Int <- 0, i: Int <- 0 in {
+            while i < 4 loop {
+                total <- total + s.area();
+                i <- i + 1;
+            } pool;
+            out_string(total.to_string().concat(" ").concat(sum(10, 0).to_string()).concat("\n"));
+            0;
+        }
+    };
+};
+
+-- 36 55
@@ -0,0 +1,24 @@
+(* every method starts at the line it is defined on, and has call frame
+   information *)
+class Counter {
+    n: Int;
+
+    inc(): Counter {{
+        n <- n + 1;
+        self;
+    }};
+
+    get(): Int { n };
+};
+
+class Main inherits IO {
+    main(): Int {
+        let c: Counter <- new Counter in {
+            c.inc().inc();
+            out_string(c.get().to_string().concat("\n"));
+            0;
+        }
+    };
+};
+
+-- 2
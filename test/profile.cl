@@ -0,0 +1,43 @@
+class Shape {
+    area(): Int { 0 };
+    name(): String { "shape" };
+};
+
+class Square inherits Shape {
+    side: Int <- 3;
+    side(): Int { side };
+    area(): Int { side * side };
+    name(): String { "square" };
+};
+
+class Circle inherits Shape {
+    r: Int <- 2;
+    area(): Int { 3 * r * r };
+    name(): String { "circle" };
+};
+
+class Main inherits IO {
+    shape(i: Int): Shape {
+        if i - i / 10 * 10 = 0 then new Circle else new Square fi
+    };
+
+    main(): Int {
+        let i: Int <- 0, area: Int <- 0, squares: Int <- 0, s: Shape in {
+            while i < 100 loop {
+                s <- shape(i);
+                area <- area + s.area();
+                case s of
+                    c: Circle => out_string(c.name()).out_string(" ");
+                    q: Square => squares <- squares + q.side();
+                esac;
+                i <- i + 1;
+            } pool;
+            out_string("\n");
+            out_string(area.to_string()).out_string(" ").out_string(squares.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- circle circle circle circle circle circle circle circle circle circle 
+-- 930 270
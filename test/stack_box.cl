@@ -0,0 +1,34 @@
+class Main inherits IO {
+    keep : Object;
+
+    puts(s : String) : SELF_TYPE {
+        out_string(s.concat("\n"))
+    };
+
+    poly(x : Int) : Int { 3 * x * x - 2 * x + 7 };
+
+    main(): Int {
+        let s : String <- "hello world", i : Int <- 0, n : Int <- 4 in {
+            puts((poly(5) + ~i * 2 - 100 / (n - 1)).to_string());
+            puts(s.substr(n + 2, n / 2 + 9));
+            puts((i + 1).type_name());
+            while i < 3 loop {
+                keep <- (i * 10 + 1).copy();
+                puts(s.substr(i * 2, i * 2 + 2).concat((i * i).to_string()));
+                i <- i + 1;
+            } pool;
+            case keep of k : Int => puts(k.to_string()); esac;
+            if n * n < n + n * 4 then puts("less") else puts("more") fi;
+            0;
+        }
+    };
+};
+
+-- 39
+-- world
+-- Int
+-- he0
+-- ll1
+-- o 4
+-- 21
+-- less
@@ -0,0 +1,61 @@
+class Walker {
+    count(l : List, n : Int) : Int {
+        case l of
+            c : Cons => count(c.tail(), n + 1);
+            e : List => n;
+        esac
+    };
+};
+
+class List {
+    prepend(x : Int) : List { (new Cons).init(x, self) };
+};
+
+class Cons inherits List {
+    head : Int;
+    tail : List;
+    init(x : Int, l : List) : List {{ head <- x; tail <- l; self; }};
+    tail() : List { tail };
+};
+
+class Main inherits IO {
+    sum(n : Int, acc : Int) : Int {
+        if n = 0 then acc else sum(n - 1, acc + n) fi
+    };
+
+    even(n : Int) : Bool {
+        if n = 0 then true else odd(n - 1) fi
+    };
+
+    odd(n : Int) : Bool {
+        if n = 0 then false else even(n - 1) fi
+    };
+
+    done(acc : Int) : Int { acc };
+
+    count_up(n : Int, acc : Int) : Int {
+        if n = 0 then done(acc) else {
+            let next : Int <- n - 1 in count_up(next, acc + 2);
+        } fi
+    };
+
+    puts(s : String) : SELF_TYPE {
+        out_string(s.concat("\n"))
+    };
+
+    main(): Int {
+        let l : List <- new List, i : Int <- 0 in {
+            puts(sum(1000000, 0).to_string());
+            if even(1000001) then puts("even") else puts("odd") fi;
+            puts(count_up(1000000, 0).to_string());
+            while i < 1000000 loop { l <- l.prepend(i); i <- i + 1; } pool;
+            puts((new Walker).count(l, 0).to_string());
+            0;
+        }
+    };
+};
+
+-- 500000500000
+-- odd
+-- 2000000
+-- 1000000
@@ -0,0 +1,69 @@
+class Visitor {
+    visit_num(n: Num): Int { 0 };
+    visit_add(a: Add): Int { 0 };
+};
+
+class Eval inherits Visitor {
+    visit_num(n: Num): Int { n.value() };
+    visit_add(a: Add): Int { a.left().accept(self) + a.right().accept(self) };
+};
+
+class Count inherits Visitor {
+    visit_num(n: Num): Int { 1 };
+    visit_add(a: Add): Int { a.left().accept(self) + a.right().accept(self) + 1 };
+};
+
+class Expr {
+    accept(v: Visitor): Int { 0 };
+};
+
+class Num inherits Expr {
+    value: Int;
+    init(x: Int): Num {{ value <- x; self; }};
+    value(): Int { value };
+    accept(v: Visitor): Int { v.visit_num(self) };
+};
+
+class Add inherits Expr {
+    left: Expr;
+    right: Expr;
+    init(l: Expr, r: Expr): Add {{ left <- l; right <- r; self; }};
+    left(): Expr { left };
+    right(): Expr { right };
+    accept(v: Visitor): Int { v.visit_add(self) };
+};
+
+(* more receiver classes than a dispatch tests for *)
+class A { f(): Int { 1 }; };
+class B inherits A { f(): Int { 2 }; };
+class C inherits A { f(): Int { 3 }; };
+class D inherits A { f(): Int { 4 }; };
+class E inherits A { f(): Int { 5 }; };
+
+class Main inherits IO {
+    pick(i: Int): A {
+        if i = 0 then new A else
+        if i = 1 then new B else
+        if i = 2 then new C else
+        if i = 3 then new D else new E fi fi fi fi
+    };
+
+    main(): Int {
+        let e: Expr <- (new Add).init((new Num).init(3),
+                            (new Add).init((new Num).init(4), (new Num).init(5))),
+            i: Int <- 0, sum: Int <- 0 in {
+            out_string(e.accept(new Eval).to_string()).out_string("\n");
+            out_string(e.accept(new Count).to_string()).out_string("\n");
+            while i < 10 loop {
+                sum <- sum + pick(i - i / 5 * 5).f();
+                i <- i + 1;
+            } pool;
+            out_string(sum.to_string()).out_string("\n");
+            0;
+        }
+    };
+};
+
+-- 12
+-- 5
+-- 30
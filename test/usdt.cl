@@ -0,0 +1,18 @@
+class Counter {
+    n: Int;
+    inc(): Counter {{ n <- n + 1; self; }};
+    get(): Int { n };
+};
+
+class Main inherits IO {
+    (* in_string is never called, so neither it nor its probe is left *)
+    main(): Int {
+        let c: Counter <- new Counter in {
+            c.inc().inc();
+            out_string(c.get().to_string().concat("\n"));
+            0;
+        }
+    };
+};
+
+-- 2
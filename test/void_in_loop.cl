@@ -0,0 +1,30 @@
+class Node {
+    next : Node;
+    set_next(n : Node) : Node { next <- n };
+    next() : Node { next };
+};
+
+class Main inherits IO
+{
+    puts(s : String) : SELF_TYPE {
+        out_string(s.concat("\n"))
+    };
+
+    main(): Int {
+        let n : Node <- new Node,
+            i : Int <- 0
+        in {
+            n.set_next(new Node);
+            (new Node).next();
+            self.type_name();
+            "a".concat("b").length();
+            case n of m : Node => m.next().next(); esac;
+            while i < 5 loop {
+                n.type_name(); -- fatal error: invoke on void
+                n <- n.next();
+                i <- i + 1;
+            } pool;
+            0;
+        }
+    };
+};
@@ -7,6 +7,11 @@ class Main inherits IO {
                 i <- i + 1;
             } pool;
             out_string(total.to_string().concat("\n")); -- 5050
+            if isvoid (while 0 < i loop i <- i - 1 pool) then
+                out_string("void\n") -- void
+            else
+                out_string("not void\n")
+            fi;
         };
         0;
     }};